@@ -0,0 +1,162 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cstdint>
+#include <type_traits>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+
+namespace persia {
+
+
+    namespace detail {
+
+
+        // Atomic access to plain integers placed in mapped memory, where
+        // std::atomic objects can't be constructed
+#if defined(_MSC_VER) && !defined(__clang__)
+
+        inline std::uint64_t load_acquire(std::uint64_t const* p) noexcept {
+            auto const value = *static_cast<std::uint64_t const volatile*>(p);
+            _ReadWriteBarrier();
+            return value;
+        }
+
+
+        inline void store_release(std::uint64_t* p, std::uint64_t value) noexcept {
+            _ReadWriteBarrier();
+            *static_cast<std::uint64_t volatile*>(p) = value;
+        }
+
+
+        inline std::uint32_t load_acquire(std::uint32_t const* p) noexcept {
+            auto const value = *static_cast<std::uint32_t const volatile*>(p);
+            _ReadWriteBarrier();
+            return value;
+        }
+
+
+        inline void store_release(std::uint32_t* p, std::uint32_t value) noexcept {
+            _ReadWriteBarrier();
+            *static_cast<std::uint32_t volatile*>(p) = value;
+        }
+
+
+        inline std::uint64_t exchange(std::uint64_t* p, std::uint64_t value) noexcept {
+            return std::uint64_t(_InterlockedExchange64(reinterpret_cast<long long volatile*>(p),
+                                                        (long long)(value)));
+        }
+
+
+        inline std::uint64_t fetch_or(std::uint64_t* p, std::uint64_t value) noexcept {
+            return std::uint64_t(_InterlockedOr64(reinterpret_cast<long long volatile*>(p),
+                                                  (long long)(value)));
+        }
+
+
+        // Returns the previous value, wraps around on overflow
+        template<typename T> T fetch_add(T* p, T delta) noexcept {
+            static_assert(std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) <= 8,
+                          "T should be integral");
+            if constexpr(sizeof(T) == 8)
+                return T(_InterlockedExchangeAdd64(reinterpret_cast<long long volatile*>(p), (long long)(delta)));
+            else if constexpr(sizeof(T) == 4)
+                return T(_InterlockedExchangeAdd(reinterpret_cast<long volatile*>(p), long(delta)));
+            else if constexpr(sizeof(T) == 2)
+                return T(_InterlockedExchangeAdd16(reinterpret_cast<short volatile*>(p), short(delta)));
+            else
+                return T(_InterlockedExchangeAdd8(reinterpret_cast<char volatile*>(p), char(delta)));
+        }
+
+
+        // On failure 'expected' receives the current value
+        inline bool compare_exchange(std::uint64_t* p, std::uint64_t& expected, std::uint64_t desired) noexcept {
+            auto const previous = std::uint64_t(
+                _InterlockedCompareExchange64(reinterpret_cast<long long volatile*>(p),
+                                              (long long)(desired), (long long)(expected)));
+            if(previous == expected)
+                return true;
+            expected = previous;
+            return false;
+        }
+
+
+        inline void acquire_fence() noexcept {
+            _ReadWriteBarrier();
+        }
+
+
+        inline void release_fence() noexcept {
+            _ReadWriteBarrier();
+        }
+
+#else
+
+        inline std::uint64_t load_acquire(std::uint64_t const* p) noexcept {
+            return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        }
+
+
+        inline void store_release(std::uint64_t* p, std::uint64_t value) noexcept {
+            __atomic_store_n(p, value, __ATOMIC_RELEASE);
+        }
+
+
+        inline std::uint32_t load_acquire(std::uint32_t const* p) noexcept {
+            return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        }
+
+
+        inline void store_release(std::uint32_t* p, std::uint32_t value) noexcept {
+            __atomic_store_n(p, value, __ATOMIC_RELEASE);
+        }
+
+
+        inline std::uint64_t exchange(std::uint64_t* p, std::uint64_t value) noexcept {
+            return __atomic_exchange_n(p, value, __ATOMIC_ACQ_REL);
+        }
+
+
+        inline std::uint64_t fetch_or(std::uint64_t* p, std::uint64_t value) noexcept {
+            return __atomic_fetch_or(p, value, __ATOMIC_ACQ_REL);
+        }
+
+
+        // Returns the previous value, wraps around on overflow
+        template<typename T> T fetch_add(T* p, T delta) noexcept {
+            static_assert(std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) <= 8,
+                          "T should be integral");
+            return __atomic_fetch_add(p, delta, __ATOMIC_ACQ_REL);
+        }
+
+
+        // On failure 'expected' receives the current value
+        inline bool compare_exchange(std::uint64_t* p, std::uint64_t& expected, std::uint64_t desired) noexcept {
+            return __atomic_compare_exchange_n(p, &expected, desired, false,
+                                               __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        }
+
+
+        inline void acquire_fence() noexcept {
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        }
+
+
+        inline void release_fence() noexcept {
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+        }
+
+#endif
+
+
+    } // namespace detail
+
+
+} // namespace persia
@@ -0,0 +1,805 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <optional>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include <persia/mapped_file.hpp>
+
+
+namespace persia {
+
+
+    enum class bitset_storage_error {
+        ok,
+        invalid_file_signature,
+        mismatch_file_size,
+        file_is_corrupted
+    }; // bitset_storage_error
+
+
+    class bitset_storage_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "bitset_storage";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(bitset_storage_error(code)) {
+            case bitset_storage_error::ok:
+                return "Ok";
+            case bitset_storage_error::invalid_file_signature:
+                return "Invalid bitset storage file signature";
+            case bitset_storage_error::mismatch_file_size:
+                return "Mismatch file size";
+            case bitset_storage_error::file_is_corrupted:
+                return "File is corrupted";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline bitset_storage_error_category const bitset_storage_error_category;
+
+
+    inline std::error_code make_error_code(bitset_storage_error e) noexcept {
+        return {int(e), bitset_storage_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::bitset_storage_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    namespace detail {
+
+#if defined(_MSC_VER) && !defined(__clang__)
+
+        inline unsigned popcount(std::uint64_t word) noexcept {
+            return unsigned(__popcnt64(word));
+        }
+
+
+        inline unsigned lowest_bit(std::uint64_t word) noexcept {
+            unsigned long index;
+            _BitScanForward64(&index, word);
+            return unsigned(index);
+        }
+
+#else
+
+        inline unsigned popcount(std::uint64_t word) noexcept {
+            return unsigned(__builtin_popcountll(word));
+        }
+
+
+        inline unsigned lowest_bit(std::uint64_t word) noexcept {
+            return unsigned(__builtin_ctzll(word));
+        }
+
+#endif
+
+
+        struct alignas(64) bitset_header {
+            unsigned char signature[4];
+            std::uint32_t unit_size{0};
+            std::uint64_t capacity{0};
+            std::uint64_t used{0};
+            std::uint64_t cardinality{0};
+            std::uint32_t free[8]{};
+        }; // bitset_header
+
+
+        inline constexpr unsigned char bitset_signature[4] = {0xB1, 0x75, 0xE7, 0x5A};
+
+    } // namespace detail
+
+
+    // Set of 32-bit integers split by high 16 bits into containers like
+    // roaring bitmaps: up to 4096 low halves are kept as sorted array, more
+    // as 8K bitmap. Containers are allocated in 64-byte units of the file
+    // from free lists of power of two sizes and kept until emptied, so
+    // churn doesn't fragment the lists. Their directory has fixed slots for
+    // every high half, sparse sets leave most of it as holes.
+    // Set operations expand containers to bitmaps and combine them by plain
+    // word loops vectorized by compilers. File grows by doubling, which
+    // remaps it; mutations aren't atomic against crashes.
+    class bitset_storage {
+    public:
+
+        using value_type = std::uint32_t;
+        using size_type = std::uint64_t;
+
+        static constexpr std::size_t unit_size = 64;
+        static constexpr std::uint32_t array_limit = 4096;
+
+        class expected;
+        class const_iterator;
+
+        static expected create(std::filesystem::path const& path);
+        static expected open(std::filesystem::path const& path);
+        static expected open_or_create(std::filesystem::path const& path);
+
+    private:
+
+        static constexpr std::size_t containers = 65536;
+        static constexpr std::size_t bitmap_words = 1024;
+        static constexpr std::uint32_t bitmap_units = 128;
+        static constexpr std::size_t blocks_offset = sizeof(detail::bitset_header);
+        static constexpr std::size_t cardinalities_offset = blocks_offset + containers * sizeof(std::uint32_t);
+        static constexpr std::size_t data_offset = cardinalities_offset + containers * sizeof(std::uint32_t);
+        static constexpr std::uint64_t initial_capacity = 1024;
+        static constexpr unsigned class_shift = 28;
+        static constexpr std::uint32_t unit_mask = (std::uint32_t(1) << class_shift) - 1;
+
+        using bitmap = std::uint64_t[bitmap_words];
+
+        mapped_file mapped_file_;
+        detail::bitset_header* header_{nullptr};
+        // First unit of container by high half, zero for absent ones, with
+        // binary logarithm of its size in the top bits
+        std::uint32_t* blocks_{nullptr};
+        std::uint32_t* cardinalities_{nullptr};
+        char* data_{nullptr};
+        // Fenwick tree over cardinalities of containers for rank and select
+        std::vector<std::uint64_t> sums_;
+        std::filesystem::path path_;
+
+        bitset_storage(mapped_file&& mapped_file, std::filesystem::path const& path)
+            : mapped_file_{std::move(mapped_file)}, sums_(containers), path_{path} {
+            refresh();
+            for(auto i = std::size_t(1); i <= containers; ++i) {
+                sums_[i - 1] += cardinalities_[i - 1];
+                auto const parent = i + (i & (~i + 1));
+                if(parent <= containers)
+                    sums_[parent - 1] += sums_[i - 1];
+            }
+        }
+
+    public:
+
+        bitset_storage() noexcept = default;
+        bitset_storage(bitset_storage const&) = delete;
+        bitset_storage& operator = (bitset_storage const&) = delete;
+        bitset_storage(bitset_storage&&) noexcept = default;
+        bitset_storage& operator = (bitset_storage&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !!mapped_file_;
+        }
+
+
+        size_type size() const noexcept {
+            return header_->cardinality;
+        }
+
+
+        bool empty() const noexcept {
+            return header_->cardinality == 0;
+        }
+
+
+        // Bytes of the file taken by containers
+        std::size_t allocated_bytes() const noexcept {
+            return std::size_t(header_->used) * unit_size;
+        }
+
+
+        const_iterator begin() const noexcept;
+        const_iterator end() const noexcept;
+
+
+        bool contains(std::uint32_t value) const noexcept {
+            auto const high = value >> 16;
+            auto const low = std::uint16_t(value);
+            auto const cardinality = cardinalities_[high];
+            if(cardinality == 0)
+                return false;
+            if(cardinality > array_limit)
+                return (bitmap_of(high)[low / 64] >> (low % 64) & 1) != 0;
+            auto const* array = array_of(high);
+            return std::binary_search(array, array + cardinality, low);
+        }
+
+
+        // False if the value is present or the file can't grow
+        bool insert(std::uint32_t value) {
+            auto const high = value >> 16;
+            auto const low = std::uint16_t(value);
+            auto const cardinality = cardinalities_[high];
+            if(cardinality == 0) {
+                auto const unit = allocate(1);
+                if(unit == 0)
+                    return false;
+                place(high, unit, 1);
+                *array_of(high) = low;
+            } else if(cardinality > array_limit) {
+                auto& word = bitmap_of(high)[low / 64];
+                auto const bit = std::uint64_t(1) << (low % 64);
+                if((word & bit) != 0)
+                    return false;
+                word |= bit;
+            } else {
+                auto const* array = array_of(high);
+                auto const position = std::uint32_t(std::lower_bound(array, array + cardinality, low) - array);
+                if(position != cardinality && array[position] == low)
+                    return false;
+                if(cardinality == array_limit) {
+                    // Array of the limit takes as many units as bitmap
+                    bitmap words = {};
+                    expand(high, words);
+                    words[low / 64] |= std::uint64_t(1) << (low % 64);
+                    std::memcpy(bitmap_of(high), words, sizeof(words));
+                } else {
+                    auto const units = units_of(cardinality + 1);
+                    if(units > units_at(high)) {
+                        auto const unit = allocate(units);
+                        if(unit == 0)
+                            return false;
+                        std::memcpy(unit_of(unit), array_of(high), cardinality * sizeof(std::uint16_t));
+                        release(unit_at(high), units_at(high));
+                        place(high, unit, units);
+                    }
+                    auto* target = array_of(high);
+                    std::memmove(target + position + 1, target + position,
+                                 (cardinality - position) * sizeof(std::uint16_t));
+                    target[position] = low;
+                }
+            }
+            set_cardinality(high, cardinality + 1);
+            ++header_->cardinality;
+            return true;
+        }
+
+
+        bool erase(std::uint32_t value) noexcept {
+            auto const high = value >> 16;
+            auto const low = std::uint16_t(value);
+            auto const cardinality = cardinalities_[high];
+            if(cardinality == 0)
+                return false;
+            if(cardinality > array_limit) {
+                auto* words = bitmap_of(high);
+                auto const bit = std::uint64_t(1) << (low % 64);
+                if((words[low / 64] & bit) == 0)
+                    return false;
+                words[low / 64] &= ~bit;
+                if(cardinality - 1 == array_limit)
+                    compact(high, words, array_limit);
+            } else {
+                auto* array = array_of(high);
+                auto const position = std::uint32_t(std::lower_bound(array, array + cardinality, low) - array);
+                if(position == cardinality || array[position] != low)
+                    return false;
+                std::memmove(array + position, array + position + 1,
+                             (cardinality - position - 1) * sizeof(std::uint16_t));
+                if(cardinality == 1)
+                    vacate(high);
+            }
+            set_cardinality(high, cardinality - 1);
+            --header_->cardinality;
+            return true;
+        }
+
+
+        // Number of values not greater than 'value'
+        size_type rank(std::uint32_t value) const noexcept {
+            auto const high = value >> 16;
+            auto const low = std::uint16_t(value);
+            auto count = size_type(0);
+            for(auto i = std::size_t(high); i != 0; i -= i & (~i + 1))
+                count += sums_[i - 1];
+            auto const cardinality = cardinalities_[high];
+            if(cardinality == 0)
+                return count;
+            if(cardinality > array_limit) {
+                auto const* words = bitmap_of(high);
+                for(auto i = std::size_t(0); i != low / 64u; ++i)
+                    count += detail::popcount(words[i]);
+                auto const mask = low % 64 == 63 ? ~std::uint64_t(0) : (std::uint64_t(2) << (low % 64)) - 1;
+                return count + detail::popcount(words[low / 64] & mask);
+            }
+            auto const* array = array_of(high);
+            return count + size_type(std::upper_bound(array, array + cardinality, low) - array);
+        }
+
+
+        // Value of the given zero based rank in ascending order
+        std::optional<std::uint32_t> select(size_type index) const noexcept {
+            if(index >= header_->cardinality)
+                return std::nullopt;
+            // Descends the tree to the first container with the prefix sum
+            // exceeding 'index'
+            auto high = std::size_t(0);
+            for(auto step = containers; step != 0; step >>= 1)
+                if(high + step <= containers && sums_[high + step - 1] <= index) {
+                    high += step;
+                    index -= sums_[high - 1];
+                }
+            if(cardinalities_[high] <= array_limit)
+                return std::uint32_t(high << 16 | array_of(high)[index]);
+            auto const* words = bitmap_of(high);
+            auto word = std::size_t(0);
+            for(; index >= detail::popcount(words[word]); ++word)
+                index -= detail::popcount(words[word]);
+            auto bits = words[word];
+            for(; index != 0; --index)
+                bits &= bits - 1;
+            return std::uint32_t(high << 16 | (word * 64 + detail::lowest_bit(bits)));
+        }
+
+
+        // Union with 'other', false if the file can't grow
+        bool merge(bitset_storage const& other) {
+            if(&other == this)
+                return true;
+            for(auto high = std::size_t(0); high != containers; ++high) {
+                if(other.cardinalities_[high] == 0)
+                    continue;
+                bitmap lhs = {}, rhs = {};
+                expand(high, lhs);
+                other.expand(high, rhs);
+                auto cardinality = std::uint32_t(0);
+                for(auto i = std::size_t(0); i != bitmap_words; ++i) {
+                    lhs[i] |= rhs[i];
+                    cardinality += detail::popcount(lhs[i]);
+                }
+                if(!assign(high, lhs, cardinality))
+                    return false;
+            }
+            return true;
+        }
+
+
+        // Intersection with 'other'
+        void intersect(bitset_storage const& other) noexcept {
+            if(&other == this)
+                return;
+            for(auto high = std::size_t(0); high != containers; ++high) {
+                if(cardinalities_[high] == 0)
+                    continue;
+                bitmap lhs = {}, rhs = {};
+                expand(high, lhs);
+                other.expand(high, rhs);
+                auto cardinality = std::uint32_t(0);
+                for(auto i = std::size_t(0); i != bitmap_words; ++i) {
+                    lhs[i] &= rhs[i];
+                    cardinality += detail::popcount(lhs[i]);
+                }
+                shrink(high, lhs, cardinality);
+            }
+        }
+
+
+        // Difference with 'other'
+        void subtract(bitset_storage const& other) noexcept {
+            if(&other == this) {
+                clear();
+                return;
+            }
+            for(auto high = std::size_t(0); high != containers; ++high) {
+                if(cardinalities_[high] == 0 || other.cardinalities_[high] == 0)
+                    continue;
+                bitmap lhs = {}, rhs = {};
+                expand(high, lhs);
+                other.expand(high, rhs);
+                auto cardinality = std::uint32_t(0);
+                for(auto i = std::size_t(0); i != bitmap_words; ++i) {
+                    lhs[i] &= ~rhs[i];
+                    cardinality += detail::popcount(lhs[i]);
+                }
+                shrink(high, lhs, cardinality);
+            }
+        }
+
+
+        void clear() noexcept {
+            std::memset(blocks_, 0, data_offset - blocks_offset);
+            header_->used = 1;
+            header_->cardinality = 0;
+            std::fill(std::begin(header_->free), std::end(header_->free), 0u);
+            std::fill(sums_.begin(), sums_.end(), 0u);
+        }
+
+
+        std::error_code flush() const noexcept {
+            return mapped_file_.flush();
+        }
+
+    private:
+
+        // Keeps sums of the tree covering the container
+        void set_cardinality(std::size_t high, std::uint32_t cardinality) noexcept {
+            auto const delta = std::uint64_t(cardinality) - cardinalities_[high];
+            cardinalities_[high] = cardinality;
+            for(auto i = high + 1; i <= containers; i += i & (~i + 1))
+                sums_[i - 1] += delta;
+        }
+
+
+        void refresh() noexcept {
+            if(!mapped_file_) {
+                header_ = nullptr;
+                blocks_ = cardinalities_ = nullptr;
+                data_ = nullptr;
+                return;
+            }
+            header_ = mapped_file_.cast<detail::bitset_header>(0);
+            blocks_ = mapped_file_.cast<std::uint32_t>(blocks_offset);
+            cardinalities_ = mapped_file_.cast<std::uint32_t>(cardinalities_offset);
+            data_ = mapped_file_.cast<char>(data_offset);
+        }
+
+
+        // Units of container, a power of two
+        static std::uint32_t units_of(std::uint32_t cardinality) noexcept {
+            if(cardinality > array_limit)
+                return bitmap_units;
+            auto const needed = (cardinality * sizeof(std::uint16_t) + unit_size - 1) / unit_size;
+            auto units = std::uint32_t(1);
+            while(units < needed)
+                units *= 2;
+            return units;
+        }
+
+
+        static unsigned class_of(std::uint32_t units) noexcept {
+            return detail::lowest_bit(units);
+        }
+
+
+        char* unit_of(std::uint32_t unit) const noexcept {
+            return data_ + std::size_t(unit) * unit_size;
+        }
+
+
+        std::uint32_t unit_at(std::size_t high) const noexcept {
+            return blocks_[high] & unit_mask;
+        }
+
+
+        std::uint32_t units_at(std::size_t high) const noexcept {
+            return std::uint32_t(1) << (blocks_[high] >> class_shift);
+        }
+
+
+        void place(std::size_t high, std::uint32_t unit, std::uint32_t units) noexcept {
+            blocks_[high] = unit | class_of(units) << class_shift;
+        }
+
+
+        void vacate(std::size_t high) noexcept {
+            release(unit_at(high), units_at(high));
+            blocks_[high] = 0;
+        }
+
+
+        std::uint16_t* array_of(std::size_t high) const noexcept {
+            return reinterpret_cast<std::uint16_t*>(unit_of(unit_at(high)));
+        }
+
+
+        std::uint64_t* bitmap_of(std::size_t high) const noexcept {
+            return reinterpret_cast<std::uint64_t*>(unit_of(unit_at(high)));
+        }
+
+
+        void expand(std::size_t high, bitmap& words) const noexcept {
+            auto const cardinality = cardinalities_[high];
+            if(cardinality > array_limit) {
+                std::memcpy(words, bitmap_of(high), sizeof(bitmap));
+                return;
+            }
+            auto const* array = array_of(high);
+            for(auto i = std::uint32_t(0); i != cardinality; ++i)
+                words[array[i] / 64] |= std::uint64_t(1) << (array[i] % 64);
+        }
+
+
+        // Writes bitmap of the given cardinality to the container of the
+        // same or larger size
+        void compact(std::size_t high, std::uint64_t const* words, std::uint32_t cardinality) noexcept {
+            if(cardinality > array_limit) {
+                std::memmove(bitmap_of(high), words, sizeof(bitmap));
+                return;
+            }
+            std::uint16_t array[array_limit];
+            auto count = std::uint32_t(0);
+            for(auto i = std::size_t(0); i != bitmap_words; ++i)
+                for(auto bits = words[i]; bits != 0; bits &= bits - 1)
+                    array[count++] = std::uint16_t(i * 64 + detail::lowest_bit(bits));
+            std::memcpy(array_of(high), array, cardinality * sizeof(std::uint16_t));
+        }
+
+
+        // Replaces content of container by smaller one in place
+        void shrink(std::size_t high, bitmap const& words, std::uint32_t cardinality) noexcept {
+            header_->cardinality -= cardinalities_[high] - cardinality;
+            set_cardinality(high, cardinality);
+            if(cardinality == 0)
+                vacate(high);
+            else
+                compact(high, words, cardinality);
+        }
+
+
+        // Replaces content of container, moving it to more units if needed
+        bool assign(std::size_t high, bitmap const& words, std::uint32_t cardinality) {
+            auto const previous = cardinalities_[high];
+            auto const units = units_of(cardinality);
+            if(previous == 0 || units > units_at(high)) {
+                auto const unit = allocate(units);
+                if(unit == 0)
+                    return false;
+                if(previous != 0)
+                    release(unit_at(high), units_at(high));
+                place(high, unit, units);
+            }
+            header_->cardinality += cardinality - previous;
+            set_cardinality(high, cardinality);
+            compact(high, words, cardinality);
+            return true;
+        }
+
+
+        // Free units are chained through their first word, zero unit is
+        // never allocated and terminates chains
+        std::uint32_t allocate(std::uint32_t units) {
+            auto& free = header_->free[class_of(units)];
+            if(free != 0) {
+                auto const unit = free;
+                std::memcpy(&free, unit_of(unit), sizeof(free));
+                return unit;
+            }
+            if(header_->used + units > header_->capacity && !grow(units))
+                return 0;
+            auto const unit = std::uint32_t(header_->used);
+            header_->used += units;
+            return unit;
+        }
+
+
+        void release(std::uint32_t unit, std::uint32_t units) noexcept {
+            auto& free = header_->free[class_of(units)];
+            std::memcpy(unit_of(unit), &free, sizeof(free));
+            free = unit;
+        }
+
+
+        bool grow(std::uint32_t units) {
+            auto const capacity = std::max(header_->capacity * 2, header_->used + units);
+            if(capacity > std::uint64_t(unit_mask) + 1)
+                return false;
+            // Failed resize keeps the old file mapped, the set stays usable
+            auto const ec = mapped_file_.resize(path_, data_offset + capacity * unit_size);
+            refresh();
+            if(!!ec)
+                return false;
+            header_->capacity = capacity;
+            return true;
+        }
+    }; // bitset_storage
+
+
+    // Ascending values, valid until the set is mutated
+    class bitset_storage::const_iterator {
+    friend class bitset_storage;
+    private:
+        bitset_storage const* storage_{nullptr};
+        std::uint32_t high_{containers};
+        std::uint32_t position_{0};
+
+        const_iterator(bitset_storage const* storage, std::uint32_t high) noexcept
+            : storage_{storage}, high_{high} {
+            settle();
+        }
+
+
+        // Moves to the first value of the container at or after the current
+        void settle() noexcept {
+            while(high_ != containers && storage_->cardinalities_[high_] == 0)
+                ++high_;
+            position_ = 0;
+            if(high_ != containers && storage_->cardinalities_[high_] > array_limit)
+                seek(0);
+        }
+
+
+        void seek(std::uint32_t bit) noexcept {
+            auto const* words = storage_->bitmap_of(high_);
+            auto word = bit / 64;
+            auto bits = words[word] & (~std::uint64_t(0) << (bit % 64));
+            while(bits == 0 && ++word != bitmap_words)
+                bits = words[word];
+            if(bits != 0) {
+                position_ = word * 64 + detail::lowest_bit(bits);
+                return;
+            }
+            ++high_;
+            settle();
+        }
+
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::uint32_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::uint32_t const*;
+        using reference = std::uint32_t;
+
+        const_iterator() noexcept = default;
+
+        bool operator == (const_iterator const& other) const noexcept {
+            return high_ == other.high_ && position_ == other.position_;
+        }
+
+
+        bool operator != (const_iterator const& other) const noexcept {
+            return !(*this == other);
+        }
+
+
+        std::uint32_t operator * () const noexcept {
+            if(storage_->cardinalities_[high_] > array_limit)
+                return high_ << 16 | position_;
+            return high_ << 16 | storage_->array_of(high_)[position_];
+        }
+
+
+        const_iterator& operator ++ () noexcept {
+            auto const cardinality = storage_->cardinalities_[high_];
+            if(cardinality > array_limit) {
+                if(position_ == 65535) {
+                    ++high_;
+                    settle();
+                } else {
+                    seek(position_ + 1);
+                }
+            } else if(++position_ == cardinality) {
+                ++high_;
+                settle();
+            }
+            return *this;
+        }
+
+
+        const_iterator operator ++ (int) noexcept {
+            auto current = *this;
+            ++*this;
+            return current;
+        }
+    }; // bitset_storage::const_iterator
+
+
+    inline bitset_storage::const_iterator bitset_storage::begin() const noexcept {
+        return const_iterator{this, 0};
+    }
+
+
+    inline bitset_storage::const_iterator bitset_storage::end() const noexcept {
+        return const_iterator{this, containers};
+    }
+
+
+    class bitset_storage::expected {
+    private:
+        std::error_code error_code_;
+        bitset_storage storage_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(bitset_storage&& s)
+            : storage_(std::move(s)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!storage_;
+        }
+
+
+        bitset_storage& operator * () & noexcept {
+            return storage_;
+        }
+
+
+        bitset_storage&& operator * () && noexcept {
+            return std::move(storage_);
+        }
+
+
+        bitset_storage* operator -> () noexcept {
+            return &storage_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // bitset_storage::expected
+
+
+    inline bitset_storage::expected bitset_storage::create(std::filesystem::path const& path) {
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, data_offset + initial_capacity * unit_size, ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->cast<detail::bitset_header>(0);
+        std::memcpy(header->signature, detail::bitset_signature, sizeof(header->signature));
+        header->unit_size = std::uint32_t(unit_size);
+        header->capacity = initial_capacity;
+        auto target = bitset_storage{std::move(*expected_file), path};
+        target.clear();
+        return {std::move(target)};
+    }
+
+
+    inline bitset_storage::expected bitset_storage::open(std::filesystem::path const& path) {
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        if(expected_file->size() < data_offset)
+            return {make_error_code(bitset_storage_error::mismatch_file_size)};
+        auto* header = expected_file->cast<detail::bitset_header>(0);
+        if(std::memcmp(header->signature, detail::bitset_signature, sizeof(header->signature)) != 0)
+            return {make_error_code(bitset_storage_error::invalid_file_signature)};
+        if(header->unit_size != unit_size
+           || expected_file->size() != data_offset + header->capacity * unit_size)
+            return {make_error_code(bitset_storage_error::mismatch_file_size)};
+        if(header->used == 0 || header->used > header->capacity)
+            return {make_error_code(bitset_storage_error::file_is_corrupted)};
+        return {bitset_storage{std::move(*expected_file), path}};
+    }
+
+
+    inline bitset_storage::expected bitset_storage::open_or_create(std::filesystem::path const& path) {
+        auto ec = std::error_code{};
+        if(std::filesystem::exists(path, ec))
+            return open(path);
+        if(!!ec)
+            return {ec};
+        return create(path);
+    }
+
+
+} // namespace persia
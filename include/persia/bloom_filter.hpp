@@ -0,0 +1,129 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+namespace persia {
+
+
+    namespace detail {
+
+
+        inline std::uint64_t mix_hash(std::uint64_t hash) noexcept {
+            hash ^= hash >> 33;
+            hash *= 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 33;
+            hash *= 0xC4CEB9FE1A85EC53ull;
+            hash ^= hash >> 33;
+            return hash;
+        }
+
+
+        // Blocked Bloom filter: every key sets one bit in each word of a single
+        // cache line, so a probe touches exactly one cache line. Erased keys
+        // can't be removed, they are counted as stale instead.
+        class bloom_filter {
+        public:
+
+            using size_type = std::size_t;
+
+            static constexpr size_type block_size = 64;
+            static constexpr size_type block_words = block_size / sizeof(std::uint64_t);
+
+        private:
+
+            struct alignas(block_size) block {
+                std::uint64_t words[block_words];
+            }; // block
+
+
+            std::vector<block> blocks_;
+            size_type stale_{0};
+
+        public:
+
+            void reset(size_type items, unsigned bits_per_item) {
+                auto const bits = std::max<size_type>(items * bits_per_item, 1);
+                blocks_.assign((bits + block_size * 8 - 1) / (block_size * 8), block{});
+                stale_ = 0;
+            }
+
+
+            void clear() noexcept {
+                std::fill(blocks_.begin(), blocks_.end(), block{});
+                stale_ = 0;
+            }
+
+
+            size_type stale() const noexcept {
+                return stale_;
+            }
+
+
+            void mark_stale() noexcept {
+                ++stale_;
+            }
+
+
+            void insert(std::uint64_t hash) noexcept {
+                std::uint64_t mask[block_words];
+                make_mask(hash, mask);
+                auto& target = blocks_[block_of(hash)];
+                for(auto i = size_type(0); i != block_words; ++i)
+                    target.words[i] |= mask[i];
+            }
+
+
+            bool may_contain(std::uint64_t hash) const noexcept {
+                alignas(32) std::uint64_t mask[block_words];
+                make_mask(hash, mask);
+                auto const& target = blocks_[block_of(hash)];
+#if defined(__AVX2__)
+                auto const* words = reinterpret_cast<__m256i const*>(target.words);
+                auto const* masks = reinterpret_cast<__m256i const*>(mask);
+                return _mm256_testc_si256(_mm256_load_si256(words), _mm256_load_si256(masks))
+                    & _mm256_testc_si256(_mm256_load_si256(words + 1), _mm256_load_si256(masks + 1));
+#else
+                // No early exit, so the loop is vectorized
+                auto missed = std::uint64_t(0);
+                for(auto i = size_type(0); i != block_words; ++i)
+                    missed |= mask[i] & ~target.words[i];
+                return missed == 0;
+#endif
+            }
+
+        private:
+
+            size_type block_of(std::uint64_t hash) const noexcept {
+                return size_type(((hash >> 32) * blocks_.size()) >> 32);
+            }
+
+
+            static void make_mask(std::uint64_t hash, std::uint64_t (&mask)[block_words]) noexcept {
+                constexpr std::uint32_t salts[block_words] = {
+                    0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+                    0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u
+                };
+                auto const low = std::uint32_t(hash);
+                for(auto i = size_type(0); i != block_words; ++i)
+                    mask[i] = std::uint64_t(1) << (std::uint32_t(low * salts[i]) >> 26);
+            }
+        }; // bloom_filter
+
+
+    } // namespace detail
+
+
+} // namespace persia
@@ -0,0 +1,403 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+
+namespace persia {
+
+
+    namespace detail {
+
+
+        // In-memory B+tree of unique (key, value) pairs ordered lexicographically,
+        // so equal keys are allowed as long as values differ. Keys and values
+        // are kept in separate arrays inside nodes sized to a few cache lines.
+        template<typename K, typename V> class bplus_tree {
+        public:
+
+            using size_type = std::size_t;
+
+            static constexpr size_type cache_line_size = 64;
+            static constexpr size_type fanout =
+                (4 * cache_line_size) / (sizeof(K) + sizeof(V)) < 8
+                    ? 8
+                    : (4 * cache_line_size) / (sizeof(K) + sizeof(V));
+
+        private:
+
+            struct node {
+                bool leaf;
+                size_type count{0};
+                K keys[fanout + 1];
+                V values[fanout + 1];
+
+                explicit node(bool is_leaf) noexcept: leaf{is_leaf} { }
+            }; // node
+
+
+            struct alignas(cache_line_size) leaf_node : node {
+                leaf_node* prev{nullptr};
+                leaf_node* next{nullptr};
+
+                leaf_node() noexcept: node{true} { }
+            }; // leaf_node
+
+
+            struct alignas(cache_line_size) inner_node : node {
+                node* children[fanout + 2];
+
+                inner_node() noexcept: node{false} { }
+            }; // inner_node
+
+
+            node* root_{nullptr};
+            size_type size_{0};
+
+        public:
+
+            class const_iterator {
+            friend class bplus_tree;
+            private:
+                leaf_node const* leaf_{nullptr};
+                size_type position_{0};
+
+                const_iterator(leaf_node const* leaf, size_type position) noexcept
+                    : leaf_{leaf}, position_{position} { }
+
+            public:
+
+                const_iterator() noexcept = default;
+
+                bool operator == (const_iterator const& other) const noexcept {
+                    return leaf_ == other.leaf_ && position_ == other.position_;
+                }
+
+
+                bool operator != (const_iterator const& other) const noexcept {
+                    return !(*this == other);
+                }
+
+
+                K const& key() const noexcept { return leaf_->keys[position_]; }
+                V const& value() const noexcept { return leaf_->values[position_]; }
+
+
+                const_iterator& operator ++ () noexcept {
+                    if(++position_ == leaf_->count) {
+                        leaf_ = leaf_->next;
+                        position_ = 0;
+                    }
+                    return *this;
+                }
+
+
+                const_iterator operator ++ (int) noexcept {
+                    auto current = *this;
+                    ++*this;
+                    return current;
+                }
+            }; // const_iterator
+
+
+            bplus_tree() noexcept = default;
+            bplus_tree(bplus_tree const&) = delete;
+            bplus_tree& operator = (bplus_tree const&) = delete;
+
+
+            bplus_tree(bplus_tree&& other) noexcept
+                : root_{other.root_}, size_{other.size_} {
+                other.root_ = nullptr;
+                other.size_ = 0;
+            }
+
+
+            bplus_tree& operator = (bplus_tree&& other) noexcept {
+                std::swap(root_, other.root_);
+                std::swap(size_, other.size_);
+                return *this;
+            }
+
+
+            ~bplus_tree() {
+                dispose(root_);
+            }
+
+
+            size_type size() const noexcept {
+                return size_;
+            }
+
+
+            bool empty() const noexcept {
+                return size_ == 0;
+            }
+
+
+            const_iterator begin() const noexcept {
+                if(size_ == 0)
+                    return end();
+                auto const* current = root_;
+                while(!current->leaf)
+                    current = static_cast<inner_node const*>(current)->children[0];
+                return const_iterator{static_cast<leaf_node const*>(current), 0};
+            }
+
+
+            const_iterator end() const noexcept {
+                return const_iterator{};
+            }
+
+
+            // First pair with key not less than the given one
+            const_iterator lower_bound(K const& key) const noexcept {
+                if(size_ == 0)
+                    return end();
+                auto const* current = root_;
+                while(!current->leaf) {
+                    auto const position = key_lower_bound(current, key);
+                    current = static_cast<inner_node const*>(current)->children[position];
+                }
+                auto const* leaf = static_cast<leaf_node const*>(current);
+                auto const position = key_lower_bound(leaf, key);
+                if(position == leaf->count)
+                    return const_iterator{leaf->next, 0};
+                return const_iterator{leaf, position};
+            }
+
+
+            bool insert(K const& key, V const& value) {
+                if(root_ == nullptr)
+                    root_ = new leaf_node{};
+                K separator_key;
+                V separator_value;
+                node* right = nullptr;
+                if(!insert(root_, key, value, separator_key, separator_value, right))
+                    return false;
+                ++size_;
+                if(right == nullptr)
+                    return true;
+                auto* new_root = new inner_node{};
+                new_root->keys[0] = separator_key;
+                new_root->values[0] = separator_value;
+                new_root->children[0] = root_;
+                new_root->children[1] = right;
+                new_root->count = 1;
+                root_ = new_root;
+                return true;
+            }
+
+
+            bool erase(K const& key, V const& value) noexcept {
+                if(root_ == nullptr)
+                    return false;
+                bool erased = false;
+                if(erase(root_, key, value, erased)) {
+                    // Children of an emptied root are already released
+                    if(root_->leaf)
+                        delete static_cast<leaf_node*>(root_);
+                    else
+                        delete static_cast<inner_node*>(root_);
+                    root_ = nullptr;
+                }
+                if(!erased)
+                    return false;
+                --size_;
+                while(root_ != nullptr && !root_->leaf && root_->count == 0) {
+                    auto* single = static_cast<inner_node*>(root_)->children[0];
+                    delete static_cast<inner_node*>(root_);
+                    root_ = single;
+                }
+                return true;
+            }
+
+
+            void clear() noexcept {
+                dispose(root_);
+                root_ = nullptr;
+                size_ = 0;
+            }
+
+        private:
+
+            static bool less(K const& lkey, V const& lvalue,
+                             K const& rkey, V const& rvalue) noexcept {
+                if(lkey < rkey)
+                    return true;
+                if(rkey < lkey)
+                    return false;
+                return lvalue < rvalue;
+            }
+
+
+            static size_type key_lower_bound(node const* n, K const& key) noexcept {
+                auto const* found = std::lower_bound(n->keys, n->keys + n->count, key);
+                return size_type(found - n->keys);
+            }
+
+
+            // Position of the first pair not less than (key, value)
+            static size_type lower_bound(node const* n, K const& key, V const& value) noexcept {
+                size_type first = 0, count = n->count;
+                while(count != 0) {
+                    auto const step = count / 2;
+                    auto const middle = first + step;
+                    if(less(n->keys[middle], n->values[middle], key, value)) {
+                        first = middle + 1;
+                        count -= step + 1;
+                    } else {
+                        count = step;
+                    }
+                }
+                return first;
+            }
+
+
+            static bool equal(node const* n, size_type position, K const& key, V const& value) noexcept {
+                return position != n->count
+                    && !less(key, value, n->keys[position], n->values[position]);
+            }
+
+
+            static void insert_at(node* n, size_type position, K const& key, V const& value) noexcept {
+                std::move_backward(n->keys + position, n->keys + n->count, n->keys + n->count + 1);
+                std::move_backward(n->values + position, n->values + n->count, n->values + n->count + 1);
+                n->keys[position] = key;
+                n->values[position] = value;
+                ++n->count;
+            }
+
+
+            static void remove_at(node* n, size_type position) noexcept {
+                std::move(n->keys + position + 1, n->keys + n->count, n->keys + position);
+                std::move(n->values + position + 1, n->values + n->count, n->values + position);
+                --n->count;
+            }
+
+
+            // Returns false if the pair is already present, sets 'right' if node was split
+            static bool insert(node* n, K const& key, V const& value,
+                               K& separator_key, V& separator_value, node*& right) {
+                if(n->leaf) {
+                    auto* leaf = static_cast<leaf_node*>(n);
+                    auto const position = lower_bound(leaf, key, value);
+                    if(equal(leaf, position, key, value))
+                        return false;
+                    insert_at(leaf, position, key, value);
+                    if(leaf->count <= fanout)
+                        return true;
+                    auto* sibling = new leaf_node{};
+                    auto const half = leaf->count / 2;
+                    std::copy(leaf->keys + half, leaf->keys + leaf->count, sibling->keys);
+                    std::copy(leaf->values + half, leaf->values + leaf->count, sibling->values);
+                    sibling->count = leaf->count - half;
+                    leaf->count = half;
+                    sibling->next = leaf->next;
+                    sibling->prev = leaf;
+                    if(leaf->next != nullptr)
+                        leaf->next->prev = sibling;
+                    leaf->next = sibling;
+                    separator_key = sibling->keys[0];
+                    separator_value = sibling->values[0];
+                    right = sibling;
+                    return true;
+                }
+
+                auto* inner = static_cast<inner_node*>(n);
+                auto position = lower_bound(inner, key, value);
+                if(equal(inner, position, key, value))
+                    ++position;
+                node* child_right = nullptr;
+                K child_key;
+                V child_value;
+                if(!insert(inner->children[position], key, value, child_key, child_value, child_right))
+                    return false;
+                if(child_right == nullptr)
+                    return true;
+                std::move_backward(inner->children + position + 1,
+                                   inner->children + inner->count + 1,
+                                   inner->children + inner->count + 2);
+                inner->children[position + 1] = child_right;
+                insert_at(inner, position, child_key, child_value);
+                if(inner->count <= fanout)
+                    return true;
+                auto* sibling = new inner_node{};
+                auto const half = inner->count / 2;
+                separator_key = inner->keys[half];
+                separator_value = inner->values[half];
+                std::copy(inner->keys + half + 1, inner->keys + inner->count, sibling->keys);
+                std::copy(inner->values + half + 1, inner->values + inner->count, sibling->values);
+                std::copy(inner->children + half + 1, inner->children + inner->count + 1, sibling->children);
+                sibling->count = inner->count - half - 1;
+                inner->count = half;
+                right = sibling;
+                return true;
+            }
+
+
+            // Returns true if node became empty; empty leaves are unlinked and
+            // removed from parents without rebalancing
+            static bool erase(node* n, K const& key, V const& value, bool& erased) noexcept {
+                if(n->leaf) {
+                    auto* leaf = static_cast<leaf_node*>(n);
+                    auto const position = lower_bound(leaf, key, value);
+                    if(!equal(leaf, position, key, value))
+                        return false;
+                    remove_at(leaf, position);
+                    erased = true;
+                    if(leaf->count != 0)
+                        return false;
+                    if(leaf->prev != nullptr)
+                        leaf->prev->next = leaf->next;
+                    if(leaf->next != nullptr)
+                        leaf->next->prev = leaf->prev;
+                    return true;
+                }
+
+                auto* inner = static_cast<inner_node*>(n);
+                auto position = lower_bound(inner, key, value);
+                if(equal(inner, position, key, value))
+                    ++position;
+                auto* child = inner->children[position];
+                if(!erase(child, key, value, erased))
+                    return false;
+                if(child->leaf)
+                    delete static_cast<leaf_node*>(child);
+                else
+                    delete static_cast<inner_node*>(child);
+                if(inner->count == 0)
+                    return true;
+                std::move(inner->children + position + 1,
+                          inner->children + inner->count + 1,
+                          inner->children + position);
+                remove_at(inner, position == 0 ? 0 : position - 1);
+                return false;
+            }
+
+
+            static void dispose(node* n) noexcept {
+                if(n == nullptr)
+                    return;
+                if(n->leaf) {
+                    delete static_cast<leaf_node*>(n);
+                    return;
+                }
+                auto* inner = static_cast<inner_node*>(n);
+                for(auto i = size_type(0); i != inner->count + 1; ++i)
+                    dispose(inner->children[i]);
+                delete inner;
+            }
+        }; // bplus_tree
+
+
+    } // namespace detail
+
+
+} // namespace persia
@@ -0,0 +1,410 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <persia/atomic.hpp>
+#include <persia/mapped_file.hpp>
+
+
+namespace persia {
+
+
+    enum class cache_error {
+        ok,
+        file_size_is_too_small,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        file_is_corrupted
+    }; // cache_error
+
+
+    class cache_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "cache";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(cache_error(code)) {
+            case cache_error::ok:
+                return "Ok";
+            case cache_error::file_size_is_too_small:
+                return "Cache file is too small";
+            case cache_error::invalid_file_signature:
+                return "Invalid cache file signature";
+            case cache_error::mismatch_file_size:
+                return "Mismatch file size";
+            case cache_error::mismatch_item_size:
+                return "Mismatch item size";
+            case cache_error::file_is_corrupted:
+                return "File is corrupted";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline cache_error_category const cache_error_category;
+
+
+    inline std::error_code make_error_code(cache_error e) noexcept {
+        return {int(e), cache_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::cache_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    namespace detail {
+
+        struct alignas(8) cache_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t capacity{0};
+            std::uint32_t hand{0};
+        }; // cache_header
+
+
+        inline constexpr unsigned char cache_signature[4] = {0xCA, 0xC4, 0xE1, 0x07};
+        inline constexpr std::uint32_t cache_occupied = 0xCAC4E107;
+
+
+        template<typename V> struct cache_record {
+            std::uint32_t marker;
+            // Set by lookups, cleared by the clock hand passing by
+            std::uint32_t referenced;
+            V data;
+        }; // cache_record
+
+    } // namespace detail
+
+
+    // Fixed capacity storage evicting items by CLOCK algorithm when full.
+    // Reference bits live in records and the clock hand in the header, so
+    // a reopened cache keeps its working set and recency. Lookups may run
+    // concurrently with each other, they set reference bits lock-free and
+    // only if not set yet, so hot records don't dirty their pages on every
+    // hit. Mutations need exclusive access.
+    template<typename Key, typename Value, class Adapter = Value> class cache {
+    public:
+
+        using key_type = Key;
+        using value_type = Value;
+        using size_type = std::uint32_t;
+
+        static_assert(std::is_trivially_copyable_v<Value>, "Value should be trivially copyable");
+
+        class expected;
+
+        static expected create(std::filesystem::path const& path, size_type capacity);
+        static expected open(std::filesystem::path const& path);
+        static expected open_or_create(std::filesystem::path const& path, size_type capacity);
+
+    private:
+
+        using record_type = detail::cache_record<Value>;
+
+        std::unordered_map<Key, size_type> indices_;
+        std::vector<size_type> free_indices_;
+        mapped_file mapped_file_;
+        detail::cache_header* header_{nullptr};
+        record_type* records_{nullptr};
+        std::uint64_t evictions_{0};
+
+        cache(mapped_file&& mapped_file) noexcept
+            : mapped_file_{std::move(mapped_file)}
+            , header_{mapped_file_.cast<detail::cache_header>(0)}
+            , records_{mapped_file_.cast<record_type>(sizeof(detail::cache_header))} {
+        }
+
+    public:
+
+        cache() noexcept = default;
+        cache(cache const&) = delete;
+        cache& operator = (cache const&) = delete;
+        cache(cache&&) noexcept = default;
+        cache& operator = (cache&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !!mapped_file_;
+        }
+
+
+        size_type capacity() const noexcept {
+            return header_->capacity;
+        }
+
+
+        size_type size() const noexcept {
+            return size_type(indices_.size());
+        }
+
+
+        bool empty() const noexcept {
+            return indices_.empty();
+        }
+
+
+        // Number of items evicted by this object
+        std::uint64_t evictions() const noexcept {
+            return evictions_;
+        }
+
+
+        // Marks found item as recently used
+        Value* find(Key const& key) noexcept {
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return nullptr;
+            auto* record = records_ + found->second;
+            if(detail::load_acquire(&record->referenced) == 0)
+                detail::store_release(&record->referenced, 1);
+            return &record->data;
+        }
+
+
+        // Doesn't affect eviction
+        bool contains(Key const& key) const noexcept {
+            return indices_.find(key) != indices_.end();
+        }
+
+
+        // False if the key is present, evicts an item if full
+        bool insert(Value const& value) {
+            auto const key = Adapter::key_of(value);
+            if(indices_.find(key) != indices_.end())
+                return false;
+            auto const index = free_indices_.empty() ? evict() : take_free();
+            write(index, value, 0);
+            indices_.emplace(key, index);
+            return true;
+        }
+
+
+        // Assigned item is marked as recently used. Always succeeds,
+        // evicting an item if full
+        bool insert_or_assign(Value const& value) {
+            auto const key = Adapter::key_of(value);
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return insert(value);
+            write(found->second, value, 1);
+            return true;
+        }
+
+
+        bool erase(Key const& key) noexcept {
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return false;
+            records_[found->second].marker = 0;
+            free_indices_.push_back(found->second);
+            indices_.erase(found);
+            return true;
+        }
+
+
+        void clear() noexcept {
+            for(auto i = size_type(0); i != header_->capacity; ++i)
+                records_[i].marker = 0;
+            header_->hand = 0;
+            indices_.clear();
+            free_indices_.clear();
+            for(auto i = header_->capacity; i-- != 0;)
+                free_indices_.push_back(i);
+        }
+
+
+        std::error_code flush() const noexcept {
+            return mapped_file_.flush();
+        }
+
+    private:
+
+        size_type take_free() noexcept {
+            auto const index = free_indices_.back();
+            free_indices_.pop_back();
+            return index;
+        }
+
+
+        // Hand clears reference bits until it finds a record without one,
+        // which takes at most one full turn
+        size_type evict() noexcept {
+            auto hand = header_->hand;
+            for(;;) {
+                auto* record = records_ + hand;
+                if(detail::load_acquire(&record->referenced) == 0)
+                    break;
+                detail::store_release(&record->referenced, 0);
+                if(++hand == header_->capacity)
+                    hand = 0;
+            }
+            header_->hand = hand + 1 == header_->capacity ? 0 : hand + 1;
+            indices_.erase(Adapter::key_of(records_[hand].data));
+            ++evictions_;
+            return hand;
+        }
+
+
+        // Record is unmarked while written, so a torn one is dropped on open
+        void write(size_type index, Value const& value, std::uint32_t referenced) noexcept {
+            auto* record = records_ + index;
+            record->marker = 0;
+            record->referenced = referenced;
+            record->data = value;
+            record->marker = detail::cache_occupied;
+        }
+
+
+        std::error_code load() {
+            auto const capacity = header_->capacity;
+            indices_.reserve(capacity);
+            free_indices_.reserve(capacity);
+            for(auto i = capacity; i-- != 0;) {
+                auto const& record = records_[i];
+                if(record.marker == 0) {
+                    free_indices_.push_back(i);
+                    continue;
+                }
+                if(record.marker != detail::cache_occupied)
+                    return make_error_code(cache_error::file_is_corrupted);
+                if(!indices_.emplace(Adapter::key_of(record.data), i).second)
+                    return make_error_code(cache_error::file_is_corrupted);
+            }
+            return {};
+        }
+    }; // cache
+
+
+    template<typename K, typename V, class A> class cache<K, V, A>::expected {
+    private:
+        std::error_code error_code_;
+        cache cache_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(cache&& c)
+            : cache_(std::move(c)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!cache_;
+        }
+
+
+        cache& operator * () & noexcept {
+            return cache_;
+        }
+
+
+        cache&& operator * () && noexcept {
+            return std::move(cache_);
+        }
+
+
+        cache* operator -> () noexcept {
+            return &cache_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // cache::expected
+
+
+    template<typename K, typename V, class A> typename cache<K, V, A>::expected
+    cache<K, V, A>::create(std::filesystem::path const& path, size_type capacity) {
+        if(capacity == 0)
+            return {make_error_code(cache_error::file_size_is_too_small)};
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, sizeof(detail::cache_header)
+                                           + std::size_t(capacity) * sizeof(record_type), ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->cast<detail::cache_header>(0);
+        std::memcpy(header->signature, detail::cache_signature, sizeof(header->signature));
+        header->item_size = sizeof(V);
+        header->capacity = capacity;
+        auto target = cache{std::move(*expected_file)};
+        target.clear();
+        return {std::move(target)};
+    }
+
+
+    template<typename K, typename V, class A> typename cache<K, V, A>::expected
+    cache<K, V, A>::open(std::filesystem::path const& path) {
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        if(expected_file->size() < sizeof(detail::cache_header) + sizeof(record_type))
+            return {make_error_code(cache_error::file_size_is_too_small)};
+        auto* header = expected_file->cast<detail::cache_header>(0);
+        if(std::memcmp(header->signature, detail::cache_signature, sizeof(header->signature)) != 0)
+            return {make_error_code(cache_error::invalid_file_signature)};
+        if(header->item_size != sizeof(V))
+            return {make_error_code(cache_error::mismatch_item_size)};
+        if(expected_file->size() != sizeof(detail::cache_header)
+                                    + std::size_t(header->capacity) * sizeof(record_type)
+           || header->hand >= header->capacity)
+            return {make_error_code(cache_error::mismatch_file_size)};
+        expected_file->will_need(0, expected_file->size());
+        auto target = cache{std::move(*expected_file)};
+        auto const ec = target.load();
+        if(!!ec)
+            return {ec};
+        return {std::move(target)};
+    }
+
+
+    template<typename K, typename V, class A> typename cache<K, V, A>::expected
+    cache<K, V, A>::open_or_create(std::filesystem::path const& path, size_type capacity) {
+        auto ec = std::error_code{};
+        if(std::filesystem::exists(path, ec))
+            return open(path);
+        if(!!ec)
+            return {ec};
+        return create(path, capacity);
+    }
+
+
+} // namespace persia
@@ -0,0 +1,381 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <persia/atomic.hpp>
+#include <persia/mapped_file.hpp>
+
+
+namespace persia {
+
+
+    enum class change_log_error {
+        ok,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        change_log_overrun,
+        change_not_applied
+    }; // change_log_error
+
+
+    class change_log_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "change_log";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(change_log_error(code)) {
+            case change_log_error::ok:
+                return "Ok";
+            case change_log_error::invalid_file_signature:
+                return "Invalid change log file signature";
+            case change_log_error::mismatch_file_size:
+                return "Mismatch file size";
+            case change_log_error::mismatch_item_size:
+                return "Mismatch item size";
+            case change_log_error::change_log_overrun:
+                return "Changes are overwritten before being applied";
+            case change_log_error::change_not_applied:
+                return "Change is not applied";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline change_log_error_category const change_log_error_category;
+
+
+    inline std::error_code make_error_code(change_log_error e) noexcept {
+        return {int(e), change_log_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::change_log_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    enum class change_kind: std::uint32_t {
+        insert = 1, assign, erase, clear
+    }; // change_kind
+
+
+    namespace detail {
+
+        struct alignas(8) change_log_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t capacity{0};
+            std::uint32_t reserved{0};
+            std::uint64_t head{0};
+        }; // change_log_header
+
+    } // namespace detail
+
+
+    // Ring file of sequence numbered changes appended by a single writer.
+    // Readers in the same or other processes copy entries optimistically
+    // and detect entries overwritten while being copied.
+    template<typename Key, typename Value> class change_log {
+    public:
+
+        using key_type = Key;
+        using value_type = Value;
+        using size_type = std::uint32_t;
+
+        struct alignas(8) entry {
+            std::uint64_t sequence;
+            change_kind kind;
+            std::uint32_t reserved;
+            Key key;
+            Value value;
+        }; // entry
+
+        static_assert(std::is_trivially_copyable_v<entry>, "Key and Value should be trivially copyable");
+
+        class expected;
+
+        static expected create(std::filesystem::path const& path, size_type capacity);
+        static expected open(std::filesystem::path const& path);
+        static expected open_or_create(std::filesystem::path const& path, size_type capacity);
+
+    private:
+
+        mapped_file mapped_file_;
+        detail::change_log_header* header_{nullptr};
+        entry* entries_{nullptr};
+
+        change_log(mapped_file&& mapped_file,
+                   detail::change_log_header* header,
+                   entry* entries) noexcept
+            : mapped_file_{std::move(mapped_file)}
+            , header_{header}
+            , entries_{entries} {
+        }
+
+    public:
+
+        change_log() noexcept = default;
+        change_log(change_log const&) = delete;
+        change_log& operator = (change_log const&) = delete;
+        change_log(change_log&&) noexcept = default;
+        change_log& operator = (change_log&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !!mapped_file_;
+        }
+
+
+        size_type capacity() const noexcept {
+            return header_->capacity;
+        }
+
+
+        // Sequence number of the last appended change, zero if there are none
+        std::uint64_t head() const noexcept {
+            return detail::load_acquire(&header_->head);
+        }
+
+
+        // Oldest entry is overwritten once the ring is full
+        std::uint64_t append(change_kind kind, Key const& key, Value const& value) noexcept {
+            return append(kind, &key, &value);
+        }
+
+
+        // Value of the entry is zeroed, e.g. for erasure
+        std::uint64_t append(change_kind kind, Key const& key) noexcept {
+            return append(kind, &key, nullptr);
+        }
+
+
+        // Key and value of the entry are zeroed, e.g. for clearing
+        std::uint64_t append(change_kind kind) noexcept {
+            return append(kind, nullptr, nullptr);
+        }
+
+
+        // False if the entry is not appended yet or overwritten
+        bool read(std::uint64_t sequence, entry& out) const noexcept {
+            auto const& source = entries_[(sequence - 1) % header_->capacity];
+            if(detail::load_acquire(&source.sequence) != sequence)
+                return false;
+            std::memcpy(&out, &source, sizeof(entry));
+            detail::acquire_fence();
+            return detail::load_acquire(&source.sequence) == sequence;
+        }
+
+    private:
+
+        // Missing key or value are zeroed, so they needn't be default constructible
+        std::uint64_t append(change_kind kind, Key const* key, Value const* value) noexcept {
+            auto const sequence = header_->head + 1;
+            auto& target = entries_[(sequence - 1) % header_->capacity];
+            detail::store_release(&target.sequence, 0);
+            detail::release_fence();
+            target.kind = kind;
+            target.reserved = 0;
+            if(key != nullptr)
+                std::memcpy(static_cast<void*>(&target.key), key, sizeof(Key));
+            else
+                std::memset(static_cast<void*>(&target.key), 0, sizeof(Key));
+            if(value != nullptr)
+                std::memcpy(static_cast<void*>(&target.value), value, sizeof(Value));
+            else
+                std::memset(static_cast<void*>(&target.value), 0, sizeof(Value));
+            detail::store_release(&target.sequence, sequence);
+            detail::store_release(&header_->head, sequence);
+            return sequence;
+        }
+    }; // change_log
+
+
+    template<typename K, typename V> class change_log<K, V>::expected {
+    private:
+        std::error_code error_code_;
+        change_log change_log_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(change_log&& log)
+            : change_log_(std::move(log)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!change_log_;
+        }
+
+
+        change_log& operator * () & noexcept {
+            return change_log_;
+        }
+
+
+        change_log&& operator * () && noexcept {
+            return std::move(change_log_);
+        }
+
+
+        change_log* operator -> () noexcept {
+            return &change_log_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // change_log::expected
+
+
+    template<typename K, typename V> typename change_log<K, V>::expected
+    change_log<K, V>::create(std::filesystem::path const& path, size_type capacity) {
+        if(capacity == 0)
+            return {make_error_code(change_log_error::mismatch_file_size)};
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, sizeof(detail::change_log_header) + capacity * sizeof(entry), ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->cast<detail::change_log_header>(0);
+        header->signature[0] = 0xC4;
+        header->signature[1] = 0xA9;
+        header->signature[2] = 0x6E;
+        header->signature[3] = 0x1F;
+        header->item_size = sizeof(entry);
+        header->capacity = capacity;
+        auto* entries = expected_file->cast<entry>(sizeof(detail::change_log_header));
+        return {change_log{std::move(*expected_file), header, entries}};
+    }
+
+
+    template<typename K, typename V> typename change_log<K, V>::expected
+    change_log<K, V>::open(std::filesystem::path const& path) {
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        if(expected_file->size() < sizeof(detail::change_log_header) + sizeof(entry))
+            return {make_error_code(change_log_error::mismatch_file_size)};
+        auto* header = expected_file->cast<detail::change_log_header>(0);
+        if(header->signature[0] != 0xC4
+            || header->signature[1] != 0xA9
+            || header->signature[2] != 0x6E
+            || header->signature[3] != 0x1F)
+            return {make_error_code(change_log_error::invalid_file_signature)};
+        if(header->item_size != sizeof(entry))
+            return {make_error_code(change_log_error::mismatch_item_size)};
+        if(expected_file->size() != sizeof(detail::change_log_header) + header->capacity * sizeof(entry))
+            return {make_error_code(change_log_error::mismatch_file_size)};
+        auto* entries = expected_file->cast<entry>(sizeof(detail::change_log_header));
+        return {change_log{std::move(*expected_file), header, entries}};
+    }
+
+
+    template<typename K, typename V> typename change_log<K, V>::expected
+    change_log<K, V>::open_or_create(std::filesystem::path const& path, size_type capacity) {
+        auto ec = std::error_code{};
+        if(std::filesystem::exists(path, ec))
+            return open(path);
+        if(!!ec)
+            return {ec};
+        return create(path, capacity);
+    }
+
+
+    // Applies changes of the log to the target storage in order. Target is
+    // expected to hold the state as of sequence 'applied', e.g. to be opened
+    // from a snapshot taken when the log head was 'applied'.
+    template<class Storage> class follower {
+    public:
+
+        using log_type = change_log<typename Storage::key_type, typename Storage::value_type>;
+
+    private:
+
+        log_type const* log_;
+        Storage* target_;
+        std::uint64_t applied_;
+
+    public:
+
+        follower(log_type const& log, Storage& target, std::uint64_t applied = 0) noexcept
+            : log_{&log}, target_{&target}, applied_{applied} {
+        }
+
+
+        // Sequence number of the last applied change
+        std::uint64_t applied() const noexcept {
+            return applied_;
+        }
+
+
+        // Number of appended changes not applied yet
+        std::uint64_t lag() const noexcept {
+            return log_->head() - applied_;
+        }
+
+
+        // Applies all changes appended so far
+        std::error_code poll() {
+            auto const head = log_->head();
+            if(head - applied_ > log_->capacity())
+                return make_error_code(change_log_error::change_log_overrun);
+            auto change = typename log_type::entry{};
+            while(applied_ != head) {
+                if(!log_->read(applied_ + 1, change))
+                    return make_error_code(change_log_error::change_log_overrun);
+                switch(change.kind) {
+                case change_kind::insert:
+                case change_kind::assign:
+                    if(!target_->insert_or_assign(change.value))
+                        return make_error_code(change_log_error::change_not_applied);
+                    break;
+                case change_kind::erase:
+                    target_->erase(change.key);
+                    break;
+                case change_kind::clear:
+                    target_->clear();
+                    break;
+                }
+                ++applied_;
+            }
+            return {};
+        }
+    }; // follower
+
+
+} // namespace persia
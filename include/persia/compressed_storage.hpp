@@ -0,0 +1,563 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <persia/lz.hpp>
+#include <persia/mapped_file.hpp>
+
+
+namespace persia {
+
+
+    enum class compressed_storage_error {
+        ok,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        mismatch_block_size,
+        file_is_corrupted
+    }; // compressed_storage_error
+
+
+    class compressed_storage_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "compressed_storage";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(compressed_storage_error(code)) {
+            case compressed_storage_error::ok:
+                return "Ok";
+            case compressed_storage_error::invalid_file_signature:
+                return "Invalid compressed storage file signature";
+            case compressed_storage_error::mismatch_file_size:
+                return "Mismatch file size";
+            case compressed_storage_error::mismatch_item_size:
+                return "Mismatch item size";
+            case compressed_storage_error::mismatch_block_size:
+                return "Mismatch block size";
+            case compressed_storage_error::file_is_corrupted:
+                return "File is corrupted";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline compressed_storage_error_category const compressed_storage_error_category;
+
+
+    inline std::error_code make_error_code(compressed_storage_error e) noexcept {
+        return {int(e), compressed_storage_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::compressed_storage_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    namespace detail {
+
+        struct alignas(64) compressed_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t block_items{0};
+            std::uint32_t block_size{0};
+            std::uint64_t blocks{0};
+        }; // compressed_header
+
+
+        struct compressed_block {
+            // Compressed bytes at the start of the block slot, zero if never written
+            std::uint32_t size;
+            // Block didn't compress and is stored as is
+            std::uint32_t raw;
+        }; // compressed_block
+
+
+        inline constexpr unsigned char compressed_signature[4] = {0xC0, 0x4B, 0x9E, 0x55};
+        inline constexpr std::size_t compressed_page_size = 4096;
+
+    } // namespace detail
+
+
+    // Storage keeping groups of records compressed by LZ codec in a mapped
+    // file. Each block of records has a page aligned slot big enough for it
+    // uncompressed, but only its compressed bytes are written, the rest of
+    // the slot stays a hole, so resident memory and I/O follow the compressed
+    // size. A few recently used blocks are kept decompressed in memory; they
+    // are compressed back when evicted, on flush and on destruction, and
+    // aren't written atomically against crashes. Keys are indexed in memory,
+    // open decompresses every block once to rebuild the index.
+    template<typename Key, typename Value, class Adapter = Value, std::size_t BlockSize = 16384>
+    class compressed_storage {
+    public:
+
+        using key_type = Key;
+        using value_type = Value;
+        using size_type = std::uint64_t;
+
+        static_assert(std::is_trivially_copyable_v<Value>, "Value should be trivially copyable");
+        static_assert(alignof(Value) <= alignof(std::uint64_t), "Value alignment is too large");
+
+        // Records per block, uncompressed block takes about BlockSize bytes
+        static constexpr std::size_t block_items = sizeof(Value) >= BlockSize ? 1
+            : BlockSize / sizeof(Value) >= 64 ? BlockSize / sizeof(Value) / 64 * 64
+            : BlockSize / sizeof(Value);
+
+        class expected;
+
+        static expected create(std::filesystem::path const& path, size_type capacity,
+                               std::size_t hot_blocks = 8);
+        static expected open(std::filesystem::path const& path, std::size_t hot_blocks = 8);
+        static expected open_or_create(std::filesystem::path const& path, size_type capacity,
+                                       std::size_t hot_blocks = 8);
+
+    private:
+
+        static constexpr size_type no_block = ~size_type(0);
+
+        // Decompressed block starts with a bitmap of occupied records
+        static constexpr std::size_t bitmap_words = (block_items + 63) / 64;
+        static constexpr std::size_t image_size = bitmap_words * sizeof(std::uint64_t)
+                                                  + block_items * sizeof(Value);
+        static constexpr std::size_t image_words = (image_size + sizeof(std::uint64_t) - 1)
+                                                   / sizeof(std::uint64_t);
+        static constexpr std::size_t slot_size = (image_size + detail::compressed_page_size - 1)
+                                                 / detail::compressed_page_size
+                                                 * detail::compressed_page_size;
+
+        struct hot_block {
+            size_type block{no_block};
+            std::uint64_t used{0};
+            bool dirty{false};
+            std::vector<std::uint64_t> image;
+
+            Value* items() noexcept {
+                return reinterpret_cast<Value*>(image.data() + bitmap_words);
+            }
+        }; // hot_block
+
+        std::unordered_map<Key, size_type> indices_;
+        std::vector<size_type> free_indices_;
+        std::vector<hot_block> hot_;
+        std::vector<unsigned char> buffer_;
+        std::uint64_t clock_{0};
+        mapped_file mapped_file_;
+        detail::compressed_header* header_{nullptr};
+        detail::compressed_block* directory_{nullptr};
+
+        compressed_storage(mapped_file&& mapped_file, std::size_t hot_blocks)
+            : hot_(std::max<std::size_t>(hot_blocks, 1))
+            , buffer_(image_size)
+            , mapped_file_{std::move(mapped_file)}
+            , header_{mapped_file_.cast<detail::compressed_header>(0)}
+            , directory_{mapped_file_.cast<detail::compressed_block>(sizeof(detail::compressed_header))} {
+            for(auto& each: hot_)
+                each.image.resize(image_words);
+        }
+
+
+        static std::size_t data_offset(size_type blocks) noexcept {
+            auto const size = sizeof(detail::compressed_header) + blocks * sizeof(detail::compressed_block);
+            return (size + detail::compressed_page_size - 1)
+                   / detail::compressed_page_size * detail::compressed_page_size;
+        }
+
+
+        static std::size_t file_size(size_type blocks) noexcept {
+            return data_offset(blocks) + blocks * slot_size;
+        }
+
+    public:
+
+        compressed_storage() noexcept = default;
+        compressed_storage(compressed_storage const&) = delete;
+        compressed_storage& operator = (compressed_storage const&) = delete;
+        compressed_storage(compressed_storage&&) noexcept = default;
+
+
+        compressed_storage& operator = (compressed_storage&& other) noexcept {
+            if(this == &other)
+                return *this;
+            if(!!mapped_file_)
+                write_back();
+            indices_ = std::move(other.indices_);
+            free_indices_ = std::move(other.free_indices_);
+            hot_ = std::move(other.hot_);
+            buffer_ = std::move(other.buffer_);
+            clock_ = other.clock_;
+            mapped_file_ = std::move(other.mapped_file_);
+            header_ = other.header_;
+            directory_ = other.directory_;
+            return *this;
+        }
+
+
+        ~compressed_storage() {
+            if(!!mapped_file_)
+                write_back();
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!mapped_file_;
+        }
+
+
+        size_type capacity() const noexcept {
+            return header_->blocks * block_items;
+        }
+
+
+        size_type size() const noexcept {
+            return size_type(indices_.size());
+        }
+
+
+        bool empty() const noexcept {
+            return indices_.empty();
+        }
+
+
+        // Bytes taken by compressed blocks in the file
+        size_type compressed_size() const noexcept {
+            auto size = size_type(0);
+            for(auto i = size_type(0); i != header_->blocks; ++i)
+                size += directory_[i].size;
+            return size;
+        }
+
+
+        // Pointer into a decompressed block, valid until the next call
+        // finding or changing a record of another block
+        Value const* find(Key const& key) {
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return nullptr;
+            auto& hot = hot_block_of(found->second / block_items);
+            return hot.items() + found->second % block_items;
+        }
+
+
+        bool contains(Key const& key) const noexcept {
+            return indices_.find(key) != indices_.end();
+        }
+
+
+        // False if the key is present or storage is full
+        bool insert(Value const& value) {
+            auto const key = Adapter::key_of(value);
+            if(free_indices_.empty() || indices_.find(key) != indices_.end())
+                return false;
+            auto const index = free_indices_.back();
+            free_indices_.pop_back();
+            auto& hot = hot_block_of(index / block_items);
+            auto const i = std::size_t(index % block_items);
+            hot.image[i / 64] |= std::uint64_t(1) << (i % 64);
+            hot.items()[i] = value;
+            hot.dirty = true;
+            indices_.emplace(key, index);
+            return true;
+        }
+
+
+        // False if storage is full
+        bool insert_or_assign(Value const& value) {
+            auto const found = indices_.find(Adapter::key_of(value));
+            if(found == indices_.end())
+                return insert(value);
+            auto& hot = hot_block_of(found->second / block_items);
+            hot.items()[found->second % block_items] = value;
+            hot.dirty = true;
+            return true;
+        }
+
+
+        // Calls fn(Value&), which shouldn't change the key
+        template<typename F> bool update(Key const& key, F&& fn) {
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return false;
+            auto& hot = hot_block_of(found->second / block_items);
+            fn(hot.items()[found->second % block_items]);
+            hot.dirty = true;
+            return true;
+        }
+
+
+        bool erase(Key const& key) {
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return false;
+            auto const index = found->second;
+            auto& hot = hot_block_of(index / block_items);
+            auto const i = std::size_t(index % block_items);
+            hot.image[i / 64] &= ~(std::uint64_t(1) << (i % 64));
+            // Zeroed record compresses to nearly nothing
+            std::memset(static_cast<void*>(hot.items() + i), 0, sizeof(Value));
+            hot.dirty = true;
+            free_indices_.push_back(index);
+            indices_.erase(found);
+            return true;
+        }
+
+
+        void clear() noexcept {
+            for(auto& each: hot_) {
+                each.block = no_block;
+                each.dirty = false;
+            }
+            for(auto i = size_type(0); i != header_->blocks; ++i)
+                directory_[i] = detail::compressed_block{0, 0};
+            mapped_file_.discard(data_offset(header_->blocks), header_->blocks * slot_size);
+            indices_.clear();
+            free_indices_.clear();
+            for(auto i = capacity(); i-- != 0;)
+                free_indices_.push_back(i);
+        }
+
+
+        // Compresses changed blocks back and writes them through
+        std::error_code flush() noexcept {
+            write_back();
+            return mapped_file_.flush();
+        }
+
+    private:
+
+        std::size_t slot_offset(size_type block) const noexcept {
+            return data_offset(header_->blocks) + block * slot_size;
+        }
+
+
+        unsigned char* slot(size_type block) noexcept {
+            return mapped_file_.cast<unsigned char>(slot_offset(block));
+        }
+
+
+        // Blocks are validated on open, so reading them doesn't fail later
+        bool read(size_type block, std::uint64_t* image) noexcept {
+            auto const& entry = directory_[block];
+            if(entry.size == 0) {
+                std::memset(image, 0, image_size);
+                return true;
+            }
+            if(entry.raw != 0) {
+                if(entry.size != image_size)
+                    return false;
+                std::memcpy(image, slot(block), image_size);
+                return true;
+            }
+            auto decompressed = std::size_t(0);
+            return entry.size < image_size
+                && lz::decompress(slot(block), entry.size, image, image_size, decompressed)
+                && decompressed == image_size;
+        }
+
+
+        void write(hot_block& hot) noexcept {
+            auto& entry = directory_[hot.block];
+            auto const previous = entry.size;
+            auto* target = slot(hot.block);
+            // Compressed block is kept only if it saves something
+            auto size = lz::compress(hot.image.data(), image_size, buffer_.data(), image_size - 1);
+            if(size == 0) {
+                std::memcpy(target, hot.image.data(), image_size);
+                size = image_size;
+                entry.raw = 1;
+            } else {
+                std::memcpy(target, buffer_.data(), size);
+                entry.raw = 0;
+            }
+            entry.size = std::uint32_t(size);
+            if(size < previous)
+                mapped_file_.discard(slot_offset(hot.block) + size, previous - size);
+            hot.dirty = false;
+        }
+
+
+        void write_back() noexcept {
+            for(auto& each: hot_)
+                if(each.dirty)
+                    write(each);
+        }
+
+
+        // Least recently used hot block is evicted to decompress another one
+        hot_block& hot_block_of(size_type block) noexcept {
+            auto* victim = &hot_.front();
+            for(auto& each: hot_) {
+                if(each.block == block) {
+                    each.used = ++clock_;
+                    return each;
+                }
+                if(each.used < victim->used)
+                    victim = &each;
+            }
+            if(victim->dirty)
+                write(*victim);
+            victim->block = block;
+            victim->used = ++clock_;
+            read(block, victim->image.data());
+            return *victim;
+        }
+
+
+        std::error_code load() {
+            auto image = std::vector<std::uint64_t>(image_words);
+            auto const* items = reinterpret_cast<Value const*>(image.data() + bitmap_words);
+            free_indices_.reserve(capacity());
+            for(auto block = header_->blocks; block-- != 0;) {
+                if(!read(block, image.data()))
+                    return make_error_code(compressed_storage_error::file_is_corrupted);
+                for(auto i = block_items; i-- != 0;) {
+                    auto const index = block * block_items + i;
+                    if((image[i / 64] >> (i % 64) & 1) == 0) {
+                        free_indices_.push_back(index);
+                        continue;
+                    }
+                    if(!indices_.emplace(Adapter::key_of(items[i]), index).second)
+                        return make_error_code(compressed_storage_error::file_is_corrupted);
+                }
+            }
+            return {};
+        }
+    }; // compressed_storage
+
+
+    template<typename K, typename V, class A, std::size_t B> class compressed_storage<K, V, A, B>::expected {
+    private:
+        std::error_code error_code_;
+        compressed_storage storage_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(compressed_storage&& s)
+            : storage_(std::move(s)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!storage_;
+        }
+
+
+        compressed_storage& operator * () & noexcept {
+            return storage_;
+        }
+
+
+        compressed_storage&& operator * () && noexcept {
+            return std::move(storage_);
+        }
+
+
+        compressed_storage* operator -> () noexcept {
+            return &storage_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // compressed_storage::expected
+
+
+    template<typename K, typename V, class A, std::size_t B> typename compressed_storage<K, V, A, B>::expected
+    compressed_storage<K, V, A, B>::create(std::filesystem::path const& path, size_type capacity,
+                                           std::size_t hot_blocks) {
+        auto const blocks = std::max<size_type>((capacity + block_items - 1) / block_items, 1);
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        // Slots are holes until blocks are written
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, file_size(blocks), ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->template cast<detail::compressed_header>(0);
+        std::memcpy(header->signature, detail::compressed_signature, sizeof(header->signature));
+        header->item_size = sizeof(V);
+        header->block_items = std::uint32_t(block_items);
+        header->block_size = std::uint32_t(slot_size);
+        header->blocks = blocks;
+        auto target = compressed_storage{std::move(*expected_file), hot_blocks};
+        target.clear();
+        return {std::move(target)};
+    }
+
+
+    template<typename K, typename V, class A, std::size_t B> typename compressed_storage<K, V, A, B>::expected
+    compressed_storage<K, V, A, B>::open(std::filesystem::path const& path, std::size_t hot_blocks) {
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        if(expected_file->size() < data_offset(0))
+            return {make_error_code(compressed_storage_error::mismatch_file_size)};
+        auto* header = expected_file->template cast<detail::compressed_header>(0);
+        if(std::memcmp(header->signature, detail::compressed_signature, sizeof(header->signature)) != 0)
+            return {make_error_code(compressed_storage_error::invalid_file_signature)};
+        if(header->item_size != sizeof(V))
+            return {make_error_code(compressed_storage_error::mismatch_item_size)};
+        if(header->block_items != block_items || header->block_size != slot_size)
+            return {make_error_code(compressed_storage_error::mismatch_block_size)};
+        if(header->blocks == 0 || expected_file->size() != file_size(header->blocks))
+            return {make_error_code(compressed_storage_error::mismatch_file_size)};
+        expected_file->will_need(0, data_offset(header->blocks));
+        auto target = compressed_storage{std::move(*expected_file), hot_blocks};
+        auto const ec = target.load();
+        if(!!ec)
+            return {ec};
+        return {std::move(target)};
+    }
+
+
+    template<typename K, typename V, class A, std::size_t B> typename compressed_storage<K, V, A, B>::expected
+    compressed_storage<K, V, A, B>::open_or_create(std::filesystem::path const& path, size_type capacity,
+                                                   std::size_t hot_blocks) {
+        auto ec = std::error_code{};
+        if(std::filesystem::exists(path, ec))
+            return open(path, hot_blocks);
+        if(!!ec)
+            return {ec};
+        return create(path, capacity, hot_blocks);
+    }
+
+
+} // namespace persia
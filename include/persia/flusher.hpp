@@ -0,0 +1,146 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+
+namespace persia {
+
+
+    struct flusher_policy {
+        // Checkpoint is made at least that often
+        std::chrono::milliseconds interval{100};
+        // or as soon as that many pages are dirty
+        std::size_t dirty_pages{1024};
+    }; // flusher_policy
+
+
+    // Makes checkpoints of storage in background thread, so mutating thread
+    // waits for durability only when it needs it. Storage should not be
+    // moved or destroyed while flusher is alive, and checkpoint should not
+    // be called by anybody else.
+    template<class Storage> class flusher {
+    private:
+
+        Storage* storage_;
+        flusher_policy policy_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable flushed_;
+        std::uint64_t requested_{0};
+        std::uint64_t checkpoints_{0};
+        std::error_code error_;
+        bool stopping_{false};
+        std::thread thread_;
+
+    public:
+
+        explicit flusher(Storage& storage, flusher_policy const& policy = flusher_policy{})
+            : storage_{&storage}, policy_{policy} {
+            thread_ = std::thread{[this] { run(); }};
+        }
+
+
+        flusher(flusher const&) = delete;
+        flusher& operator = (flusher const&) = delete;
+
+
+        // Pages dirty at destruction are flushed
+        ~flusher() {
+            {
+                auto const lock = std::lock_guard<std::mutex>{mutex_};
+                stopping_ = true;
+            }
+            wake_.notify_one();
+            thread_.join();
+        }
+
+
+        std::uint64_t durable_sequence() const noexcept {
+            return storage_->durable_sequence();
+        }
+
+
+        // Error of the last checkpoint
+        std::error_code error() {
+            auto const lock = std::lock_guard<std::mutex>{mutex_};
+            return error_;
+        }
+
+
+        // Requests immediate checkpoint if mutation 'sequence' isn't durable
+        // yet, mutation not made yet is checkpointed as soon as it's made
+        std::error_code wait_durable(std::uint64_t sequence) {
+            auto lock = std::unique_lock<std::mutex>{mutex_};
+            if(storage_->durable_sequence() >= sequence)
+                return {};
+            requested_ = std::max(requested_, sequence);
+            wake_.notify_one();
+            auto const checkpoints = checkpoints_;
+            flushed_.wait(lock, [&] {
+                return stopping_
+                    || storage_->durable_sequence() >= sequence
+                    || (checkpoints_ != checkpoints && !!error_);
+            });
+            if(storage_->durable_sequence() >= sequence)
+                return {};
+            if(!!error_)
+                return error_;
+            return std::make_error_code(std::errc::operation_canceled);
+        }
+
+    private:
+
+        void run() {
+            auto const tick = std::max(policy_.interval / 8, std::chrono::milliseconds{1});
+            auto last = std::chrono::steady_clock::now();
+            auto lock = std::unique_lock<std::mutex>{mutex_};
+            for(;;) {
+                wake_.wait_for(lock, tick, [this] {
+                    return stopping_ || requested();
+                });
+                auto const now = std::chrono::steady_clock::now();
+                auto const due = stopping_
+                    || requested()
+                    || now - last >= policy_.interval
+                    || storage_->dirty_pages() >= policy_.dirty_pages;
+                if(!due)
+                    continue;
+                auto const stopping = stopping_;
+                lock.unlock();
+                auto const ec = storage_->checkpoint();
+                lock.lock();
+                last = now;
+                error_ = ec;
+                ++checkpoints_;
+                // Failed request is reported to waiters and not retried
+                if(!!ec || storage_->durable_sequence() >= requested_)
+                    requested_ = 0;
+                flushed_.notify_all();
+                if(stopping)
+                    return;
+                if(!!ec)
+                    wake_.wait_for(lock, tick, [this] { return stopping_; });
+            }
+        }
+
+
+        // Requested mutations are made and not durable yet
+        bool requested() const noexcept {
+            return std::min(requested_, storage_->sequence()) > storage_->durable_sequence();
+        }
+    }; // flusher
+
+
+} // namespace persia
@@ -0,0 +1,263 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <persia/bloom_filter.hpp>
+
+
+namespace persia {
+
+
+    // Selects primary index that keeps 32-bit key hashes both in records and
+    // in an open addressing table of (hash, record index) pairs. Transparent
+    // Hash (with 'is_transparent' member type) enables lookup by any type
+    // comparable to Key and hashed equally.
+    template<class Hash = void> struct hashed_indices { }; // hashed_indices
+
+
+    namespace detail {
+
+
+        template<class I> struct is_hashed_indices: std::false_type {
+            using hash = void;
+        }; // is_hashed_indices
+
+
+        template<class H> struct is_hashed_indices<hashed_indices<H>>: std::true_type {
+            using hash = H;
+        }; // is_hashed_indices
+
+
+        template<class H, typename = void> struct is_transparent: std::false_type { };
+
+
+        template<class H>
+        struct is_transparent<H, std::void_t<typename H::is_transparent>>: std::true_type { };
+
+
+        // Linear probing table of hash tags. Keys are read from records only
+        // when tags are equal, so probing stays within the table.
+        template<typename Key, class Record, class Adapter, class Hash>
+        class tag_table {
+        public:
+
+            using size_type = std::size_t;
+            using index_type = std::uint32_t;
+            using hasher = std::conditional_t<std::is_void_v<Hash>, std::hash<Key>, Hash>;
+
+            static constexpr index_type no_index = ~index_type(0);
+            static constexpr bool transparent = is_transparent<hasher>::value;
+
+            struct slot {
+                std::uint32_t tag;
+                index_type second;
+            }; // slot
+
+        private:
+
+            std::vector<slot> slots_;
+            size_type size_{0};
+            Record const* records_{nullptr};
+
+
+            template<class S> class basic_iterator {
+            friend class tag_table;
+            private:
+                S* current_;
+                S* last_;
+
+                basic_iterator(S* current, S* last) noexcept
+                    : current_{current}, last_{last} {
+                    skip();
+                }
+
+                void skip() noexcept {
+                    while(current_ != last_ && current_->second == no_index)
+                        ++current_;
+                }
+
+            public:
+
+                bool operator == (basic_iterator const& other) const noexcept {
+                    return current_ == other.current_;
+                }
+
+
+                bool operator != (basic_iterator const& other) const noexcept {
+                    return current_ != other.current_;
+                }
+
+
+                S& operator * () const noexcept { return *current_; }
+                S* operator -> () const noexcept { return current_; }
+
+
+                basic_iterator& operator ++ () noexcept {
+                    ++current_;
+                    skip();
+                    return *this;
+                }
+
+
+                basic_iterator operator ++ (int) noexcept {
+                    auto current = *this;
+                    ++*this;
+                    return current;
+                }
+            }; // basic_iterator
+
+        public:
+
+            using iterator = basic_iterator<slot>;
+            using const_iterator = basic_iterator<slot const>;
+
+
+            template<typename K> static std::uint32_t hash_of(K const& key) noexcept {
+                return std::uint32_t(mix_hash(std::uint64_t(hasher{}(key))));
+            }
+
+
+            void attach(Record const* records) noexcept {
+                records_ = records;
+            }
+
+
+            size_type size() const noexcept { return size_; }
+            bool empty() const noexcept { return size_ == 0; }
+
+            iterator begin() noexcept { return iterator{slots_.data(), slots_.data() + slots_.size()}; }
+            iterator end() noexcept { return iterator{slots_.data() + slots_.size(), slots_.data() + slots_.size()}; }
+
+            const_iterator begin() const noexcept {
+                return const_iterator{slots_.data(), slots_.data() + slots_.size()};
+            }
+
+            const_iterator end() const noexcept {
+                return const_iterator{slots_.data() + slots_.size(), slots_.data() + slots_.size()};
+            }
+
+
+            // Table is kept at most three quarters full
+            void reserve(size_type count) {
+                auto capacity = size_type(16);
+                while(capacity * 3 < count * 4)
+                    capacity *= 2;
+                if(capacity > slots_.size())
+                    rehash(capacity);
+            }
+
+
+            void clear() noexcept {
+                for(auto& each: slots_)
+                    each.second = no_index;
+                size_ = 0;
+            }
+
+
+            template<typename K> iterator find(K const& key) noexcept {
+                auto* last = slots_.data() + slots_.size();
+                return iterator{slots_.data() + locate(key, hash_of(key)), last};
+            }
+
+
+            template<typename K> const_iterator find(K const& key) const noexcept {
+                auto const* last = slots_.data() + slots_.size();
+                return const_iterator{slots_.data() + locate(key, hash_of(key)), last};
+            }
+
+
+            std::pair<iterator, bool> try_emplace(Key const& key, index_type index) {
+                return try_emplace(key, index, hash_of(key));
+            }
+
+
+            // Tag is the hash of the key computed beforehand
+            std::pair<iterator, bool> try_emplace(Key const& key, index_type index, std::uint32_t tag) {
+                reserve(size_ + 1);
+                auto const mask = slots_.size() - 1;
+                for(auto i = size_type(tag) & mask;; i = (i + 1) & mask) {
+                    auto& current = slots_[i];
+                    if(current.second == no_index) {
+                        current = slot{tag, index};
+                        ++size_;
+                        return {iterator{&current, slots_.data() + slots_.size()}, true};
+                    }
+                    if(current.tag == tag && Adapter::key_of(records_[current.second].data) == key)
+                        return {iterator{&current, slots_.data() + slots_.size()}, false};
+                }
+            }
+
+
+            // Inserts known unique key without reading records
+            void insert_unique(std::uint32_t tag, index_type index) {
+                reserve(size_ + 1);
+                place(slot{tag, index});
+                ++size_;
+            }
+
+
+            // Backward shift deletion keeps probe sequences free of tombstones
+            void erase(iterator it) noexcept {
+                auto const mask = slots_.size() - 1;
+                auto hole = size_type(it.current_ - slots_.data());
+                for(auto i = (hole + 1) & mask; slots_[i].second != no_index; i = (i + 1) & mask) {
+                    auto const home = size_type(slots_[i].tag) & mask;
+                    if(((i - home) & mask) >= ((i - hole) & mask)) {
+                        slots_[hole] = slots_[i];
+                        hole = i;
+                    }
+                }
+                slots_[hole].second = no_index;
+                --size_;
+            }
+
+        private:
+
+            // Position of the key or size of the table if it's absent
+            template<typename K> size_type locate(K const& key, std::uint32_t tag) const noexcept {
+                if(slots_.empty())
+                    return 0;
+                auto const mask = slots_.size() - 1;
+                for(auto i = size_type(tag) & mask;; i = (i + 1) & mask) {
+                    auto const& current = slots_[i];
+                    if(current.second == no_index)
+                        return slots_.size();
+                    if(current.tag == tag && Adapter::key_of(records_[current.second].data) == key)
+                        return i;
+                }
+            }
+
+
+            void place(slot const& value) noexcept {
+                auto const mask = slots_.size() - 1;
+                auto i = size_type(value.tag) & mask;
+                while(slots_[i].second != no_index)
+                    i = (i + 1) & mask;
+                slots_[i] = value;
+            }
+
+
+            void rehash(size_type capacity) {
+                auto previous = std::move(slots_);
+                slots_.assign(capacity, slot{0, no_index});
+                for(auto const& each: previous)
+                    if(each.second != no_index)
+                        place(each);
+            }
+        }; // tag_table
+
+
+    } // namespace detail
+
+
+} // namespace persia
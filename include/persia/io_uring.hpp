@@ -0,0 +1,230 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#if defined(PERSIA_USE_IO_URING) && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PERSIA_IO_URING 1
+#endif
+#endif
+
+
+#if defined(PERSIA_IO_URING)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace persia {
+
+
+    namespace detail {
+
+
+        // Minimal io_uring submission/completion rings used to write back
+        // file ranges as a single linked batch without liburing
+        class uring {
+        public:
+
+            static constexpr unsigned depth = 64;
+
+        private:
+
+            int fd_{-1};
+            void* sq_ring_{MAP_FAILED};
+            std::size_t sq_ring_size_{0};
+            void* cq_ring_{MAP_FAILED};
+            std::size_t cq_ring_size_{0};
+            io_uring_sqe* sqes_{static_cast<io_uring_sqe*>(MAP_FAILED)};
+            std::size_t sqes_size_{0};
+            unsigned* sq_tail_{nullptr};
+            unsigned* sq_mask_{nullptr};
+            unsigned* sq_array_{nullptr};
+            unsigned* cq_head_{nullptr};
+            unsigned* cq_tail_{nullptr};
+            unsigned* cq_mask_{nullptr};
+            io_uring_cqe* cqes_{nullptr};
+            unsigned tail_{0};
+
+        public:
+
+            uring() noexcept {
+                auto params = io_uring_params{};
+                fd_ = int(::syscall(__NR_io_uring_setup, depth, &params));
+                if(fd_ == -1)
+                    return;
+                sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                auto const single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+                if(single)
+                    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+                sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+                if(sq_ring_ == MAP_FAILED) {
+                    dispose();
+                    return;
+                }
+                cq_ring_ = single
+                    ? sq_ring_
+                    : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+                if(cq_ring_ == MAP_FAILED) {
+                    dispose();
+                    return;
+                }
+                sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+                sqes_ = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                                          MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+                if(sqes_ == MAP_FAILED) {
+                    dispose();
+                    return;
+                }
+                auto* sq = static_cast<char*>(sq_ring_);
+                auto* cq = static_cast<char*>(cq_ring_);
+                sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+                sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+                sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+                cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+                cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+                cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+                cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+                tail_ = *sq_tail_;
+            }
+
+
+            uring(uring const&) = delete;
+            uring& operator = (uring const&) = delete;
+
+
+            ~uring() {
+                dispose();
+            }
+
+
+            explicit operator bool () const noexcept {
+                return fd_ != -1;
+            }
+
+
+            // Ring of the calling thread, empty if io_uring is not available
+            static uring& local() noexcept {
+                thread_local uring ring;
+                return ring;
+            }
+
+
+            // Starts write-back of every extent and links fdatasync after them.
+            // EINVAL means the kernel doesn't support some of operations or
+            // didn't take all of them, then the ring isn't used any more.
+            template<class E> std::error_code sync(int file, E const* extents, std::size_t count) noexcept {
+                constexpr auto max_length = std::size_t(1) << 30;
+                auto queued = 0u;
+                for(auto i = std::size_t(0); i != count; ++i)
+                    for(auto offset = extents[i].offset; offset != extents[i].offset + extents[i].size;) {
+                        auto const length = std::min(extents[i].offset + extents[i].size - offset, max_length);
+                        auto* sqe = next();
+                        sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+                        sqe->flags = IOSQE_IO_LINK;
+                        sqe->fd = file;
+                        sqe->off = offset;
+                        sqe->len = std::uint32_t(length);
+                        sqe->sync_range_flags = SYNC_FILE_RANGE_WRITE;
+                        offset += length;
+                        if(++queued != depth - 1)
+                            continue;
+                        auto const ec = submit_with_fsync(file, queued);
+                        if(!!ec)
+                            return ec;
+                        queued = 0;
+                    }
+                return submit_with_fsync(file, queued);
+            }
+
+        private:
+
+            // Entries are published to the kernel by submit
+            io_uring_sqe* next() noexcept {
+                auto const index = tail_++ & *sq_mask_;
+                auto* sqe = sqes_ + index;
+                std::memset(sqe, 0, sizeof(io_uring_sqe));
+                sq_array_[index] = index;
+                return sqe;
+            }
+
+
+            std::error_code submit_with_fsync(int file, unsigned queued) noexcept {
+                auto* sqe = next();
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = file;
+                sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+                auto const queued_with_fsync = queued + 1;
+                __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+                auto consumed = 0L;
+                while((consumed = ::syscall(__NR_io_uring_enter, fd_, queued_with_fsync, 0, 0, nullptr, 0)) == -1)
+                    if(errno != EINTR)
+                        return {errno, std::system_category()};
+                // Only consumed entries complete; the rest stay in the ring, so
+                // it's dropped and the caller falls back to system calls
+                auto const submitted = unsigned(consumed);
+                // Linked operations after a failed one are cancelled, the
+                // first failure is reported
+                auto result = 0;
+                for(auto reaped = 0u; reaped != submitted;) {
+                    auto const head = *cq_head_;
+                    if(head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+                        if(::syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) == -1
+                           && errno != EINTR)
+                            return {errno, std::system_category()};
+                        continue;
+                    }
+                    auto const res = cqes_[head & *cq_mask_].res;
+                    if(res < 0 && (result == 0 || result == -ECANCELED))
+                        result = res;
+                    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                    ++reaped;
+                }
+                if(submitted != queued_with_fsync) {
+                    dispose();
+                    return std::make_error_code(std::errc::invalid_argument);
+                }
+                if(result < 0)
+                    return {-result, std::system_category()};
+                return {};
+            }
+
+
+            void dispose() noexcept {
+                if(sqes_ != MAP_FAILED)
+                    ::munmap(sqes_, sqes_size_);
+                if(cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+                    ::munmap(cq_ring_, cq_ring_size_);
+                if(sq_ring_ != MAP_FAILED)
+                    ::munmap(sq_ring_, sq_ring_size_);
+                if(fd_ != -1)
+                    ::close(fd_);
+                sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+                cq_ring_ = sq_ring_ = MAP_FAILED;
+                fd_ = -1;
+            }
+        }; // uring
+
+
+    } // namespace detail
+
+
+} // namespace persia
+
+#endif
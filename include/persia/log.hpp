@@ -0,0 +1,465 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <persia/atomic.hpp>
+#include <persia/mapped_file.hpp>
+#include <persia/span.hpp>
+
+
+namespace persia {
+
+
+    enum class log_error {
+        ok,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        mismatch_segment_capacity,
+        missing_segment
+    }; // log_error
+
+
+    class log_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "log";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(log_error(code)) {
+            case log_error::ok:
+                return "Ok";
+            case log_error::invalid_file_signature:
+                return "Invalid log segment signature";
+            case log_error::mismatch_file_size:
+                return "Mismatch file size";
+            case log_error::mismatch_item_size:
+                return "Mismatch item size";
+            case log_error::mismatch_segment_capacity:
+                return "Mismatch segment capacity";
+            case log_error::missing_segment:
+                return "Log segment is missing";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline log_error_category const log_error_category;
+
+
+    inline std::error_code make_error_code(log_error e) noexcept {
+        return {int(e), log_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::log_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    namespace detail {
+
+        struct alignas(8) log_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t capacity{0};
+            std::uint32_t reserved{0};
+            std::uint64_t first{0};
+            std::uint64_t size{0};
+        }; // log_header
+
+
+        inline constexpr unsigned char log_signature[4] = {0xA7, 0x10, 0x65, 0xE6};
+
+    } // namespace detail
+
+
+    // Append-only sequence of items kept in a directory of fixed size segment
+    // files named by sequence number of their first item. Appending is done
+    // by a single writer, readers in the same or other processes open their
+    // own log objects and see items once the segment size is published.
+    template<typename T> class log {
+    public:
+
+        using value_type = T;
+        using size_type = std::uint32_t;
+
+        static_assert(std::is_trivially_copyable_v<T>, "T should be trivially copyable");
+
+        class expected;
+
+        static expected create(std::filesystem::path const& directory, size_type segment_capacity);
+        static expected open(std::filesystem::path const& directory);
+        static expected open_or_create(std::filesystem::path const& directory, size_type segment_capacity);
+
+    private:
+
+        struct segment {
+            mapped_file file;
+            detail::log_header* header;
+            T* items;
+        }; // segment
+
+        std::filesystem::path directory_;
+        size_type segment_capacity_{0};
+        std::deque<segment> segments_;
+        std::uint64_t unflushed_{0};
+
+        log(std::filesystem::path const& directory, size_type segment_capacity) noexcept
+            : directory_{directory}, segment_capacity_{segment_capacity} {
+        }
+
+    public:
+
+        log() noexcept = default;
+        log(log const&) = delete;
+        log& operator = (log const&) = delete;
+        log(log&&) noexcept = default;
+        log& operator = (log&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !segments_.empty();
+        }
+
+
+        size_type segment_capacity() const noexcept {
+            return segment_capacity_;
+        }
+
+
+        // Sequence number of the oldest item not truncated
+        std::uint64_t front() const noexcept {
+            return segments_.front().header->first;
+        }
+
+
+        // Sequence number of the next item to append. Segments rotated
+        // by other log object are mapped on the way.
+        std::uint64_t tail() noexcept {
+            follow();
+            auto const& last = segments_.back();
+            return last.header->first + detail::load_acquire(&last.header->size);
+        }
+
+
+        std::error_code append(T const& item) {
+            return append(span<T const>{&item, 1});
+        }
+
+
+        // Items are published at once within every segment they occupy
+        std::error_code append(span<T const> items) {
+            while(!items.empty()) {
+                auto* last = &segments_.back();
+                if(last->header->size == segment_capacity_) {
+                    auto const ec = rotate();
+                    if(!!ec)
+                        return ec;
+                    last = &segments_.back();
+                }
+                auto const size = last->header->size;
+                auto const count = std::min<std::size_t>(items.size(), segment_capacity_ - size);
+                std::memcpy(last->items + size, items.data(), count * sizeof(T));
+                detail::store_release(&last->header->size, size + count);
+                items = items.subspan(count, items.size() - count);
+            }
+            return {};
+        }
+
+
+        // Up to 'count' items from 'sequence' lying in the same segment, empty
+        // if they are not appended yet or truncated. Items stay valid until
+        // their segment is truncated by this log object.
+        span<T const> read(std::uint64_t sequence, std::size_t count) noexcept {
+            if(sequence < front())
+                return {};
+            auto const index = std::size_t((sequence - front()) / segment_capacity_);
+            if(index >= segments_.size()) {
+                follow();
+                if(index >= segments_.size())
+                    return {};
+            }
+            auto const& found = segments_[index];
+            auto const offset = sequence - found.header->first;
+            auto const size = detail::load_acquire(&found.header->size);
+            if(offset >= size)
+                return {};
+            return {found.items + offset, std::min<std::size_t>(count, size - offset)};
+        }
+
+
+        // Deletes segments holding only items before 'sequence', the last
+        // segment is kept
+        std::error_code truncate(std::uint64_t sequence) {
+            while(segments_.size() > 1 && front() + segment_capacity_ <= sequence) {
+                auto const path = segment_path(directory_, front());
+                segments_.pop_front();
+                auto ec = std::error_code{};
+                std::filesystem::remove(path, ec);
+                if(!!ec)
+                    return ec;
+            }
+            unflushed_ = std::max(unflushed_, front());
+            return {};
+        }
+
+
+        // Syncs items appended since the previous flush
+        std::error_code flush() noexcept {
+            auto const end = tail();
+            if(unflushed_ == end)
+                return {};
+            for(auto const& each: segments_) {
+                auto const last = each.header->first + each.header->size;
+                if(last <= unflushed_)
+                    continue;
+                auto const from = std::max(unflushed_, each.header->first) - each.header->first;
+                auto const offset = sizeof(detail::log_header) + from * sizeof(T);
+                auto ec = each.file.flush(offset, (each.header->size - from) * sizeof(T));
+                if(!ec)
+                    ec = each.file.flush(0, sizeof(detail::log_header));
+                if(!!ec)
+                    return ec;
+            }
+            unflushed_ = end;
+            return {};
+        }
+
+    private:
+
+        static std::filesystem::path segment_path(std::filesystem::path const& directory,
+                                                  std::uint64_t first) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%020llu.seg", static_cast<unsigned long long>(first));
+            return directory / name;
+        }
+
+
+        static std::size_t segment_size(size_type capacity) noexcept {
+            return sizeof(detail::log_header) + std::size_t(capacity) * sizeof(T);
+        }
+
+
+        // Segment is prepared under temporary name, so readers never
+        // map it partially initialized
+        std::error_code add_segment(std::uint64_t first) {
+            namespace fs = std::filesystem;
+            auto const path = segment_path(directory_, first);
+            auto temporary = path;
+            temporary += ".tmp";
+            auto* file = std::fopen(temporary.string().data(), "w+b");
+            if(file == nullptr)
+                return {int(errno), std::system_category()};
+            std::fclose(file);
+            auto ec = std::error_code{};
+            fs::resize_file(temporary, segment_size(segment_capacity_), ec);
+            if(!!ec)
+                return ec;
+            {
+                auto expected_file = mapped_file::create(temporary);
+                if(!expected_file)
+                    return expected_file.error();
+                auto* header = expected_file->cast<detail::log_header>(0);
+                std::memcpy(header->signature, detail::log_signature, sizeof(header->signature));
+                header->item_size = sizeof(T);
+                header->capacity = segment_capacity_;
+                header->first = first;
+            }
+            fs::rename(temporary, path, ec);
+            if(!!ec)
+                return ec;
+            return map_segment(path, first);
+        }
+
+
+        std::error_code map_segment(std::filesystem::path const& path, std::uint64_t first) {
+            auto expected_file = mapped_file::create(path);
+            if(!expected_file)
+                return expected_file.error();
+            if(expected_file->size() < sizeof(detail::log_header))
+                return make_error_code(log_error::mismatch_file_size);
+            auto* header = expected_file->cast<detail::log_header>(0);
+            if(std::memcmp(header->signature, detail::log_signature, sizeof(header->signature)) != 0)
+                return make_error_code(log_error::invalid_file_signature);
+            if(header->item_size != sizeof(T))
+                return make_error_code(log_error::mismatch_item_size);
+            if(segment_capacity_ == 0)
+                segment_capacity_ = header->capacity;
+            if(header->capacity != segment_capacity_ || header->first != first)
+                return make_error_code(log_error::mismatch_segment_capacity);
+            if(expected_file->size() != segment_size(segment_capacity_))
+                return make_error_code(log_error::mismatch_file_size);
+            auto* items = expected_file->cast<T>(sizeof(detail::log_header));
+            segments_.push_back(segment{std::move(*expected_file), header, items});
+            return {};
+        }
+
+
+        std::error_code rotate() {
+            return add_segment(segments_.back().header->first + segment_capacity_);
+        }
+
+
+        // Maps segments added by the writer since the last one became full
+        void follow() noexcept {
+            for(;;) {
+                auto const& last = segments_.back();
+                if(detail::load_acquire(&last.header->size) != segment_capacity_)
+                    return;
+                auto const first = last.header->first + segment_capacity_;
+                auto const path = segment_path(directory_, first);
+                auto ec = std::error_code{};
+                if(!std::filesystem::exists(path, ec))
+                    return;
+                if(!!map_segment(path, first))
+                    return;
+            }
+        }
+    }; // log
+
+
+    template<typename T> class log<T>::expected {
+    private:
+        std::error_code error_code_;
+        log log_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(log&& l)
+            : log_(std::move(l)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!log_;
+        }
+
+
+        log& operator * () & noexcept {
+            return log_;
+        }
+
+
+        log&& operator * () && noexcept {
+            return std::move(log_);
+        }
+
+
+        log* operator -> () noexcept {
+            return &log_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // log::expected
+
+
+    // Segments of previous log in the directory are deleted
+    template<typename T> typename log<T>::expected
+    log<T>::create(std::filesystem::path const& directory, size_type segment_capacity) {
+        namespace fs = std::filesystem;
+        if(segment_capacity == 0)
+            return {make_error_code(log_error::mismatch_segment_capacity)};
+        auto ec = std::error_code{};
+        fs::create_directories(directory, ec);
+        if(!!ec)
+            return {ec};
+        for(auto const& entry: fs::directory_iterator{directory, ec}) {
+            auto const extension = entry.path().extension();
+            if(extension == ".seg" || extension == ".tmp")
+                fs::remove(entry.path(), ec);
+            if(!!ec)
+                return {ec};
+        }
+        if(!!ec)
+            return {ec};
+        auto target = log{directory, segment_capacity};
+        ec = target.add_segment(0);
+        if(!!ec)
+            return {ec};
+        return {std::move(target)};
+    }
+
+
+    template<typename T> typename log<T>::expected
+    log<T>::open(std::filesystem::path const& directory) {
+        namespace fs = std::filesystem;
+        auto ec = std::error_code{};
+        auto firsts = std::vector<std::uint64_t>{};
+        for(auto const& entry: fs::directory_iterator{directory, ec}) {
+            if(entry.path().extension() != ".seg")
+                continue;
+            auto const stem = entry.path().stem().string();
+            char* end = nullptr;
+            auto const first = std::strtoull(stem.data(), &end, 10);
+            if(end != stem.data() + stem.size())
+                continue;
+            firsts.push_back(first);
+        }
+        if(!!ec)
+            return {ec};
+        if(firsts.empty())
+            return {make_error_code(log_error::missing_segment)};
+        std::sort(firsts.begin(), firsts.end());
+        auto target = log{directory, 0};
+        for(auto const first: firsts) {
+            if(!target.segments_.empty()
+               && first != target.segments_.back().header->first + target.segment_capacity_)
+                return {make_error_code(log_error::missing_segment)};
+            ec = target.map_segment(segment_path(directory, first), first);
+            if(!!ec)
+                return {ec};
+        }
+        target.unflushed_ = target.tail();
+        return {std::move(target)};
+    }
+
+
+    template<typename T> typename log<T>::expected
+    log<T>::open_or_create(std::filesystem::path const& directory, size_type segment_capacity) {
+        auto ec = std::error_code{};
+        if(!std::filesystem::exists(directory, ec)) {
+            if(!!ec)
+                return {ec};
+            return create(directory, segment_capacity);
+        }
+        auto expected_log = open(directory);
+        if(!!expected_log || expected_log.error() != log_error::missing_segment)
+            return expected_log;
+        return create(directory, segment_capacity);
+    }
+
+
+} // namespace persia
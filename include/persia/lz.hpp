@@ -0,0 +1,175 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+namespace persia::lz {
+
+
+    // Byte oriented LZ77 codec in the manner of LZ4: sequences of a token
+    // (literals length in the high nibble, match length minus 4 in the low
+    // one, 15 meaning more length bytes follow), literals and a 16-bit
+    // little endian match offset; the last sequence has literals only.
+    // Favors speed over ratio, long zero runs of sparse records shrink well.
+
+
+    namespace detail {
+
+        inline constexpr std::size_t min_match = 4;
+        inline constexpr std::size_t max_offset = 65535;
+        inline constexpr unsigned hash_bits = 12;
+
+
+        inline std::uint32_t read32(unsigned char const* p) noexcept {
+            std::uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+
+        inline bool put_length(unsigned char*& out, unsigned char const* end, std::size_t length) noexcept {
+            for(; length >= 255; length -= 255) {
+                if(out == end)
+                    return false;
+                *out++ = 255;
+            }
+            if(out == end)
+                return false;
+            *out++ = static_cast<unsigned char>(length);
+            return true;
+        }
+
+
+        inline bool get_length(unsigned char const*& in, unsigned char const* end, std::size_t& length) noexcept {
+            unsigned char byte;
+            do {
+                if(in == end)
+                    return false;
+                byte = *in++;
+                length += byte;
+            } while(byte == 255);
+            return true;
+        }
+
+
+        inline bool put_sequence(unsigned char*& out, unsigned char const* end,
+                                 unsigned char const* literals, std::size_t literals_length,
+                                 std::size_t offset, std::size_t match_length) noexcept {
+            if(out == end)
+                return false;
+            auto* token = out++;
+            auto const literals_nibble = literals_length < 15 ? literals_length : 15;
+            if(literals_nibble == 15 && !put_length(out, end, literals_length - 15))
+                return false;
+            if(std::size_t(end - out) < literals_length)
+                return false;
+            std::memcpy(out, literals, literals_length);
+            out += literals_length;
+            auto match_nibble = std::size_t(0);
+            if(match_length != 0) {
+                if(end - out < 2)
+                    return false;
+                *out++ = static_cast<unsigned char>(offset);
+                *out++ = static_cast<unsigned char>(offset >> 8);
+                auto const rest = match_length - min_match;
+                match_nibble = rest < 15 ? rest : 15;
+                if(match_nibble == 15 && !put_length(out, end, rest - 15))
+                    return false;
+            }
+            *token = static_cast<unsigned char>(literals_nibble << 4 | match_nibble);
+            return true;
+        }
+
+    } // namespace detail
+
+
+    // Compressed size, zero if it exceeds 'capacity'
+    inline std::size_t compress(void const* source, std::size_t size,
+                                void* destination, std::size_t capacity) noexcept {
+        auto const* in = static_cast<unsigned char const*>(source);
+        auto* out = static_cast<unsigned char*>(destination);
+        auto const* out_end = out + capacity;
+        // Positions plus one of the last occurrences of 4-byte sequences
+        std::uint32_t table[std::size_t(1) << detail::hash_bits] = {};
+        auto anchor = std::size_t(0);
+        auto i = std::size_t(0);
+        while(i + detail::min_match <= size) {
+            auto const sequence = detail::read32(in + i);
+            auto const hash = (sequence * 2654435761u) >> (32 - detail::hash_bits);
+            auto const candidate = std::size_t(table[hash]);
+            table[hash] = std::uint32_t(i + 1);
+            if(candidate == 0 || i - (candidate - 1) > detail::max_offset
+               || detail::read32(in + candidate - 1) != sequence) {
+                ++i;
+                continue;
+            }
+            auto const match = candidate - 1;
+            auto length = detail::min_match;
+            while(i + length != size && in[match + length] == in[i + length])
+                ++length;
+            if(!detail::put_sequence(out, out_end, in + anchor, i - anchor, i - match, length))
+                return 0;
+            i += length;
+            anchor = i;
+        }
+        if(!detail::put_sequence(out, out_end, in + anchor, size - anchor, 0, 0))
+            return 0;
+        return std::size_t(out - static_cast<unsigned char*>(destination));
+    }
+
+
+    // False if the input is malformed or doesn't fit 'capacity'
+    inline bool decompress(void const* source, std::size_t size,
+                           void* destination, std::size_t capacity, std::size_t& decompressed) noexcept {
+        auto const* in = static_cast<unsigned char const*>(source);
+        auto const* in_end = in + size;
+        auto* const first = static_cast<unsigned char*>(destination);
+        auto* out = first;
+        auto const* out_end = first + capacity;
+        while(in != in_end) {
+            auto const token = *in++;
+            auto literals_length = std::size_t(token >> 4);
+            if(literals_length == 15 && !detail::get_length(in, in_end, literals_length))
+                return false;
+            if(literals_length > std::size_t(in_end - in) || literals_length > std::size_t(out_end - out))
+                return false;
+            std::memcpy(out, in, literals_length);
+            in += literals_length;
+            out += literals_length;
+            if(in == in_end)
+                break;
+            if(in_end - in < 2)
+                return false;
+            auto const offset = std::size_t(in[0]) | std::size_t(in[1]) << 8;
+            in += 2;
+            if(offset == 0 || offset > std::size_t(out - first))
+                return false;
+            auto match_length = std::size_t(token & 15);
+            if(match_length == 15 && !detail::get_length(in, in_end, match_length))
+                return false;
+            match_length += detail::min_match;
+            if(match_length > std::size_t(out_end - out))
+                return false;
+            auto const* match = out - offset;
+            if(offset >= match_length) {
+                std::memcpy(out, match, match_length);
+                out += match_length;
+            } else {
+                // Overlapping match repeats the last 'offset' bytes
+                for(auto const* end = out + match_length; out != end;)
+                    *out++ = *match++;
+            }
+        }
+        decompressed = std::size_t(out - first);
+        return true;
+    }
+
+
+} // namespace persia::lz
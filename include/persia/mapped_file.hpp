@@ -5,7 +5,9 @@
 #pragma once
 
 
+#include <cerrno>
 #include <cstddef>
+#include <cstdio>
 #include <filesystem>
 #include <system_error>
 
@@ -25,8 +27,12 @@
 #endif
 
 #include <minwindef.h>
+#include <fileapi.h>
 #include <memoryapi.h>
 #include <handleapi.h>
+#include <processthreadsapi.h>
+#include <sysinfoapi.h>
+#include <io.h>
 
 #elif defined(__unix__) || defined(__MACH__)
 
@@ -35,12 +41,19 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
 #else
 
 #error Unsupported system
 
 #endif
 
+#include <persia/io_uring.hpp>
+
 
 
 namespace persia {
@@ -59,6 +72,11 @@ namespace persia {
     public:
     
         using size_type = std::size_t;
+        
+        struct extent {
+            size_type offset;
+            size_type size;
+        }; // extent
 
         class expected;
         static expected create(std::filesystem::path const& path) noexcept;
@@ -125,6 +143,45 @@ namespace persia {
             return size_;
         }
         
+        
+        // Writes current contents to a new file, sharing extents with this one
+        // (reflink) when file system supports it
+        std::error_code copy_to(std::filesystem::path const& path) const noexcept;
+        
+        
+        // Synchronously writes back pages overlapping [offset, offset + size)
+        std::error_code flush(size_type offset, size_type size) const noexcept;
+        
+        
+        std::error_code flush() const noexcept {
+            return flush(0, size_);
+        }
+        
+        
+        // Starts write-back of all extents, then syncs the file once. Uses
+        // io_uring when compiled with PERSIA_USE_IO_URING and it's available.
+        std::error_code flush_extents(extent const* extents, std::size_t count) const noexcept;
+        
+        
+        // Hints that pages overlapping [offset, offset + size) will be read soon,
+        // so they are read ahead asynchronously
+        void will_need(size_type offset, size_type size) const noexcept;
+        
+        
+        // Hints that whole pages inside [offset, offset + size) aren't needed
+        // any more. On Linux they are punched out of the file, so they take no
+        // disk space and read as zeros; elsewhere their contents are kept.
+        void discard(size_type offset, size_type size) const noexcept;
+        
+        
+        // Releases the mapping, resizes the file at 'path' it was created from
+        // and maps it again. On failure the file gets its original size back
+        // and is mapped again, so the mapping is empty only if that fails too.
+        std::error_code resize(std::filesystem::path const& path, size_type size) noexcept;
+        
+        
+        static size_type page_size() noexcept;
+        
     private:
     
 #if defined(_WIN32)
@@ -229,9 +286,9 @@ namespace persia {
             ::close(file);
             return {std::error_code{code, std::system_category()}};
         }
-        auto size = sb.st_size;
-        auto* address = ::mmap(NULL, size, PROT_RDWR, MAP_PRIVATE, file, 0);
-        if(address == MMAP_FAILED) {
+        auto size = size_type(sb.st_size);
+        auto* address = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        if(address == MAP_FAILED) {
             auto const code = errno;
             ::close(file);
             return {std::error_code{code, std::system_category()}};
@@ -241,4 +298,237 @@ namespace persia {
     }
     
     
+    inline std::error_code mapped_file::copy_to(std::filesystem::path const& path) const noexcept {
+        auto const* bytes = static_cast<char const*>(address_);
+        auto left = size_;
+#if defined(_WIN32)
+        auto file = ::CreateFileA(path.string().data(), GENERIC_WRITE, 0,
+                                  NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(file == INVALID_HANDLE_VALUE)
+            return {int(::GetLastError()), std::system_category()};
+        while(left != 0) {
+            auto written = DWORD{0};
+            auto const chunk = DWORD(left < 0x40000000 ? left : 0x40000000);
+            if(!::WriteFile(file, bytes, chunk, &written, NULL)) {
+                auto const code = int(::GetLastError());
+                ::CloseHandle(file);
+                ::DeleteFileA(path.string().data());
+                return {code, std::system_category()};
+            }
+            bytes += written;
+            left -= written;
+        }
+        if(!::FlushFileBuffers(file)) {
+            auto const code = int(::GetLastError());
+            ::CloseHandle(file);
+            return {code, std::system_category()};
+        }
+        ::CloseHandle(file);
+        return {};
+#else
+        auto file = ::open(path.string().data(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(file == -1)
+            return {errno, std::system_category()};
+#if defined(FICLONE)
+        // Kernel writes back dirty pages of the source before cloning
+        if(::ioctl(file, FICLONE, file_) == 0)
+            left = 0;
+#endif
+        while(left != 0) {
+            auto const written = ::write(file, bytes, left);
+            if(written == -1) {
+                if(errno == EINTR)
+                    continue;
+                auto const code = errno;
+                ::close(file);
+                ::unlink(path.string().data());
+                return {code, std::system_category()};
+            }
+            bytes += written;
+            left -= size_type(written);
+        }
+        if(::fsync(file) == -1) {
+            auto const code = errno;
+            ::close(file);
+            return {code, std::system_category()};
+        }
+        ::close(file);
+        return {};
+#endif
+    }
+    
+    
+    inline mapped_file::size_type mapped_file::page_size() noexcept {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        ::GetSystemInfo(&info);
+        return size_type(info.dwPageSize);
+#else
+        return size_type(::sysconf(_SC_PAGESIZE));
+#endif
+    }
+    
+    
+    inline std::error_code mapped_file::flush(size_type offset, size_type size) const noexcept {
+        if(size == 0)
+            return {};
+        auto const page = page_size();
+        auto const first = offset / page * page;
+        auto* address = static_cast<char*>(address_) + first;
+        auto const length = offset + size - first;
+#if defined(_WIN32)
+        if(!::FlushViewOfFile(address, length) || !::FlushFileBuffers(file_))
+            return {int(::GetLastError()), std::system_category()};
+#else
+        if(::msync(address, length, MS_SYNC) == -1)
+            return {errno, std::system_category()};
+#endif
+        return {};
+    }
+    
+    
+    inline std::error_code mapped_file::flush_extents(extent const* extents, std::size_t count) const noexcept {
+        if(count == 0)
+            return {};
+#if defined(_WIN32)
+        auto const page = page_size();
+        for(auto const* each = extents; each != extents + count; ++each) {
+            auto const first = each->offset / page * page;
+            auto* address = static_cast<char*>(address_) + first;
+            if(!::FlushViewOfFile(address, each->offset + each->size - first))
+                return {int(::GetLastError()), std::system_category()};
+        }
+        if(!::FlushFileBuffers(file_))
+            return {int(::GetLastError()), std::system_category()};
+        return {};
+#elif defined(__linux__)
+#if defined(PERSIA_IO_URING)
+        auto& ring = detail::uring::local();
+        if(ring) {
+            // Kernel without SYNC_FILE_RANGE operation or not taking the whole
+            // batch falls back to syscalls
+            auto const ec = ring.sync(file_, extents, count);
+            if(ec != std::errc::invalid_argument)
+                return ec;
+        }
+#endif
+        for(auto const* each = extents; each != extents + count; ++each)
+            if(::sync_file_range(file_, off64_t(each->offset), off64_t(each->size), SYNC_FILE_RANGE_WRITE) == -1)
+                return {errno, std::system_category()};
+        if(::fdatasync(file_) == -1)
+            return {errno, std::system_category()};
+        return {};
+#else
+        for(auto const* each = extents; each != extents + count; ++each) {
+            auto const ec = flush(each->offset, each->size);
+            if(!!ec)
+                return ec;
+        }
+        return {};
+#endif
+    }
+    
+    
+    inline void mapped_file::will_need(size_type offset, size_type size) const noexcept {
+        if(size == 0)
+            return;
+        auto const page = page_size();
+        auto const first = offset / page * page;
+        auto* address = static_cast<char*>(address_) + first;
+        auto const length = offset + size - first;
+#if defined(_WIN32)
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+        auto range = WIN32_MEMORY_RANGE_ENTRY{address, length};
+        ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+#else
+        (void)address;
+        (void)length;
+#endif
+#else
+        ::madvise(address, length, MADV_WILLNEED);
+#endif
+    }
+    
+    
+    inline void mapped_file::discard(size_type offset, size_type size) const noexcept {
+        auto const page = page_size();
+        auto const first = (offset + page - 1) / page * page;
+        auto const last = (offset + size) / page * page;
+        if(last <= first)
+            return;
+#if defined(_WIN32)
+        (void)first;
+        (void)last;
+#elif defined(__linux__)
+        if(::fallocate(file_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                       off_t(first), off_t(last - first)) == -1)
+            ::madvise(static_cast<char*>(address_) + first, last - first, MADV_DONTNEED);
+#else
+        ::madvise(static_cast<char*>(address_) + first, last - first, MADV_DONTNEED);
+#endif
+    }
+    
+    
+    inline std::error_code mapped_file::resize(std::filesystem::path const& path, size_type size) noexcept {
+        auto const original = size_;
+        *this = mapped_file{};
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, size, ec);
+        if(!ec) {
+            auto expected_file = create(path);
+            if(expected_file) {
+                *this = std::move(*expected_file);
+                return {};
+            }
+            ec = expected_file.error();
+            auto restored = std::error_code{};
+            std::filesystem::resize_file(path, original, restored);
+        }
+        auto expected_file = create(path);
+        if(expected_file)
+            *this = std::move(*expected_file);
+        return ec;
+    }
+    
+    
+    namespace detail {
+        
+        // Flushes stdio buffers and writes the file through to storage device
+        inline std::error_code sync(std::FILE* file) noexcept {
+            if(std::fflush(file) != 0)
+                return {errno, std::system_category()};
+#if defined(_WIN32)
+            if(::_commit(::_fileno(file)) != 0)
+                return {errno, std::system_category()};
+#else
+            if(::fsync(::fileno(file)) != 0)
+                return {errno, std::system_category()};
+#endif
+            return {};
+        }
+        
+        
+        // Makes creation and removal of files in the directory durable. On
+        // Windows directory entries can't be synced and NTFS journals them.
+        inline std::error_code sync_directory(std::filesystem::path const& directory) noexcept {
+#if defined(_WIN32)
+            (void)directory;
+            return {};
+#else
+            auto const name = directory.empty() ? std::string{"."} : directory.string();
+            auto const handle = ::open(name.data(), O_RDONLY);
+            if(handle == -1)
+                return {errno, std::system_category()};
+            auto const result = ::fsync(handle);
+            auto const code = errno;
+            ::close(handle);
+            if(result == -1)
+                return {code, std::system_category()};
+            return {};
+#endif
+        }
+        
+    } // namespace detail
+    
+    
 } // namespace persia
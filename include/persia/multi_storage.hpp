@@ -0,0 +1,553 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <persia/mapped_file.hpp>
+
+
+namespace persia {
+
+
+    enum class multi_storage_error {
+        ok,
+        file_size_is_too_small,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        file_is_corrupted
+    }; // multi_storage_error
+
+
+    class multi_storage_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "multi_storage";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(multi_storage_error(code)) {
+            case multi_storage_error::ok:
+                return "Ok";
+            case multi_storage_error::file_size_is_too_small:
+                return "Multi storage file is too small";
+            case multi_storage_error::invalid_file_signature:
+                return "Invalid multi storage file signature";
+            case multi_storage_error::mismatch_file_size:
+                return "Mismatch file size";
+            case multi_storage_error::mismatch_item_size:
+                return "Mismatch item size";
+            case multi_storage_error::file_is_corrupted:
+                return "File is corrupted";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline multi_storage_error_category const multi_storage_error_category;
+
+
+    inline std::error_code make_error_code(multi_storage_error e) noexcept {
+        return {int(e), multi_storage_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::multi_storage_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    namespace detail {
+
+        struct alignas(8) multi_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t capacity{0};
+            std::uint32_t reserved{0};
+        }; // multi_header
+
+
+        inline constexpr unsigned char multi_signature[4] = {0xC4, 0xA1, 0x25, 0x0F};
+        inline constexpr std::uint32_t multi_occupied = 0xC4A1250F;
+        inline constexpr std::uint32_t no_link = ~std::uint32_t(0);
+
+
+        // Records of a key are doubly linked in insertion order
+        template<typename V> struct multi_record {
+            std::uint32_t marker;
+            std::uint32_t prev;
+            std::uint32_t next;
+            std::uint32_t reserved;
+            V data;
+        }; // multi_record
+
+    } // namespace detail
+
+
+    // Several items per key kept in fixed capacity file of records. Records
+    // of a key form a chain stored in the file, the in-memory index holds
+    // only its ends, so keys with many items cost a single index entry.
+    // Links are updated in an order that lets open drop a half inserted or
+    // half erased record after crash.
+    template<typename Key, typename Value, class Adapter = Value> class multi_storage {
+    public:
+
+        using key_type = Key;
+        using value_type = Value;
+        using size_type = std::uint32_t;
+
+        static_assert(std::is_trivially_copyable_v<Value>, "Value should be trivially copyable");
+
+    private:
+
+        using record_type = detail::multi_record<Value>;
+
+        struct chain {
+            size_type head;
+            size_type tail;
+            size_type count;
+        }; // chain
+
+        std::unordered_map<Key, chain> chains_;
+        std::vector<size_type> free_indices_;
+        mapped_file mapped_file_;
+        detail::multi_header* header_{nullptr};
+        record_type* records_{nullptr};
+        size_type size_{0};
+
+        multi_storage(mapped_file&& mapped_file) noexcept
+            : mapped_file_{std::move(mapped_file)}
+            , header_{mapped_file_.cast<detail::multi_header>(0)}
+            , records_{mapped_file_.cast<record_type>(sizeof(detail::multi_header))} {
+        }
+
+
+        template<class R, typename D> class basic_iterator {
+        friend class multi_storage;
+        private:
+            R* records_{nullptr};
+            size_type index_{detail::no_link};
+
+            basic_iterator(R* records, size_type index) noexcept
+                : records_{records}, index_{index} { }
+
+        public:
+
+            basic_iterator() noexcept = default;
+
+            template<class OR, typename OD, bool C = std::is_const_v<D>, typename = std::enable_if_t<C>>
+            basic_iterator(basic_iterator<OR, OD> const& other) noexcept
+                : records_{other.records_}, index_{other.index_} { }
+
+
+            bool operator == (basic_iterator const& other) const noexcept {
+                return index_ == other.index_;
+            }
+
+
+            bool operator != (basic_iterator const& other) const noexcept {
+                return index_ != other.index_;
+            }
+
+
+            D& operator * () const noexcept { return records_[index_].data; }
+            D* operator -> () const noexcept { return &records_[index_].data; }
+
+
+            basic_iterator& operator ++ () noexcept {
+                index_ = records_[index_].next;
+                return *this;
+            }
+
+
+            basic_iterator operator ++ (int) noexcept {
+                auto current = *this;
+                ++*this;
+                return current;
+            }
+
+            template<class, typename> friend class basic_iterator;
+        }; // basic_iterator
+
+
+        template<class I> class basic_range {
+        friend class multi_storage;
+        private:
+            I begin_;
+            I end_;
+
+            basic_range(I begin, I end) noexcept
+                : begin_{begin}, end_{end} { }
+
+        public:
+
+            I begin() const noexcept { return begin_; }
+            I end() const noexcept { return end_; }
+            bool empty() const noexcept { return begin_ == end_; }
+        }; // basic_range
+
+    public:
+
+        using const_iterator = basic_iterator<record_type const, Value const>;
+        using iterator = basic_iterator<record_type, Value>;
+        using const_range = basic_range<const_iterator>;
+        using range_type = basic_range<iterator>;
+
+        class expected;
+
+        static expected create(std::filesystem::path const& path, size_type initial_capacity);
+        static expected open(std::filesystem::path const& path, size_type initial_capacity);
+        static expected open_or_create(std::filesystem::path const& path, size_type initial_capacity);
+
+
+        multi_storage() noexcept = default;
+        multi_storage(multi_storage const&) = delete;
+        multi_storage& operator = (multi_storage const&) = delete;
+        multi_storage(multi_storage&&) noexcept = default;
+        multi_storage& operator = (multi_storage&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !!mapped_file_;
+        }
+
+
+        size_type capacity() const noexcept {
+            return header_->capacity;
+        }
+
+
+        // Number of items
+        size_type size() const noexcept {
+            return size_;
+        }
+
+
+        bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+
+        bool fully_occupied() const noexcept {
+            return free_indices_.empty();
+        }
+
+
+        // Number of distinct keys
+        size_type key_count() const noexcept {
+            return size_type(chains_.size());
+        }
+
+
+        size_type count(Key const& key) const noexcept {
+            auto const found = chains_.find(key);
+            return found == chains_.end() ? 0 : found->second.count;
+        }
+
+
+        bool contains(Key const& key) const noexcept {
+            return chains_.find(key) != chains_.end();
+        }
+
+
+        // Items of the key in insertion order
+        const_range equal_range(Key const& key) const noexcept {
+            auto const found = chains_.find(key);
+            if(found == chains_.end())
+                return const_range{const_iterator{}, const_iterator{}};
+            return const_range{const_iterator{records_, found->second.head}, const_iterator{}};
+        }
+
+
+        range_type equal_range(Key const& key) noexcept {
+            auto const found = chains_.find(key);
+            if(found == chains_.end())
+                return range_type{iterator{}, iterator{}};
+            return range_type{iterator{records_, found->second.head}, iterator{}};
+        }
+
+
+        // Appends item to the chain of its key, false if storage is full
+        bool insert(Value const& value) {
+            if(free_indices_.empty())
+                return false;
+            auto const key = Adapter::key_of(value);
+            auto emplaced = chains_.try_emplace(key, chain{detail::no_link, detail::no_link, 0});
+            auto& target = emplaced.first->second;
+            auto const index = free_indices_.back();
+            free_indices_.pop_back();
+            auto* record = records_ + index;
+            record->prev = target.tail;
+            record->next = detail::no_link;
+            record->data = value;
+            record->marker = detail::multi_occupied;
+            if(target.tail != detail::no_link)
+                records_[target.tail].next = index;
+            else
+                target.head = index;
+            target.tail = index;
+            ++target.count;
+            ++size_;
+            return true;
+        }
+
+
+        // Iterator to the next item of the same key
+        iterator erase(const_iterator position) noexcept {
+            auto const index = position.index_;
+            auto* record = records_ + index;
+            auto const next = record->next;
+            auto const found = chains_.find(Adapter::key_of(record->data));
+            auto& target = found->second;
+            unlink(index, target);
+            if(--target.count == 0)
+                chains_.erase(found);
+            return iterator{records_, next};
+        }
+
+
+        // Erases all items of the key, returns their number
+        size_type erase(Key const& key) noexcept {
+            auto const found = chains_.find(key);
+            if(found == chains_.end())
+                return 0;
+            auto const count = found->second.count;
+            // Erased from the tail, so the chain stays linked after crash
+            for(auto index = found->second.tail; index != detail::no_link;) {
+                auto const prev = records_[index].prev;
+                unlink(index, found->second);
+                index = prev;
+            }
+            chains_.erase(found);
+            return count;
+        }
+
+
+        void clear() noexcept {
+            for(auto i = size_type(0); i != header_->capacity; ++i)
+                records_[i].marker = 0;
+            chains_.clear();
+            free_indices_.clear();
+            for(auto i = header_->capacity; i-- != 0;)
+                free_indices_.push_back(i);
+            size_ = 0;
+        }
+
+
+        std::error_code flush() const noexcept {
+            return mapped_file_.flush();
+        }
+
+    private:
+
+        // Next item is relinked first, so after crash the erased record is
+        // either still reachable from the head or not reachable at all
+        void unlink(size_type index, chain& target) noexcept {
+            auto* record = records_ + index;
+            if(record->next != detail::no_link)
+                records_[record->next].prev = record->prev;
+            else
+                target.tail = record->prev;
+            if(record->prev != detail::no_link)
+                records_[record->prev].next = record->next;
+            else
+                target.head = record->next;
+            record->marker = 0;
+            free_indices_.push_back(index);
+            --size_;
+        }
+
+
+        // Chains are walked from heads, i.e. records without predecessor
+        // nobody links to; records not reached are freed
+        std::error_code load() {
+            auto const capacity = header_->capacity;
+            auto linked = std::vector<bool>(capacity, false);
+            for(auto i = size_type(0); i != capacity; ++i) {
+                auto const& record = records_[i];
+                if(record.marker == 0)
+                    continue;
+                if(record.marker != detail::multi_occupied)
+                    return make_error_code(multi_storage_error::file_is_corrupted);
+                if(record.next != detail::no_link) {
+                    if(record.next >= capacity)
+                        return make_error_code(multi_storage_error::file_is_corrupted);
+                    linked[record.next] = true;
+                }
+            }
+            auto reached = std::vector<bool>(capacity, false);
+            for(auto i = size_type(0); i != capacity; ++i) {
+                auto const& record = records_[i];
+                if(record.marker != detail::multi_occupied || record.prev != detail::no_link || linked[i])
+                    continue;
+                auto emplaced = chains_.try_emplace(Adapter::key_of(record.data), chain{i, i, 0});
+                if(!emplaced.second)
+                    return make_error_code(multi_storage_error::file_is_corrupted);
+                auto& target = emplaced.first->second;
+                for(auto index = i, prev = detail::no_link; index != detail::no_link;) {
+                    if(reached[index] || records_[index].marker != detail::multi_occupied)
+                        return make_error_code(multi_storage_error::file_is_corrupted);
+                    reached[index] = true;
+                    records_[index].prev = prev;
+                    target.tail = index;
+                    ++target.count;
+                    prev = index;
+                    index = records_[index].next;
+                }
+                size_ += target.count;
+            }
+            free_indices_.reserve(capacity);
+            for(auto i = capacity; i-- != 0;) {
+                if(reached[i])
+                    continue;
+                records_[i].marker = 0;
+                free_indices_.push_back(i);
+            }
+            return {};
+        }
+    }; // multi_storage
+
+
+    template<typename K, typename V, class A> class multi_storage<K, V, A>::expected {
+    private:
+        std::error_code error_code_;
+        multi_storage storage_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(multi_storage&& s)
+            : storage_(std::move(s)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!storage_;
+        }
+
+
+        multi_storage& operator * () & noexcept {
+            return storage_;
+        }
+
+
+        multi_storage&& operator * () && noexcept {
+            return std::move(storage_);
+        }
+
+
+        multi_storage* operator -> () noexcept {
+            return &storage_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // multi_storage::expected
+
+
+    template<typename K, typename V, class A> typename multi_storage<K, V, A>::expected
+    multi_storage<K, V, A>::create(std::filesystem::path const& path, size_type initial_capacity) {
+        if(initial_capacity == 0)
+            return {make_error_code(multi_storage_error::file_size_is_too_small)};
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, sizeof(detail::multi_header)
+                                           + std::size_t(initial_capacity) * sizeof(record_type), ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->cast<detail::multi_header>(0);
+        std::memcpy(header->signature, detail::multi_signature, sizeof(header->signature));
+        header->item_size = sizeof(V);
+        header->capacity = initial_capacity;
+        auto target = multi_storage{std::move(*expected_file)};
+        target.clear();
+        return {std::move(target)};
+    }
+
+
+    // File is expanded to 'initial_capacity' if it's smaller
+    template<typename K, typename V, class A> typename multi_storage<K, V, A>::expected
+    multi_storage<K, V, A>::open(std::filesystem::path const& path, size_type initial_capacity) {
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        if(expected_file->size() < sizeof(detail::multi_header) + sizeof(record_type))
+            return {make_error_code(multi_storage_error::file_size_is_too_small)};
+        auto* header = expected_file->cast<detail::multi_header>(0);
+        if(std::memcmp(header->signature, detail::multi_signature, sizeof(header->signature)) != 0)
+            return {make_error_code(multi_storage_error::invalid_file_signature)};
+        if(header->item_size != sizeof(V))
+            return {make_error_code(multi_storage_error::mismatch_item_size)};
+        auto const capacity = header->capacity;
+        if(expected_file->size() != sizeof(detail::multi_header) + std::size_t(capacity) * sizeof(record_type))
+            return {make_error_code(multi_storage_error::mismatch_file_size)};
+        if(initial_capacity > capacity) {
+            *expected_file = mapped_file{};
+            auto ec = std::error_code{};
+            std::filesystem::resize_file(path, sizeof(detail::multi_header)
+                                               + std::size_t(initial_capacity) * sizeof(record_type), ec);
+            if(!!ec)
+                return {ec};
+            expected_file = mapped_file::create(path);
+            if(!expected_file)
+                return {expected_file.error()};
+            header = expected_file->cast<detail::multi_header>(0);
+            auto* records = expected_file->cast<record_type>(sizeof(detail::multi_header));
+            for(auto i = capacity; i != initial_capacity; ++i)
+                records[i].marker = 0;
+            header->capacity = initial_capacity;
+        }
+        expected_file->will_need(0, expected_file->size());
+        auto target = multi_storage{std::move(*expected_file)};
+        auto const ec = target.load();
+        if(!!ec)
+            return {ec};
+        return {std::move(target)};
+    }
+
+
+    template<typename K, typename V, class A> typename multi_storage<K, V, A>::expected
+    multi_storage<K, V, A>::open_or_create(std::filesystem::path const& path, size_type initial_capacity) {
+        auto ec = std::error_code{};
+        if(std::filesystem::exists(path, ec))
+            return open(path, initial_capacity);
+        if(!!ec)
+            return {ec};
+        return create(path, initial_capacity);
+    }
+
+
+} // namespace persia
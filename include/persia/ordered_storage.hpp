@@ -0,0 +1,778 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <persia/mapped_file.hpp>
+
+
+namespace persia {
+
+
+    enum class ordered_storage_error {
+        ok,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        mismatch_node_size
+    }; // ordered_storage_error
+
+
+    class ordered_storage_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "ordered_storage";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(ordered_storage_error(code)) {
+            case ordered_storage_error::ok:
+                return "Ok";
+            case ordered_storage_error::invalid_file_signature:
+                return "Invalid ordered storage file signature";
+            case ordered_storage_error::mismatch_file_size:
+                return "Mismatch file size";
+            case ordered_storage_error::mismatch_item_size:
+                return "Mismatch item size";
+            case ordered_storage_error::mismatch_node_size:
+                return "Mismatch node size";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline ordered_storage_error_category const ordered_storage_error_category;
+
+
+    inline std::error_code make_error_code(ordered_storage_error e) noexcept {
+        return {int(e), ordered_storage_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::ordered_storage_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    namespace detail {
+
+        // Page 0 of the file, other pages are tree nodes referenced by number
+        struct alignas(8) ordered_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t key_size{0};
+            std::uint32_t node_size{0};
+            std::uint32_t root{0};
+            std::uint32_t height{0};
+            std::uint32_t pages{0};
+            std::uint32_t capacity{0};
+            std::uint32_t free{0};
+            std::uint32_t free_count{0};
+            std::uint64_t size{0};
+        }; // ordered_header
+
+
+        struct node_header {
+            std::uint32_t leaf;
+            std::uint32_t count;
+            std::uint32_t prev;
+            std::uint32_t next;
+        }; // node_header
+
+
+        inline constexpr unsigned char ordered_signature[4] = {0x0B, 0xDE, 0x7E, 0xE5};
+
+
+        // Number of keys less than (or not greater than, if Upper) the given
+        // one. Binary search narrows the range down to a cache line, which is
+        // then counted without branches, so compilers vectorize the loop.
+        template<bool Upper, typename K>
+        std::uint32_t key_position(K const* keys, std::uint32_t count, K const& key) noexcept {
+            if constexpr(std::is_arithmetic_v<K>) {
+                constexpr auto line = std::uint32_t(64 / sizeof(K) < 4 ? 4 : 64 / sizeof(K));
+                auto first = std::uint32_t(0), last = count;
+                while(last - first > line) {
+                    auto const middle = first + (last - first) / 2;
+                    if(Upper ? !(key < keys[middle]) : keys[middle] < key)
+                        first = middle + 1;
+                    else
+                        last = middle;
+                }
+                auto position = first;
+                for(auto i = first; i != last; ++i)
+                    position += Upper ? std::uint32_t(!(key < keys[i])) : std::uint32_t(keys[i] < key);
+                return position;
+            } else {
+                auto const* found = Upper
+                    ? std::upper_bound(keys, keys + count, key)
+                    : std::lower_bound(keys, keys + count, key);
+                return std::uint32_t(found - keys);
+            }
+        }
+
+    } // namespace detail
+
+
+    // B+tree of items ordered by Adapter::key_of kept in nodes of a mapped
+    // file, so opening it doesn't rebuild anything. Nodes are page sized,
+    // keys of a node are kept apart from values and children in arrays
+    // starting at cache line boundaries. Like the in-memory tree, emptied
+    // nodes are released without rebalancing. File grows by doubling, which
+    // remaps it and invalidates pointers to items, iterators stay valid
+    // until the tree is mutated.
+    template<typename Key, typename Value, class Adapter = Value> class ordered_storage {
+    public:
+
+        using key_type = Key;
+        using value_type = Value;
+        using size_type = std::uint64_t;
+        using page_type = std::uint32_t;
+
+        static_assert(std::is_trivially_copyable_v<Key>, "Key should be trivially copyable");
+        static_assert(std::is_trivially_copyable_v<Value>, "Value should be trivially copyable");
+
+        static constexpr std::size_t cache_line_size = 64;
+
+    private:
+
+        static constexpr std::size_t keys_offset = cache_line_size;
+
+        static constexpr std::size_t align_up(std::size_t n) noexcept {
+            return (n + cache_line_size - 1) / cache_line_size * cache_line_size;
+        }
+
+        static constexpr std::size_t leaf_slots(std::size_t node_size) noexcept {
+            return (node_size - keys_offset - cache_line_size) / (sizeof(Key) + sizeof(Value));
+        }
+
+        static constexpr std::size_t inner_slots(std::size_t node_size) noexcept {
+            return (node_size - keys_offset - cache_line_size - sizeof(page_type))
+                / (sizeof(Key) + sizeof(page_type));
+        }
+
+        // Smallest multiple of 4K holding at least 8 items and a spare slot
+        static constexpr std::size_t fit_node_size() noexcept {
+            auto size = std::size_t(4096);
+            while(leaf_slots(size) < 9 || inner_slots(size) < 9)
+                size += 4096;
+            return size;
+        }
+
+    public:
+
+        static constexpr std::size_t node_size = fit_node_size();
+        static constexpr std::uint32_t leaf_capacity = std::uint32_t(leaf_slots(node_size) - 1);
+        static constexpr std::uint32_t inner_capacity = std::uint32_t(inner_slots(node_size) - 1);
+
+    private:
+
+        static constexpr std::size_t values_offset = align_up(keys_offset + leaf_slots(node_size) * sizeof(Key));
+        static constexpr std::size_t children_offset = align_up(keys_offset + inner_slots(node_size) * sizeof(Key));
+        static constexpr std::uint32_t max_height = 32;
+
+        static_assert(alignof(Value) <= cache_line_size, "Value alignment is too large");
+
+        mapped_file mapped_file_;
+        detail::ordered_header* header_{nullptr};
+        char* pages_{nullptr};
+        std::filesystem::path path_;
+
+        ordered_storage(mapped_file&& mapped_file, std::filesystem::path const& path) noexcept
+            : mapped_file_{std::move(mapped_file)}
+            , header_{mapped_file_.cast<detail::ordered_header>(0)}
+            , pages_{mapped_file_.cast<char>(0)}
+            , path_{path} {
+        }
+
+
+        template<class S, typename V> class basic_iterator {
+        friend class ordered_storage;
+        private:
+            S* storage_{nullptr};
+            page_type page_{0};
+            std::uint32_t position_{0};
+
+            basic_iterator(S* storage, page_type page, std::uint32_t position) noexcept
+                : storage_{storage}, page_{page}, position_{position} { }
+
+        public:
+
+            basic_iterator() noexcept = default;
+
+            bool operator == (basic_iterator const& other) const noexcept {
+                return page_ == other.page_ && position_ == other.position_;
+            }
+
+
+            bool operator != (basic_iterator const& other) const noexcept {
+                return !(*this == other);
+            }
+
+
+            V& operator * () const noexcept { return storage_->values_of(page_)[position_]; }
+            V* operator -> () const noexcept { return &storage_->values_of(page_)[position_]; }
+
+
+            basic_iterator& operator ++ () noexcept {
+                if(++position_ == storage_->node_of(page_)->count) {
+                    page_ = storage_->node_of(page_)->next;
+                    position_ = 0;
+                }
+                return *this;
+            }
+
+
+            basic_iterator operator ++ (int) noexcept {
+                auto current = *this;
+                ++*this;
+                return current;
+            }
+        }; // basic_iterator
+
+
+        template<class I> class basic_range {
+        friend class ordered_storage;
+        private:
+            I begin_;
+            I end_;
+
+            basic_range(I begin, I end) noexcept
+                : begin_{begin}, end_{end} { }
+
+        public:
+
+            I begin() const noexcept { return begin_; }
+            I end() const noexcept { return end_; }
+            bool empty() const noexcept { return begin_ == end_; }
+        }; // basic_range
+
+    public:
+
+        using const_iterator = basic_iterator<ordered_storage const, Value const>;
+        using iterator = basic_iterator<ordered_storage, Value>;
+        using const_range = basic_range<const_iterator>;
+        using range_type = basic_range<iterator>;
+
+        class expected;
+
+        static expected create(std::filesystem::path const& path, size_type initial_capacity);
+        static expected open(std::filesystem::path const& path);
+        static expected open_or_create(std::filesystem::path const& path, size_type initial_capacity);
+
+
+        ordered_storage() noexcept = default;
+        ordered_storage(ordered_storage const&) = delete;
+        ordered_storage& operator = (ordered_storage const&) = delete;
+        ordered_storage(ordered_storage&&) noexcept = default;
+        ordered_storage& operator = (ordered_storage&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !!mapped_file_;
+        }
+
+
+        size_type size() const noexcept {
+            return header_->size;
+        }
+
+
+        bool empty() const noexcept {
+            return header_->size == 0;
+        }
+
+
+        std::uint32_t height() const noexcept {
+            return header_->height;
+        }
+
+
+        const_iterator begin() const noexcept {
+            return first_of<const_iterator>(this);
+        }
+
+
+        const_iterator end() const noexcept {
+            return const_iterator{this, 0, 0};
+        }
+
+
+        iterator begin() noexcept {
+            return first_of<iterator>(this);
+        }
+
+
+        iterator end() noexcept {
+            return iterator{this, 0, 0};
+        }
+
+
+        // First item with key not less than the given one
+        const_iterator lower_bound(Key const& key) const noexcept {
+            return bound_of<const_iterator, false>(this, key);
+        }
+
+
+        iterator lower_bound(Key const& key) noexcept {
+            return bound_of<iterator, false>(this, key);
+        }
+
+
+        // First item with key greater than the given one
+        const_iterator upper_bound(Key const& key) const noexcept {
+            return bound_of<const_iterator, true>(this, key);
+        }
+
+
+        iterator upper_bound(Key const& key) noexcept {
+            return bound_of<iterator, true>(this, key);
+        }
+
+
+        // Items with keys in [from, to)
+        const_range range(Key const& from, Key const& to) const noexcept {
+            return const_range{lower_bound(from), lower_bound(to)};
+        }
+
+
+        range_type range(Key const& from, Key const& to) noexcept {
+            return range_type{lower_bound(from), lower_bound(to)};
+        }
+
+
+        Value const* find(Key const& key) const noexcept {
+            return find_of(this, key);
+        }
+
+
+        Value* find(Key const& key) noexcept {
+            return find_of(this, key);
+        }
+
+
+        bool contains(Key const& key) const noexcept {
+            return find(key) != nullptr;
+        }
+
+
+        // False if the key is present or the file can't grow
+        bool insert(Value const& value) {
+            return put(value, false);
+        }
+
+
+        bool insert_or_assign(Value const& value) {
+            return put(value, true);
+        }
+
+
+        bool erase(Key const& key) noexcept {
+            page_type path[max_height];
+            std::uint32_t positions[max_height];
+            auto const leaf = descend(key, path, positions);
+            auto* node = node_of(leaf);
+            auto const position = detail::key_position<false>(keys_of(leaf), node->count, key);
+            if(position == node->count || key < keys_of(leaf)[position])
+                return false;
+            remove_at(keys_of(leaf), node->count, position);
+            remove_at(values_of(leaf), node->count, position);
+            --node->count;
+            --header_->size;
+            if(node->count == 0 && header_->height > 1)
+                release_leaf(leaf, path, positions);
+            return true;
+        }
+
+
+        void clear() noexcept {
+            header_->root = 1;
+            header_->height = 1;
+            header_->pages = 2;
+            header_->free = 0;
+            header_->free_count = 0;
+            header_->size = 0;
+            *node_of(1) = detail::node_header{1, 0, 0, 0};
+        }
+
+
+        std::error_code flush() const noexcept {
+            return mapped_file_.flush();
+        }
+
+    private:
+
+        detail::node_header* node_of(page_type page) noexcept {
+            return reinterpret_cast<detail::node_header*>(pages_ + std::size_t(page) * node_size);
+        }
+
+
+        detail::node_header const* node_of(page_type page) const noexcept {
+            return reinterpret_cast<detail::node_header const*>(pages_ + std::size_t(page) * node_size);
+        }
+
+
+        Key* keys_of(page_type page) noexcept {
+            return reinterpret_cast<Key*>(pages_ + std::size_t(page) * node_size + keys_offset);
+        }
+
+
+        Key const* keys_of(page_type page) const noexcept {
+            return reinterpret_cast<Key const*>(pages_ + std::size_t(page) * node_size + keys_offset);
+        }
+
+
+        Value* values_of(page_type page) noexcept {
+            return reinterpret_cast<Value*>(pages_ + std::size_t(page) * node_size + values_offset);
+        }
+
+
+        Value const* values_of(page_type page) const noexcept {
+            return reinterpret_cast<Value const*>(pages_ + std::size_t(page) * node_size + values_offset);
+        }
+
+
+        page_type* children_of(page_type page) noexcept {
+            return reinterpret_cast<page_type*>(pages_ + std::size_t(page) * node_size + children_offset);
+        }
+
+
+        page_type const* children_of(page_type page) const noexcept {
+            return reinterpret_cast<page_type const*>(pages_ + std::size_t(page) * node_size + children_offset);
+        }
+
+
+        template<class I, class S> static I first_of(S* self) noexcept {
+            auto page = self->header_->root;
+            for(auto level = self->header_->height; level != 1; --level)
+                page = self->children_of(page)[0];
+            if(self->node_of(page)->count == 0)
+                return I{self, 0, 0};
+            return I{self, page, 0};
+        }
+
+
+        template<class I, bool Upper, class S> static I bound_of(S* self, Key const& key) noexcept {
+            auto page = self->header_->root;
+            for(auto level = self->header_->height; level != 1; --level) {
+                auto const* node = self->node_of(page);
+                page = self->children_of(page)[detail::key_position<true>(self->keys_of(page), node->count, key)];
+            }
+            auto const* node = self->node_of(page);
+            auto const position = detail::key_position<Upper>(self->keys_of(page), node->count, key);
+            if(position == node->count)
+                return I{self, node->next, 0};
+            return I{self, page, position};
+        }
+
+
+        template<class S> static auto find_of(S* self, Key const& key) noexcept -> decltype(self->values_of(0)) {
+            auto page = self->header_->root;
+            for(auto level = self->header_->height; level != 1; --level) {
+                auto const* node = self->node_of(page);
+                page = self->children_of(page)[detail::key_position<true>(self->keys_of(page), node->count, key)];
+            }
+            auto const* node = self->node_of(page);
+            auto const position = detail::key_position<false>(self->keys_of(page), node->count, key);
+            if(position == node->count || key < self->keys_of(page)[position])
+                return nullptr;
+            return self->values_of(page) + position;
+        }
+
+
+        // Leaf where the key belongs, with inner pages and child positions on the way
+        page_type descend(Key const& key, page_type* path, std::uint32_t* positions) noexcept {
+            auto page = header_->root;
+            for(auto level = std::uint32_t(0); level + 1 != header_->height; ++level) {
+                auto const position = detail::key_position<true>(keys_of(page), node_of(page)->count, key);
+                path[level] = page;
+                positions[level] = position;
+                page = children_of(page)[position];
+            }
+            return page;
+        }
+
+
+        template<typename T> static void insert_at(T* items, std::uint32_t count,
+                                                   std::uint32_t position, T const& item) noexcept {
+            std::memmove(items + position + 1, items + position, (count - position) * sizeof(T));
+            items[position] = item;
+        }
+
+
+        template<typename T> static void remove_at(T* items, std::uint32_t count, std::uint32_t position) noexcept {
+            std::memmove(items + position, items + position + 1, (count - position - 1) * sizeof(T));
+        }
+
+
+        bool put(Value const& value, bool assign) {
+            // Splits take at most a page per level and a new root, pages are
+            // reserved beforehand so the file isn't remapped while descending
+            if(!reserve(header_->height + 1))
+                return false;
+            auto const key = Adapter::key_of(value);
+            page_type path[max_height];
+            std::uint32_t positions[max_height];
+            auto const leaf = descend(key, path, positions);
+            auto* node = node_of(leaf);
+            auto const position = detail::key_position<false>(keys_of(leaf), node->count, key);
+            if(position != node->count && !(key < keys_of(leaf)[position])) {
+                if(!assign)
+                    return false;
+                values_of(leaf)[position] = value;
+                return true;
+            }
+            insert_at(keys_of(leaf), node->count, position, key);
+            insert_at(values_of(leaf), node->count, position, value);
+            ++node->count;
+            ++header_->size;
+            if(node->count <= leaf_capacity)
+                return true;
+
+            auto const sibling = allocate();
+            auto* right = node_of(sibling);
+            auto const half = node->count / 2;
+            *right = detail::node_header{1, node->count - half, leaf, node->next};
+            std::memcpy(keys_of(sibling), keys_of(leaf) + half, right->count * sizeof(Key));
+            std::memcpy(values_of(sibling), values_of(leaf) + half, right->count * sizeof(Value));
+            node->count = half;
+            if(node->next != 0)
+                node_of(node->next)->prev = sibling;
+            node->next = sibling;
+            auto separator = keys_of(sibling)[0];
+            auto split = sibling;
+
+            for(auto level = header_->height - 1; level-- != 0;) {
+                auto const parent = path[level];
+                auto* inner = node_of(parent);
+                auto const at = positions[level];
+                insert_at(keys_of(parent), inner->count, at, separator);
+                insert_at(children_of(parent), inner->count + 1, at + 1, split);
+                ++inner->count;
+                if(inner->count <= inner_capacity)
+                    return true;
+                auto const inner_sibling = allocate();
+                auto* upper = node_of(inner_sibling);
+                auto const middle = inner->count / 2;
+                separator = keys_of(parent)[middle];
+                *upper = detail::node_header{0, inner->count - middle - 1, 0, 0};
+                std::memcpy(keys_of(inner_sibling), keys_of(parent) + middle + 1, upper->count * sizeof(Key));
+                std::memcpy(children_of(inner_sibling), children_of(parent) + middle + 1,
+                            (upper->count + 1) * sizeof(page_type));
+                inner->count = middle;
+                split = inner_sibling;
+            }
+
+            auto const root = allocate();
+            *node_of(root) = detail::node_header{0, 1, 0, 0};
+            keys_of(root)[0] = separator;
+            children_of(root)[0] = header_->root;
+            children_of(root)[1] = split;
+            header_->root = root;
+            ++header_->height;
+            return true;
+        }
+
+
+        // Unlinks emptied leaf and removes emptied inner nodes on the path
+        void release_leaf(page_type leaf, page_type const* path, std::uint32_t const* positions) noexcept {
+            auto const* node = node_of(leaf);
+            if(node->prev != 0)
+                node_of(node->prev)->next = node->next;
+            if(node->next != 0)
+                node_of(node->next)->prev = node->prev;
+            release(leaf);
+            for(auto level = header_->height - 1; level-- != 0;) {
+                auto const parent = path[level];
+                auto* inner = node_of(parent);
+                auto const at = positions[level];
+                if(inner->count == 0) {
+                    if(level == 0) {
+                        // Root lost its only child, tree becomes a single empty leaf
+                        *inner = detail::node_header{1, 0, 0, 0};
+                        header_->height = 1;
+                        return;
+                    }
+                    release(parent);
+                    continue;
+                }
+                remove_at(children_of(parent), inner->count + 1, at);
+                remove_at(keys_of(parent), inner->count, at == 0 ? 0 : at - 1);
+                --inner->count;
+                break;
+            }
+            while(header_->height > 1 && node_of(header_->root)->count == 0) {
+                auto const single = children_of(header_->root)[0];
+                release(header_->root);
+                header_->root = single;
+                --header_->height;
+            }
+        }
+
+
+        page_type allocate() noexcept {
+            if(header_->free != 0) {
+                auto const page = header_->free;
+                header_->free = *children_of(page);
+                --header_->free_count;
+                return page;
+            }
+            return header_->pages++;
+        }
+
+
+        // Free pages are chained through their first child slot
+        void release(page_type page) noexcept {
+            *node_of(page) = detail::node_header{0, 0, 0, 0};
+            *children_of(page) = header_->free;
+            header_->free = page;
+            ++header_->free_count;
+        }
+
+
+        // Grows the file twice if less than 'count' pages are available
+        bool reserve(std::uint32_t count) {
+            if(header_->capacity - header_->pages + header_->free_count >= count)
+                return true;
+            auto const capacity = std::max<std::uint64_t>(std::uint64_t(header_->capacity) * 2,
+                                                          std::uint64_t(header_->pages) + count);
+            if(capacity > std::uint64_t(~page_type(0)))
+                return false;
+            // Failed resize keeps the old file mapped, the storage stays usable
+            auto const ec = mapped_file_.resize(path_, capacity * node_size);
+            header_ = !mapped_file_ ? nullptr : mapped_file_.cast<detail::ordered_header>(0);
+            pages_ = !mapped_file_ ? nullptr : mapped_file_.cast<char>(0);
+            if(!!ec)
+                return false;
+            header_->capacity = page_type(capacity);
+            return true;
+        }
+    }; // ordered_storage
+
+
+    template<typename K, typename V, class A> class ordered_storage<K, V, A>::expected {
+    private:
+        std::error_code error_code_;
+        ordered_storage storage_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(ordered_storage&& s)
+            : storage_(std::move(s)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!storage_;
+        }
+
+
+        ordered_storage& operator * () & noexcept {
+            return storage_;
+        }
+
+
+        ordered_storage&& operator * () && noexcept {
+            return std::move(storage_);
+        }
+
+
+        ordered_storage* operator -> () noexcept {
+            return &storage_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // ordered_storage::expected
+
+
+    template<typename K, typename V, class A> typename ordered_storage<K, V, A>::expected
+    ordered_storage<K, V, A>::create(std::filesystem::path const& path, size_type initial_capacity) {
+        auto const leaves = (initial_capacity + leaf_capacity - 1) / leaf_capacity;
+        auto const capacity = std::max<std::uint64_t>(4, 2 + 2 * leaves);
+        if(capacity > std::uint64_t(~page_type(0)))
+            return {make_error_code(ordered_storage_error::mismatch_file_size)};
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, capacity * node_size, ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->cast<detail::ordered_header>(0);
+        std::memcpy(header->signature, detail::ordered_signature, sizeof(header->signature));
+        header->item_size = sizeof(V);
+        header->key_size = sizeof(K);
+        header->node_size = std::uint32_t(node_size);
+        header->capacity = page_type(capacity);
+        auto target = ordered_storage{std::move(*expected_file), path};
+        target.clear();
+        return {std::move(target)};
+    }
+
+
+    template<typename K, typename V, class A> typename ordered_storage<K, V, A>::expected
+    ordered_storage<K, V, A>::open(std::filesystem::path const& path) {
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        if(expected_file->size() < 2 * node_size)
+            return {make_error_code(ordered_storage_error::mismatch_file_size)};
+        auto* header = expected_file->cast<detail::ordered_header>(0);
+        if(std::memcmp(header->signature, detail::ordered_signature, sizeof(header->signature)) != 0)
+            return {make_error_code(ordered_storage_error::invalid_file_signature)};
+        if(header->item_size != sizeof(V) || header->key_size != sizeof(K))
+            return {make_error_code(ordered_storage_error::mismatch_item_size)};
+        if(header->node_size != node_size)
+            return {make_error_code(ordered_storage_error::mismatch_node_size)};
+        if(expected_file->size() != std::size_t(header->capacity) * node_size
+           || header->pages > header->capacity)
+            return {make_error_code(ordered_storage_error::mismatch_file_size)};
+        expected_file->will_need(0, expected_file->size());
+        return {ordered_storage{std::move(*expected_file), path}};
+    }
+
+
+    template<typename K, typename V, class A> typename ordered_storage<K, V, A>::expected
+    ordered_storage<K, V, A>::open_or_create(std::filesystem::path const& path, size_type initial_capacity) {
+        auto ec = std::error_code{};
+        if(std::filesystem::exists(path, ec))
+            return open(path);
+        if(!!ec)
+            return {ec};
+        return create(path, initial_capacity);
+    }
+
+
+} // namespace persia
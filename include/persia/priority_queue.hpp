@@ -0,0 +1,377 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <persia/mapped_file.hpp>
+
+
+namespace persia {
+
+
+    enum class priority_queue_error {
+        ok,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        mismatch_arity
+    }; // priority_queue_error
+
+
+    class priority_queue_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "priority_queue";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(priority_queue_error(code)) {
+            case priority_queue_error::ok:
+                return "Ok";
+            case priority_queue_error::invalid_file_signature:
+                return "Invalid priority queue file signature";
+            case priority_queue_error::mismatch_file_size:
+                return "Mismatch file size";
+            case priority_queue_error::mismatch_item_size:
+                return "Mismatch item size";
+            case priority_queue_error::mismatch_arity:
+                return "Mismatch heap arity";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline priority_queue_error_category const priority_queue_error_category;
+
+
+    inline std::error_code make_error_code(priority_queue_error e) noexcept {
+        return {int(e), priority_queue_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::priority_queue_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    namespace detail {
+
+        struct alignas(64) heap_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t arity{0};
+            std::uint32_t reserved{0};
+            std::uint64_t capacity{0};
+            std::uint64_t size{0};
+        }; // heap_header
+
+
+        inline constexpr unsigned char heap_signature[4] = {0x4E, 0xA9, 0x0D, 0x17};
+
+    } // namespace detail
+
+
+    // Implicit d-ary min-heap of items ordered by Adapter::priority_of in a
+    // mapped file, so pending items survive restarts without rebuilding.
+    // Push and pop take O(log n) with a base of Arity; wider nodes make the
+    // heap shallower and their children share cache lines. File grows by
+    // doubling, which remaps it and invalidates pointers to items; push and
+    // pop aren't atomic against crashes.
+    template<typename T, class Adapter = T, std::size_t Arity = 4> class priority_queue {
+    public:
+
+        using value_type = T;
+        using size_type = std::uint64_t;
+
+        static constexpr std::size_t arity = Arity;
+
+        static_assert(std::is_trivially_copyable_v<T>, "T should be trivially copyable");
+        static_assert(Arity >= 2, "Arity should be at least 2");
+
+        class expected;
+
+        static expected create(std::filesystem::path const& path, size_type initial_capacity);
+        static expected open(std::filesystem::path const& path);
+        static expected open_or_create(std::filesystem::path const& path, size_type initial_capacity);
+
+    private:
+
+        static constexpr std::size_t cache_line_size = 64;
+
+        // Children of item i start at Arity * i + 1, so items are shifted by
+        // one slot back from a cache line boundary to align sibling groups
+        static constexpr std::size_t items_offset = sizeof(detail::heap_header)
+            + (sizeof(T) < cache_line_size && cache_line_size % sizeof(T) == 0
+               ? cache_line_size - sizeof(T) : 0);
+
+        static_assert(alignof(T) <= cache_line_size, "T alignment is too large");
+
+        mapped_file mapped_file_;
+        detail::heap_header* header_{nullptr};
+        T* items_{nullptr};
+        std::filesystem::path path_;
+
+        priority_queue(mapped_file&& mapped_file, std::filesystem::path const& path) noexcept
+            : mapped_file_{std::move(mapped_file)}
+            , header_{mapped_file_.cast<detail::heap_header>(0)}
+            , items_{mapped_file_.cast<T>(items_offset)}
+            , path_{path} {
+        }
+
+
+        static bool before(T const& lhs, T const& rhs) noexcept {
+            return Adapter::priority_of(lhs) < Adapter::priority_of(rhs);
+        }
+
+    public:
+
+        priority_queue() noexcept = default;
+        priority_queue(priority_queue const&) = delete;
+        priority_queue& operator = (priority_queue const&) = delete;
+        priority_queue(priority_queue&&) noexcept = default;
+        priority_queue& operator = (priority_queue&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !!mapped_file_;
+        }
+
+
+        size_type capacity() const noexcept {
+            return header_->capacity;
+        }
+
+
+        size_type size() const noexcept {
+            return header_->size;
+        }
+
+
+        bool empty() const noexcept {
+            return header_->size == 0;
+        }
+
+
+        // Item of the lowest priority, nullptr if empty
+        T const* top() const noexcept {
+            return header_->size == 0 ? nullptr : items_;
+        }
+
+
+        // False if the file can't grow
+        bool push(T const& item) {
+            if(header_->size == header_->capacity && !grow())
+                return false;
+            sift_up(header_->size, item);
+            ++header_->size;
+            return true;
+        }
+
+
+        // False if empty
+        bool pop(T& item) noexcept {
+            if(header_->size == 0)
+                return false;
+            item = items_[0];
+            auto const last = --header_->size;
+            if(last != 0)
+                sift_down(0, items_[last]);
+            return true;
+        }
+
+
+        // Pops items with priority not greater than 'limit' in order of
+        // priority, passing them to fn(T const&), e.g. timers due by now
+        template<typename P, typename F> size_type pop_until(P const& limit, F&& fn) {
+            auto count = size_type(0);
+            T item;
+            while(header_->size != 0 && !(limit < Adapter::priority_of(items_[0]))) {
+                pop(item);
+                fn(static_cast<T const&>(item));
+                ++count;
+            }
+            return count;
+        }
+
+
+        void clear() noexcept {
+            header_->size = 0;
+        }
+
+
+        std::error_code flush() const noexcept {
+            return mapped_file_.flush(0, items_offset + std::size_t(header_->size) * sizeof(T));
+        }
+
+    private:
+
+        // Moves the hole at 'index' up until 'item' fits it
+        void sift_up(size_type index, T const& item) noexcept {
+            while(index != 0) {
+                auto const parent = (index - 1) / Arity;
+                if(!before(item, items_[parent]))
+                    break;
+                items_[index] = items_[parent];
+                index = parent;
+            }
+            items_[index] = item;
+        }
+
+
+        // Moves the hole at 'index' down until 'item' fits it
+        void sift_down(size_type index, T const& last) noexcept {
+            auto const item = last;
+            auto const size = header_->size;
+            for(;;) {
+                auto const first = index * Arity + 1;
+                if(first >= size)
+                    break;
+                auto const end = std::min<size_type>(first + Arity, size);
+                auto least = first;
+                for(auto child = first + 1; child < end; ++child)
+                    if(before(items_[child], items_[least]))
+                        least = child;
+                if(!before(items_[least], item))
+                    break;
+                items_[index] = items_[least];
+                index = least;
+            }
+            items_[index] = item;
+        }
+
+
+        bool grow() {
+            auto const capacity = header_->capacity * 2;
+            // Failed resize keeps the old file mapped, the queue stays usable
+            auto const ec = mapped_file_.resize(path_, items_offset + capacity * sizeof(T));
+            header_ = !mapped_file_ ? nullptr : mapped_file_.cast<detail::heap_header>(0);
+            items_ = !mapped_file_ ? nullptr : mapped_file_.cast<T>(items_offset);
+            if(!!ec)
+                return false;
+            header_->capacity = capacity;
+            return true;
+        }
+    }; // priority_queue
+
+
+    template<typename T, class A, std::size_t N> class priority_queue<T, A, N>::expected {
+    private:
+        std::error_code error_code_;
+        priority_queue queue_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(priority_queue&& q)
+            : queue_(std::move(q)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!queue_;
+        }
+
+
+        priority_queue& operator * () & noexcept {
+            return queue_;
+        }
+
+
+        priority_queue&& operator * () && noexcept {
+            return std::move(queue_);
+        }
+
+
+        priority_queue* operator -> () noexcept {
+            return &queue_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // priority_queue::expected
+
+
+    template<typename T, class A, std::size_t N> typename priority_queue<T, A, N>::expected
+    priority_queue<T, A, N>::create(std::filesystem::path const& path, size_type initial_capacity) {
+        auto const capacity = std::max<size_type>(initial_capacity, 1);
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, items_offset + capacity * sizeof(T), ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->cast<detail::heap_header>(0);
+        std::memcpy(header->signature, detail::heap_signature, sizeof(header->signature));
+        header->item_size = sizeof(T);
+        header->arity = std::uint32_t(N);
+        header->capacity = capacity;
+        header->size = 0;
+        return {priority_queue{std::move(*expected_file), path}};
+    }
+
+
+    template<typename T, class A, std::size_t N> typename priority_queue<T, A, N>::expected
+    priority_queue<T, A, N>::open(std::filesystem::path const& path) {
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        if(expected_file->size() < items_offset)
+            return {make_error_code(priority_queue_error::mismatch_file_size)};
+        auto* header = expected_file->cast<detail::heap_header>(0);
+        if(std::memcmp(header->signature, detail::heap_signature, sizeof(header->signature)) != 0)
+            return {make_error_code(priority_queue_error::invalid_file_signature)};
+        if(header->item_size != sizeof(T))
+            return {make_error_code(priority_queue_error::mismatch_item_size)};
+        if(header->arity != N)
+            return {make_error_code(priority_queue_error::mismatch_arity)};
+        if(header->capacity == 0 || header->size > header->capacity
+           || expected_file->size() != items_offset + header->capacity * sizeof(T))
+            return {make_error_code(priority_queue_error::mismatch_file_size)};
+        return {priority_queue{std::move(*expected_file), path}};
+    }
+
+
+    template<typename T, class A, std::size_t N> typename priority_queue<T, A, N>::expected
+    priority_queue<T, A, N>::open_or_create(std::filesystem::path const& path, size_type initial_capacity) {
+        auto ec = std::error_code{};
+        if(std::filesystem::exists(path, ec))
+            return open(path);
+        if(!!ec)
+            return {ec};
+        return create(path, initial_capacity);
+    }
+
+
+} // namespace persia
@@ -0,0 +1,377 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <persia/atomic.hpp>
+#include <persia/mapped_file.hpp>
+
+
+namespace persia {
+
+
+    enum class queue_error {
+        ok,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        mismatch_producer_mode
+    }; // queue_error
+
+
+    class queue_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "queue";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(queue_error(code)) {
+            case queue_error::ok:
+                return "Ok";
+            case queue_error::invalid_file_signature:
+                return "Invalid queue file signature";
+            case queue_error::mismatch_file_size:
+                return "Mismatch file size";
+            case queue_error::mismatch_item_size:
+                return "Mismatch item size";
+            case queue_error::mismatch_producer_mode:
+                return "Mismatch producer mode";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline queue_error_category const queue_error_category;
+
+
+    inline std::error_code make_error_code(queue_error e) noexcept {
+        return {int(e), queue_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::queue_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    // Producer mode of queue, both have a single consumer
+    struct single_producer {
+        static constexpr bool multiple = false;
+    }; // single_producer
+
+
+    struct multi_producer {
+        static constexpr bool multiple = true;
+    }; // multi_producer
+
+
+    namespace detail {
+
+        inline constexpr std::size_t cache_line = 64;
+
+
+        struct alignas(cache_line) queue_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t capacity{0};
+            std::uint32_t flags{0};
+        }; // queue_header
+
+
+        // Counters are kept on separate cache lines, so producer and
+        // consumer don't invalidate each other's lines
+        struct alignas(cache_line) queue_counter {
+            std::uint64_t value{0};
+        }; // queue_counter
+
+
+        inline constexpr unsigned char queue_signature[4] = {0x9E, 0x0E, 0x51, 0x7C};
+
+
+        template<typename T, bool Multiple> struct queue_slot {
+            T item;
+        }; // queue_slot
+
+
+        // Sequence tells whether the slot is ready to be written at position
+        // (sequence == position) or read (sequence == position + 1)
+        template<typename T> struct queue_slot<T, true> {
+            std::uint64_t sequence;
+            T item;
+        }; // queue_slot
+
+    } // namespace detail
+
+
+    // Fixed capacity ring in a shared file mapping. Processes open their own
+    // queue objects on the same file, positions are kept in the file and
+    // survive restarts. Items are popped by a single consumer and pushed by
+    // a single producer or, with multi_producer, by any number of them.
+    // Multi producer queue stalls if a producer dies between claiming a
+    // slot and publishing it.
+    template<typename T, class Producer = single_producer> class queue {
+    public:
+
+        using value_type = T;
+        using size_type = std::uint32_t;
+
+        static_assert(std::is_trivially_copyable_v<T>, "T should be trivially copyable");
+
+        class expected;
+
+        static expected create(std::filesystem::path const& path, size_type capacity);
+        static expected open(std::filesystem::path const& path);
+        static expected open_or_create(std::filesystem::path const& path, size_type capacity);
+
+    private:
+
+        static constexpr bool multiple = Producer::multiple;
+
+        using slot_type = detail::queue_slot<T, multiple>;
+
+        static constexpr std::size_t slots_offset = sizeof(detail::queue_header) + 2 * sizeof(detail::queue_counter);
+
+        mapped_file mapped_file_;
+        detail::queue_header* header_{nullptr};
+        std::uint64_t* tail_{nullptr};
+        std::uint64_t* head_{nullptr};
+        slot_type* slots_{nullptr};
+        std::uint64_t mask_{0};
+        // Last seen positions of the other side, single producer only
+        std::uint64_t cached_head_{0};
+        std::uint64_t cached_tail_{0};
+
+        queue(mapped_file&& mapped_file) noexcept
+            : mapped_file_{std::move(mapped_file)}
+            , header_{mapped_file_.cast<detail::queue_header>(0)}
+            , tail_{&mapped_file_.cast<detail::queue_counter>(sizeof(detail::queue_header))->value}
+            , head_{&mapped_file_.cast<detail::queue_counter>(sizeof(detail::queue_header)
+                                                              + sizeof(detail::queue_counter))->value}
+            , slots_{mapped_file_.cast<slot_type>(slots_offset)}
+            , mask_{header_->capacity - 1u} {
+        }
+
+    public:
+
+        queue() noexcept = default;
+        queue(queue const&) = delete;
+        queue& operator = (queue const&) = delete;
+        queue(queue&&) noexcept = default;
+        queue& operator = (queue&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !!mapped_file_;
+        }
+
+
+        size_type capacity() const noexcept {
+            return header_->capacity;
+        }
+
+
+        // Exact only when neither side is running
+        size_type size() const noexcept {
+            return size_type(detail::load_acquire(tail_) - detail::load_acquire(head_));
+        }
+
+
+        bool empty() const noexcept {
+            return size() == 0;
+        }
+
+
+        // False if the queue is full
+        bool try_push(T const& item) noexcept {
+            if constexpr(multiple) {
+                auto position = detail::load_acquire(tail_);
+                slot_type* slot;
+                for(;;) {
+                    slot = slots_ + (position & mask_);
+                    auto const sequence = detail::load_acquire(&slot->sequence);
+                    if(sequence == position) {
+                        if(detail::compare_exchange(tail_, position, position + 1))
+                            break;
+                    } else if(sequence < position) {
+                        return false;
+                    } else {
+                        position = detail::load_acquire(tail_);
+                    }
+                }
+                slot->item = item;
+                detail::store_release(&slot->sequence, position + 1);
+            } else {
+                auto const position = *tail_;
+                if(position - cached_head_ == capacity()) {
+                    cached_head_ = detail::load_acquire(head_);
+                    if(position - cached_head_ == capacity())
+                        return false;
+                }
+                slots_[position & mask_].item = item;
+                detail::store_release(tail_, position + 1);
+            }
+            return true;
+        }
+
+
+        // False if the queue is empty
+        bool try_pop(T& item) noexcept {
+            auto const position = *head_;
+            auto* slot = slots_ + (position & mask_);
+            if constexpr(multiple) {
+                if(detail::load_acquire(&slot->sequence) != position + 1)
+                    return false;
+                item = slot->item;
+                detail::store_release(&slot->sequence, position + capacity());
+            } else {
+                if(position == cached_tail_) {
+                    cached_tail_ = detail::load_acquire(tail_);
+                    if(position == cached_tail_)
+                        return false;
+                }
+                item = slot->item;
+            }
+            detail::store_release(head_, position + 1);
+            return true;
+        }
+
+
+        // Syncs items and positions to disk
+        std::error_code flush() const noexcept {
+            return mapped_file_.flush();
+        }
+    }; // queue
+
+
+    template<typename T, class P> class queue<T, P>::expected {
+    private:
+        std::error_code error_code_;
+        queue queue_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(queue&& q)
+            : queue_(std::move(q)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!queue_;
+        }
+
+
+        queue& operator * () & noexcept {
+            return queue_;
+        }
+
+
+        queue&& operator * () && noexcept {
+            return std::move(queue_);
+        }
+
+
+        queue* operator -> () noexcept {
+            return &queue_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // queue::expected
+
+
+    // Capacity is rounded up to a power of two
+    template<typename T, class P> typename queue<T, P>::expected
+    queue<T, P>::create(std::filesystem::path const& path, size_type capacity) {
+        if(capacity == 0 || capacity > (size_type(1) << 31))
+            return {make_error_code(queue_error::mismatch_file_size)};
+        auto rounded = size_type(1);
+        while(rounded < capacity)
+            rounded *= 2;
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, slots_offset + std::size_t(rounded) * sizeof(slot_type), ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->cast<detail::queue_header>(0);
+        std::memcpy(header->signature, detail::queue_signature, sizeof(header->signature));
+        header->item_size = sizeof(T);
+        header->capacity = rounded;
+        header->flags = multiple ? 1 : 0;
+        auto* slots = expected_file->cast<slot_type>(slots_offset);
+        if constexpr(multiple)
+            for(auto i = size_type(0); i != rounded; ++i)
+                slots[i].sequence = i;
+        return {queue{std::move(*expected_file)}};
+    }
+
+
+    template<typename T, class P> typename queue<T, P>::expected
+    queue<T, P>::open(std::filesystem::path const& path) {
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        if(expected_file->size() < slots_offset)
+            return {make_error_code(queue_error::mismatch_file_size)};
+        auto* header = expected_file->cast<detail::queue_header>(0);
+        if(std::memcmp(header->signature, detail::queue_signature, sizeof(header->signature)) != 0)
+            return {make_error_code(queue_error::invalid_file_signature)};
+        if(header->item_size != sizeof(T))
+            return {make_error_code(queue_error::mismatch_item_size)};
+        if(header->flags != (multiple ? 1u : 0u))
+            return {make_error_code(queue_error::mismatch_producer_mode)};
+        if(header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0
+           || expected_file->size() != slots_offset + std::size_t(header->capacity) * sizeof(slot_type))
+            return {make_error_code(queue_error::mismatch_file_size)};
+        auto target = queue{std::move(*expected_file)};
+        target.cached_head_ = detail::load_acquire(target.head_);
+        target.cached_tail_ = detail::load_acquire(target.tail_);
+        return {std::move(target)};
+    }
+
+
+    template<typename T, class P> typename queue<T, P>::expected
+    queue<T, P>::open_or_create(std::filesystem::path const& path, size_type capacity) {
+        auto ec = std::error_code{};
+        if(std::filesystem::exists(path, ec))
+            return open(path);
+        if(!!ec)
+            return {ec};
+        return create(path, capacity);
+    }
+
+
+} // namespace persia
@@ -0,0 +1,74 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cstddef>
+#include <type_traits>
+
+
+namespace persia {
+
+
+    // Non-owning view of contiguous items, subset of C++20 std::span
+    template<typename T> class span {
+    public:
+
+        using element_type = T;
+        using value_type = std::remove_cv_t<T>;
+        using size_type = std::size_t;
+        using iterator = T*;
+
+    private:
+
+        T* data_{nullptr};
+        size_type size_{0};
+
+    public:
+
+        constexpr span() noexcept = default;
+
+
+        constexpr span(T* data, size_type size) noexcept
+            : data_{data}, size_{size} {
+        }
+
+
+        template<std::size_t N> constexpr span(T (&items)[N]) noexcept
+            : data_{items}, size_{N} {
+        }
+
+
+        template<typename U, typename = std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>>
+        constexpr span(span<U> const& other) noexcept
+            : data_{other.data()}, size_{other.size()} {
+        }
+
+
+        constexpr T* data() const noexcept { return data_; }
+        constexpr size_type size() const noexcept { return size_; }
+        constexpr size_type size_bytes() const noexcept { return size_ * sizeof(T); }
+        constexpr bool empty() const noexcept { return size_ == 0; }
+
+        constexpr iterator begin() const noexcept { return data_; }
+        constexpr iterator end() const noexcept { return data_ + size_; }
+
+        constexpr T& operator [] (size_type index) const noexcept { return data_[index]; }
+        constexpr T& front() const noexcept { return data_[0]; }
+        constexpr T& back() const noexcept { return data_[size_ - 1]; }
+
+
+        constexpr span subspan(size_type offset, size_type count) const noexcept {
+            return span{data_ + offset, count};
+        }
+
+
+        constexpr span first(size_type count) const noexcept {
+            return span{data_, count};
+        }
+    }; // span
+
+
+} // namespace persia
@@ -0,0 +1,430 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <persia/mapped_file.hpp>
+
+
+namespace persia {
+
+
+    enum class split_storage_error {
+        ok,
+        file_size_is_too_small,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        file_is_corrupted
+    }; // split_storage_error
+
+
+    class split_storage_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "split_storage";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(split_storage_error(code)) {
+            case split_storage_error::ok:
+                return "Ok";
+            case split_storage_error::file_size_is_too_small:
+                return "Split storage file is too small";
+            case split_storage_error::invalid_file_signature:
+                return "Invalid split storage file signature";
+            case split_storage_error::mismatch_file_size:
+                return "Mismatch file size";
+            case split_storage_error::mismatch_item_size:
+                return "Mismatch item size";
+            case split_storage_error::file_is_corrupted:
+                return "File is corrupted";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline split_storage_error_category const split_storage_error_category;
+
+
+    inline std::error_code make_error_code(split_storage_error e) noexcept {
+        return {int(e), split_storage_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::split_storage_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    namespace detail {
+
+        struct alignas(64) split_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t hot_size{0};
+            std::uint32_t capacity{0};
+        }; // split_header
+
+
+        inline constexpr unsigned char split_signature[4] = {0x5B, 0x11, 0x7C, 0x01};
+        inline constexpr std::uint32_t split_occupied = 0x5B117C01;
+        inline constexpr std::size_t split_page_size = 4096;
+
+
+        template<typename K, typename H> struct split_record {
+            std::uint32_t marker;
+            K key;
+            H data;
+        }; // split_record
+
+    } // namespace detail
+
+
+    // Storage keeping a hot projection of each item, declared by
+    // Adapter::hot_of, together with its key in a dense array at the start
+    // of the file, while whole items live in a separate cold region after
+    // it. Lookups by find_hot and open touch only the hot array, so pages of
+    // cold items stay out of memory until items are read by find. Hot
+    // record is unmarked while an item is written, so a torn write is
+    // dropped on open. Capacity is fixed.
+    template<typename Key, typename Value, class Adapter = Value> class split_storage {
+    public:
+
+        using key_type = Key;
+        using value_type = Value;
+        using hot_type = std::decay_t<decltype(Adapter::hot_of(std::declval<Value const&>()))>;
+        using size_type = std::uint32_t;
+
+        static_assert(std::is_trivially_copyable_v<Key>, "Key should be trivially copyable");
+        static_assert(std::is_trivially_copyable_v<Value>, "Value should be trivially copyable");
+        static_assert(std::is_trivially_copyable_v<hot_type>, "Hot projection should be trivially copyable");
+
+        class expected;
+
+        static expected create(std::filesystem::path const& path, size_type capacity);
+        static expected open(std::filesystem::path const& path);
+        static expected open_or_create(std::filesystem::path const& path, size_type capacity);
+
+    private:
+
+        using record_type = detail::split_record<Key, hot_type>;
+
+        std::unordered_map<Key, size_type> indices_;
+        std::vector<size_type> free_indices_;
+        mapped_file mapped_file_;
+        detail::split_header* header_{nullptr};
+        record_type* records_{nullptr};
+        Value* values_{nullptr};
+
+        split_storage(mapped_file&& mapped_file) noexcept
+            : mapped_file_{std::move(mapped_file)}
+            , header_{mapped_file_.cast<detail::split_header>(0)}
+            , records_{mapped_file_.cast<record_type>(sizeof(detail::split_header))}
+            , values_{mapped_file_.cast<Value>(cold_offset(header_->capacity))} {
+        }
+
+
+        static std::size_t hot_size(size_type capacity) noexcept {
+            return sizeof(detail::split_header) + std::size_t(capacity) * sizeof(record_type);
+        }
+
+
+        // Cold region starts on its own page, so hot pages hold no cold bytes
+        static std::size_t cold_offset(size_type capacity) noexcept {
+            return (hot_size(capacity) + detail::split_page_size - 1)
+                   / detail::split_page_size * detail::split_page_size;
+        }
+
+
+        static std::size_t file_size(size_type capacity) noexcept {
+            return cold_offset(capacity) + std::size_t(capacity) * sizeof(Value);
+        }
+
+    public:
+
+        split_storage() noexcept = default;
+        split_storage(split_storage const&) = delete;
+        split_storage& operator = (split_storage const&) = delete;
+        split_storage(split_storage&&) noexcept = default;
+        split_storage& operator = (split_storage&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !!mapped_file_;
+        }
+
+
+        size_type capacity() const noexcept {
+            return header_->capacity;
+        }
+
+
+        size_type size() const noexcept {
+            return size_type(indices_.size());
+        }
+
+
+        bool empty() const noexcept {
+            return indices_.empty();
+        }
+
+
+        bool fully_occupied() const noexcept {
+            return free_indices_.empty();
+        }
+
+
+        // Touches the hot array only
+        hot_type const* find_hot(Key const& key) const noexcept {
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return nullptr;
+            return &records_[found->second].data;
+        }
+
+
+        // Faults in the cold item
+        Value const* find(Key const& key) const noexcept {
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return nullptr;
+            return values_ + found->second;
+        }
+
+
+        bool contains(Key const& key) const noexcept {
+            return indices_.find(key) != indices_.end();
+        }
+
+
+        // False if the key is present or storage is full
+        bool insert(Value const& value) {
+            auto const key = Adapter::key_of(value);
+            if(free_indices_.empty() || indices_.find(key) != indices_.end())
+                return false;
+            auto const index = free_indices_.back();
+            free_indices_.pop_back();
+            write(index, key, value);
+            indices_.emplace(key, index);
+            return true;
+        }
+
+
+        // False if storage is full
+        bool insert_or_assign(Value const& value) {
+            auto const key = Adapter::key_of(value);
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return insert(value);
+            write(found->second, key, value);
+            return true;
+        }
+
+
+        // Calls fn(Value&) on a copy of the item and writes it back with
+        // its hot projection, fn shouldn't change the key
+        template<typename F> bool update(Key const& key, F&& fn) {
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return false;
+            auto value = values_[found->second];
+            fn(value);
+            write(found->second, key, value);
+            return true;
+        }
+
+
+        bool erase(Key const& key) noexcept {
+            auto const found = indices_.find(key);
+            if(found == indices_.end())
+                return false;
+            records_[found->second].marker = 0;
+            free_indices_.push_back(found->second);
+            indices_.erase(found);
+            return true;
+        }
+
+
+        // Calls fn(Key const&, hot_type const&) for each item
+        template<typename F> void for_each_hot(F&& fn) const {
+            for(auto const& each: indices_) {
+                auto const& record = records_[each.second];
+                fn(static_cast<Key const&>(record.key), static_cast<hot_type const&>(record.data));
+            }
+        }
+
+
+        void clear() noexcept {
+            for(auto i = size_type(0); i != header_->capacity; ++i)
+                records_[i].marker = 0;
+            indices_.clear();
+            free_indices_.clear();
+            for(auto i = header_->capacity; i-- != 0;)
+                free_indices_.push_back(i);
+        }
+
+
+        std::error_code flush() const noexcept {
+            return mapped_file_.flush();
+        }
+
+    private:
+
+        void write(size_type index, Key const& key, Value const& value) noexcept {
+            auto* record = records_ + index;
+            record->marker = 0;
+            values_[index] = value;
+            record->key = key;
+            record->data = Adapter::hot_of(value);
+            record->marker = detail::split_occupied;
+        }
+
+
+        std::error_code load() {
+            auto const capacity = header_->capacity;
+            indices_.reserve(capacity);
+            free_indices_.reserve(capacity);
+            for(auto i = capacity; i-- != 0;) {
+                auto const& record = records_[i];
+                if(record.marker == 0) {
+                    free_indices_.push_back(i);
+                    continue;
+                }
+                if(record.marker != detail::split_occupied)
+                    return make_error_code(split_storage_error::file_is_corrupted);
+                if(!indices_.emplace(record.key, i).second)
+                    return make_error_code(split_storage_error::file_is_corrupted);
+            }
+            return {};
+        }
+    }; // split_storage
+
+
+    template<typename K, typename V, class A> class split_storage<K, V, A>::expected {
+    private:
+        std::error_code error_code_;
+        split_storage storage_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(split_storage&& s)
+            : storage_(std::move(s)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!storage_;
+        }
+
+
+        split_storage& operator * () & noexcept {
+            return storage_;
+        }
+
+
+        split_storage&& operator * () && noexcept {
+            return std::move(storage_);
+        }
+
+
+        split_storage* operator -> () noexcept {
+            return &storage_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // split_storage::expected
+
+
+    template<typename K, typename V, class A> typename split_storage<K, V, A>::expected
+    split_storage<K, V, A>::create(std::filesystem::path const& path, size_type capacity) {
+        if(capacity == 0)
+            return {make_error_code(split_storage_error::file_size_is_too_small)};
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        auto ec = std::error_code{};
+        std::filesystem::resize_file(path, file_size(capacity), ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->template cast<detail::split_header>(0);
+        std::memcpy(header->signature, detail::split_signature, sizeof(header->signature));
+        header->item_size = sizeof(V);
+        header->hot_size = sizeof(record_type);
+        header->capacity = capacity;
+        auto target = split_storage{std::move(*expected_file)};
+        target.clear();
+        return {std::move(target)};
+    }
+
+
+    template<typename K, typename V, class A> typename split_storage<K, V, A>::expected
+    split_storage<K, V, A>::open(std::filesystem::path const& path) {
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        if(expected_file->size() < sizeof(detail::split_header))
+            return {make_error_code(split_storage_error::file_size_is_too_small)};
+        auto* header = expected_file->template cast<detail::split_header>(0);
+        if(std::memcmp(header->signature, detail::split_signature, sizeof(header->signature)) != 0)
+            return {make_error_code(split_storage_error::invalid_file_signature)};
+        if(header->item_size != sizeof(V) || header->hot_size != sizeof(record_type))
+            return {make_error_code(split_storage_error::mismatch_item_size)};
+        if(header->capacity == 0 || expected_file->size() != file_size(header->capacity))
+            return {make_error_code(split_storage_error::mismatch_file_size)};
+        // Only the hot array is read ahead
+        expected_file->will_need(0, hot_size(header->capacity));
+        auto target = split_storage{std::move(*expected_file)};
+        auto const ec = target.load();
+        if(!!ec)
+            return {ec};
+        return {std::move(target)};
+    }
+
+
+    template<typename K, typename V, class A> typename split_storage<K, V, A>::expected
+    split_storage<K, V, A>::open_or_create(std::filesystem::path const& path, size_type capacity) {
+        auto ec = std::error_code{};
+        if(std::filesystem::exists(path, ec))
+            return open(path);
+        if(!!ec)
+            return {ec};
+        return create(path, capacity);
+    }
+
+
+} // namespace persia
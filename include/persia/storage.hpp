@@ -5,14 +5,32 @@
 #pragma once
 
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <system_error>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include <persia/atomic.hpp>
+#include <persia/bloom_filter.hpp>
+#include <persia/bplus_tree.hpp>
+#include <persia/change_log.hpp>
+#include <persia/hashed_indices.hpp>
 #include <persia/mapped_file.hpp>
 
 
@@ -25,7 +43,10 @@ namespace persia {
         invalid_file_signature,
         mismatch_file_size,
         mismatch_item_size,
-        file_is_corrupted
+        file_is_corrupted,
+        mismatch_format,
+        transaction_rejected,
+        duplicate_secondary_key
     }; // storage_error
 
 
@@ -49,6 +70,12 @@ namespace persia {
                 return "Mismatch item size";
             case storage_error::file_is_corrupted:
                 return "File is corrupted";
+            case storage_error::mismatch_format:
+                return "Mismatch record format";
+            case storage_error::transaction_rejected:
+                return "Transaction is rejected";
+            case storage_error::duplicate_secondary_key:
+                return "Duplicate unique secondary key";
             default:
                 return "Unknown";
             }
@@ -76,42 +103,332 @@ namespace std {
 namespace persia {
     
     
+    using storage_index = std::uint32_t;
+    
+    
+    // Secondary index by Extractor result, each key maps to a single item
+    template<auto Extractor> struct unique_index {
+        static constexpr bool unique = true;
+    }; // unique_index
+    
+    
+    // Secondary index by Extractor result, each key maps to any number of items
+    template<auto Extractor> struct multi_index {
+        static constexpr bool unique = false;
+    }; // multi_index
+    
+    
+    // Declared by adapter as 'using secondary_indices = persia::secondary_indices<...>'
+    template<class... Indices> struct secondary_indices { }; // secondary_indices
+    
+    
     namespace detail {
         
         struct alignas(8) header {
             unsigned char signature[4];
             std::uint32_t item_size{0};
             std::uint32_t capacity{0};
-            std::uint32_t size{0};
+            // Record format bits, takes the place of unused size field, so
+            // files of plain records keep the original layout with zero here
+            std::uint32_t flags{0};
         }; // header
         
         
+        // Record format bits of header::flags
+        inline constexpr std::uint32_t hashed_records = 0x1;
+        inline constexpr std::uint32_t versioned_records = 0x2;
+        
+        
         enum class marker: std::uint32_t {
             empty = 0, occupied = 0xFEEDDA1A
         };
         
-        template<typename T > struct alignas(8) record {
+        // Version stamp of records not created or not retired yet
+        inline constexpr std::uint64_t unstamped = ~std::uint64_t(0);
+        
+        template<typename T, bool Hashed = false, bool Versioned = false>
+        struct alignas(8) record {
+            enum marker marker{persia::detail::marker::empty};
+            T data;
+        }; // record
+        
+        
+        // Hash of the key fills the gap after marker
+        template<typename T> struct alignas(8) record<T, true, false> {
+            enum marker marker{persia::detail::marker::empty};
+            std::uint32_t hash{0};
+            T data;
+        }; // record
+        
+        
+        // Record is visible to snapshot of version v if created <= v < retired,
+        // hash is left zero unless Hashed
+        template<typename T, bool Hashed> struct alignas(8) record<T, Hashed, true> {
             enum marker marker{persia::detail::marker::empty};
+            std::uint32_t hash{0};
+            std::uint64_t created{unstamped};
+            std::uint64_t retired{unstamped};
             T data;
         }; // record
         
+        
+        struct no_order {
+            friend bool operator < (no_order, no_order) noexcept { return false; }
+        }; // no_order
+        
+        
+        // Secondary ordering is enabled by declaring Adapter::order_of
+        template<class A, typename V, typename = void> struct order_traits {
+            static constexpr bool enabled = false;
+            using type = no_order;
+        }; // order_traits
+        
+        
+        template<class A, typename V>
+        struct order_traits<A, V, std::void_t<decltype(A::order_of(std::declval<V const&>()))>> {
+            static constexpr bool enabled = true;
+            using type = std::decay_t<decltype(A::order_of(std::declval<V const&>()))>;
+        }; // order_traits
+        
+        
+        // Bloom filter is enabled by declaring Adapter::bloom_filter_bits (bits per item)
+        template<class A, typename = void> struct filter_traits {
+            static constexpr bool enabled = false;
+            static constexpr unsigned bits_per_item = 0;
+        }; // filter_traits
+        
+        
+        template<class A> struct filter_traits<A, std::void_t<decltype(A::bloom_filter_bits)>> {
+            static constexpr bool enabled = true;
+            static constexpr unsigned bits_per_item = A::bloom_filter_bits;
+        }; // filter_traits
+        
+        
+        // Multiple versions of records are kept by declaring Adapter::multiversion
+        template<class A, typename = void> struct version_traits {
+            static constexpr bool enabled = false;
+        }; // version_traits
+        
+        
+        template<class A> struct version_traits<A, std::void_t<decltype(A::multiversion)>> {
+            static constexpr bool enabled = A::multiversion;
+        }; // version_traits
+        
+        
+        // Versions of active snapshots; records retired before the oldest
+        // of them are not visible to anybody
+        class version_registry {
+        private:
+            std::mutex mutex_;
+            std::multiset<std::uint64_t> active_;
+            std::atomic<std::uint64_t> current_{0};
+            
+        public:
+            
+            std::uint64_t current() const noexcept {
+                return current_.load(std::memory_order_acquire);
+            }
+            
+            
+            void publish(std::uint64_t version) noexcept {
+                current_.store(version, std::memory_order_release);
+            }
+            
+            
+            std::uint64_t enter() {
+                auto const lock = std::lock_guard<std::mutex>{mutex_};
+                auto const version = current();
+                active_.insert(version);
+                return version;
+            }
+            
+            
+            void leave(std::uint64_t version) noexcept {
+                auto const lock = std::lock_guard<std::mutex>{mutex_};
+                active_.erase(active_.find(version));
+            }
+            
+            
+            std::uint64_t oldest() noexcept {
+                auto const lock = std::lock_guard<std::mutex>{mutex_};
+                return active_.empty() ? current() : *active_.begin();
+            }
+        }; // version_registry
+        
+        
+        inline constexpr storage_index no_index = ~storage_index(0);
+        
+        
+        // Redo log of a transaction is a sequence of record images
+        // terminated by commit record
+        template<typename R> struct redo_entry {
+            storage_index index;
+            std::uint32_t reserved;
+            R record;
+        }; // redo_entry
+        
+        
+        struct redo_commit {
+            unsigned char signature[4];
+            std::uint32_t count;
+            std::uint64_t checksum;
+        }; // redo_commit
+        
+        
+        inline constexpr unsigned char redo_signature[4] = {0xC0, 0x11, 0x17, 0xED};
+        
+        
+        inline std::uint64_t checksum(void const* data, std::size_t size) noexcept {
+            auto const* bytes = static_cast<unsigned char const*>(data);
+            auto hash = std::uint64_t(0xCBF29CE484222325ull);
+            for(auto i = std::size_t(0); i != size; ++i) {
+                hash ^= bytes[i];
+                hash *= 0x100000001B3ull;
+            }
+            return hash;
+        }
+        
+        
+        template<typename V, class I> class secondary_index;
+        
+        
+        template<typename V, template<auto> class I, auto Extractor>
+        class secondary_index<V, I<Extractor>> {
+        public:
+            
+            static constexpr bool unique = I<Extractor>::unique;
+            
+            using key_type = std::decay_t<decltype(Extractor(std::declval<V const&>()))>;
+            using map_type = std::conditional_t<unique,
+                                                std::unordered_map<key_type, storage_index>,
+                                                std::unordered_multimap<key_type, storage_index>>;
+            
+            map_type map;
+            
+            
+            static key_type key_of(V const& value) {
+                return Extractor(value);
+            }
+            
+            
+            // Unique key of value is not taken by any item except replaced ones
+            template<class F> bool admissible(V const& value, F&& replaced) const {
+                if constexpr(!unique)
+                    return true;
+                auto const found = map.find(Extractor(value));
+                return found == map.end() || replaced(found->second);
+            }
+            
+            
+            bool admissible(V const& value, storage_index index) const {
+                return admissible(value, [index](storage_index other) { return other == index; });
+            }
+            
+            
+            void insert(V const& value, storage_index index) {
+                map.emplace(Extractor(value), index);
+            }
+            
+            
+            void erase(V const& value, storage_index index) noexcept {
+                auto const range = map.equal_range(Extractor(value));
+                for(auto it = range.first; it != range.second; ++it)
+                    if(it->second == index) {
+                        map.erase(it);
+                        return;
+                    }
+            }
+        }; // secondary_index
+        
+        
+        template<typename V, class S> struct secondary_maps;
+        
+        
+        template<typename V, class... I> struct secondary_maps<V, secondary_indices<I...>> {
+            using type = std::tuple<secondary_index<V, I>...>;
+        }; // secondary_maps
+        
+        
+        // Primary index looks up keys of other types without converting them
+        template<class I, typename = void> struct transparent_lookup: std::false_type { };
+        
+        
+        template<class I>
+        struct transparent_lookup<I, std::enable_if_t<I::transparent>>: std::true_type { };
+        
+        
+#if defined(__cpp_lib_generic_unordered_lookup)
+        template<class I>
+        struct transparent_lookup<I, std::void_t<typename I::hasher::is_transparent,
+                                                 typename I::key_equal::is_transparent>>
+            : std::true_type { };
+#endif
+        
+        
+        template<class T> struct any_unique;
+        
+        
+        template<class... S> struct any_unique<std::tuple<S...>> {
+            static constexpr bool value = (S::unique || ...);
+        }; // any_unique
+        
+        
+        template<class A, typename V, typename = void> struct secondary_traits {
+            using type = std::tuple<>;
+        }; // secondary_traits
+        
+        
+        template<class A, typename V>
+        struct secondary_traits<A, V, std::void_t<typename A::secondary_indices>> {
+            using type = typename secondary_maps<V, typename A::secondary_indices>::type;
+        }; // secondary_traits
+        
     } // namespace detail
     
     
-    using storage_index = std::uint32_t;
-    
-    
     template<typename Key,
              typename Value,
              class Adapter = Value,
              class Indices = std::unordered_map<Key, storage_index>>
     class storage {
         
-        Indices occupied_indices_;
+        using order_traits = detail::order_traits<Adapter, Value>;
+        using ordered_indices = detail::bplus_tree<typename order_traits::type, storage_index>;
+        using secondary_indices = typename detail::secondary_traits<Adapter, Value>::type;
+        using filter_traits = detail::filter_traits<Adapter>;
+        
+        static constexpr bool hashed = detail::is_hashed_indices<Indices>::value;
+        static constexpr bool versioned = detail::version_traits<Adapter>::enabled;
+        static constexpr std::uint32_t format_flags =
+            (hashed ? detail::hashed_records : 0) | (versioned ? detail::versioned_records : 0);
+        
+        using record_type = detail::record<Value, hashed, versioned>;
+        using primary_indices = std::conditional_t<hashed,
+                                                   detail::tag_table<Key,
+                                                                     record_type,
+                                                                     Adapter,
+                                                                     typename detail::is_hashed_indices<Indices>::hash>,
+                                                   Indices>;
+        
+        static constexpr bool transparent = detail::transparent_lookup<primary_indices>::value;
+        // Change log copies keys and values as bytes
+        static constexpr bool loggable = std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>;
+        
+        primary_indices occupied_indices_;
+        ordered_indices ordered_indices_;
+        secondary_indices secondary_indices_;
+        detail::bloom_filter bloom_filter_;
         std::vector<storage_index> free_indices_;
+        std::vector<storage_index> retired_indices_;
+        std::unique_ptr<detail::version_registry> versions_;
+        change_log<Key, Value>* change_log_{nullptr};
+        std::vector<std::uint64_t> dirty_pages_;
+        std::uint64_t sequence_{0};
+        std::uint64_t durable_{0};
         mapped_file mapped_file_;
         detail::header* header_{nullptr};
-        detail::record<Value>* records_{nullptr};
+        record_type* records_{nullptr};
+        std::filesystem::path path_;
         
         
         template<class I, class R, class D> class basic_iterator {
@@ -155,6 +472,66 @@ namespace persia {
             }
         }; // basic_iterator
         
+        
+        template<class R, class D> class basic_ordered_iterator {
+        friend class storage;
+        private:
+            typename ordered_indices::const_iterator index_it_;
+            R* records_;
+            
+            basic_ordered_iterator(typename ordered_indices::const_iterator index_it,
+                                   R* records) noexcept
+                : index_it_{index_it}, records_{records} { }
+        
+        public:
+            
+            basic_ordered_iterator() = delete;
+            basic_ordered_iterator(basic_ordered_iterator const&) noexcept = default;
+            basic_ordered_iterator& operator = (basic_ordered_iterator const&) noexcept = default;
+            
+            
+            bool operator == (basic_ordered_iterator const& other) const noexcept {
+                return index_it_ == other.index_it_;
+            }
+            
+            
+            bool operator != (basic_ordered_iterator const& other) const noexcept {
+                return index_it_ != other.index_it_;
+            }
+            
+            
+            D& operator * () const noexcept { return records_[index_it_.value()].data; }
+            D* operator -> () const noexcept { return &records_[index_it_.value()].data; }
+            
+            basic_ordered_iterator& operator ++ () noexcept {
+                ++index_it_;
+                return *this;
+            }
+            
+            basic_ordered_iterator operator ++ (int) noexcept {
+                auto current = *this;
+                ++index_it_;
+                return current;
+            }
+        }; // basic_ordered_iterator
+        
+        
+        template<class I> class basic_range {
+        friend class storage;
+        private:
+            I begin_;
+            I end_;
+            
+            basic_range(I begin, I end) noexcept
+                : begin_{begin}, end_{end} { }
+            
+        public:
+            
+            I begin() const noexcept { return begin_; }
+            I end() const noexcept { return end_; }
+            bool empty() const noexcept { return begin_ == end_; }
+        }; // basic_range
+        
     public:
     
         using key_type = Key;
@@ -162,14 +539,25 @@ namespace persia {
         using adapter_type = Adapter;
         using indices_type = Indices;
         using size_type = std::uint32_t;
-        using const_iterator = basic_iterator<typename Indices::const_iterator,
-                                              detail::record<Value> const,
+        using const_iterator = basic_iterator<typename primary_indices::const_iterator,
+                                              record_type const,
                                               Value const>;
-        using iterator = basic_iterator<typename Indices::iterator,
-                                        detail::record<Value>,
+        using iterator = basic_iterator<typename primary_indices::iterator,
+                                        record_type,
                                         Value>;
+        using order_type = typename order_traits::type;
+        using const_ordered_iterator = basic_ordered_iterator<record_type const,
+                                                              Value const>;
+        using ordered_iterator = basic_ordered_iterator<record_type, Value>;
+        using const_ordered_range = basic_range<const_ordered_iterator>;
+        using ordered_range = basic_range<ordered_iterator>;
+        
+        template<std::size_t N>
+        using secondary_key_type = typename std::tuple_element_t<N, secondary_indices>::key_type;
                                         
         class expected;
+        class transaction;
+        class read_view;
         
         
         static expected create(std::filesystem::path const& path,
@@ -181,6 +569,12 @@ namespace persia {
         static expected open_or_create(std::filesystem::path const& path,
                                        size_type initial_capacity);
         
+        // Creates storage of items [first, last) of forward range,
+        // capacity is at least the number of items
+        template<class It> static expected bulk_load(std::filesystem::path const& path,
+                                                     size_type initial_capacity,
+                                                     It first, It last);
+        
         
         storage() = default;
         storage(storage const&) = delete;
@@ -233,123 +627,864 @@ namespace persia {
         }
         
         
+        const_ordered_iterator ordered_begin() const noexcept {
+            static_assert(order_traits::enabled, "Adapter::order_of is not declared");
+            return const_ordered_iterator{ordered_indices_.begin(), records_};
+        }
+        
+        
+        const_ordered_iterator ordered_end() const noexcept {
+            static_assert(order_traits::enabled, "Adapter::order_of is not declared");
+            return const_ordered_iterator{ordered_indices_.end(), records_};
+        }
+        
+        
+        ordered_iterator ordered_begin() noexcept {
+            static_assert(order_traits::enabled, "Adapter::order_of is not declared");
+            return ordered_iterator{ordered_indices_.begin(), records_};
+        }
+        
+        
+        ordered_iterator ordered_end() noexcept {
+            static_assert(order_traits::enabled, "Adapter::order_of is not declared");
+            return ordered_iterator{ordered_indices_.end(), records_};
+        }
+        
+        
+        const_ordered_iterator lower_bound(order_type const& order) const noexcept {
+            static_assert(order_traits::enabled, "Adapter::order_of is not declared");
+            return const_ordered_iterator{ordered_indices_.lower_bound(order), records_};
+        }
+        
+        
+        ordered_iterator lower_bound(order_type const& order) noexcept {
+            static_assert(order_traits::enabled, "Adapter::order_of is not declared");
+            return ordered_iterator{ordered_indices_.lower_bound(order), records_};
+        }
+        
+        
+        // Items with order in [from, to)
+        const_ordered_range range(order_type const& from, order_type const& to) const noexcept {
+            return const_ordered_range{lower_bound(from), lower_bound(to)};
+        }
+        
+        
+        ordered_range range(order_type const& from, order_type const& to) noexcept {
+            return ordered_range{lower_bound(from), lower_bound(to)};
+        }
+        
+        
+        // Pointer to item for unique index, range of items for multi index
+        template<std::size_t N> auto find_by(secondary_key_type<N> const& key) const noexcept {
+            auto const& map = std::get<N>(secondary_indices_).map;
+            using map_iterator = typename std::decay_t<decltype(map)>::const_iterator;
+            using secondary_iterator = basic_iterator<map_iterator,
+                                                      record_type const,
+                                                      Value const>;
+            auto const range = map.equal_range(key);
+            if constexpr(std::tuple_element_t<N, secondary_indices>::unique) {
+                return range.first == range.second
+                    ? static_cast<Value const*>(nullptr)
+                    : &records_[range.first->second].data;
+            } else {
+                return basic_range<secondary_iterator>{secondary_iterator{range.first, records_},
+                                                       secondary_iterator{range.second, records_}};
+            }
+        }
+        
+        
+        template<std::size_t N> auto find_by(secondary_key_type<N> const& key) noexcept {
+            auto& map = std::get<N>(secondary_indices_).map;
+            using map_iterator = typename std::decay_t<decltype(map)>::iterator;
+            using secondary_iterator = basic_iterator<map_iterator, record_type, Value>;
+            auto const range = map.equal_range(key);
+            if constexpr(std::tuple_element_t<N, secondary_indices>::unique) {
+                return range.first == range.second
+                    ? static_cast<Value*>(nullptr)
+                    : &records_[range.first->second].data;
+            } else {
+                return basic_range<secondary_iterator>{secondary_iterator{range.first, records_},
+                                                       secondary_iterator{range.second, records_}};
+            }
+        }
+        
+        
         bool insert(Value const& value) {
+            return emplace(value);
+        }
+        
+        
+        bool insert(Value&& value) {
+            return emplace(std::move(value));
+        }
+        
+        
+        // Constructs item right in a free record, the record stays free
+        // if the key of constructed item is already present
+        template<typename... Args> bool emplace(Args&&... args) {
+            reclaim();
             if(free_indices_.empty())
                 return false;
             auto const index = free_indices_.back();
-            free_indices_.pop_back();
-            auto const key = Adapter::key_of(value);
+            auto* record = records_ + index;
+            prepare_record(index);
+            new(&record->data) Value(std::forward<Args>(args)...);
+            if(!admissible(record->data, detail::no_index))
+                return false;
+            auto const key = Adapter::key_of(record->data);
             auto emplaced = occupied_indices_.try_emplace(key, index);
-            if(!emplaced.second) {
-                free_indices_.push_back(index);
+            if(!emplaced.second)
+                return false;
+            free_indices_.pop_back();
+            complete_record(index, emplaced.first);
+            index_record(index);
+            publish();
+            log_change(change_kind::insert, key, record->data);
+            return true;
+        }
+        
+        
+        // Item is constructed only if the key is absent, key of constructed
+        // item should be equal to the given one
+        template<typename... Args> bool try_emplace(Key const& key, Args&&... args) {
+            if(contains(key))
+                return false;
+            return emplace(std::forward<Args>(args)...);
+        }
+        
+        
+        // Mutates item in place by fn(Value&), indices are updated after it.
+        // fn should not change the key. With multiversion records item is
+        // copied to another free record first. Returns false if key is absent
+        // or changed unique secondary key is taken by other item.
+        template<typename F> bool update(Key const& key, F&& fn) {
+            reclaim();
+            if(!may_contain(key))
                 return false;
+            auto index_found = occupied_indices_.find(key);
+            if(index_found == occupied_indices_.end())
+                return false;
+            auto const index = index_found->second;
+            if constexpr(versioned) {
+                if(free_indices_.empty())
+                    return false;
+                auto const copy = free_indices_.back();
+                auto* record = records_ + copy;
+                prepare_record(copy);
+                new(&record->data) Value(records_[index].data);
+                fn(record->data);
+                if(!admissible(record->data, index))
+                    return false;
+                free_indices_.pop_back();
+                unindex_record(index);
+                complete_record(copy, index_found);
+                index_found->second = copy;
+                release(index);
+                index_record(copy);
+                log_change(change_kind::assign, key, record->data);
+            } else {
+                auto* record = records_ + index;
+                unindex_record(index);
+                if constexpr(detail::any_unique<secondary_indices>::value) {
+                    auto const previous = record->data;
+                    fn(record->data);
+                    if(!admissible(record->data, index)) {
+                        record->data = previous;
+                        index_record(index);
+                        return false;
+                    }
+                } else {
+                    fn(record->data);
+                }
+                mark_dirty(index);
+                index_record(index);
+                log_change(change_kind::assign, key, record->data);
             }
-            auto* record = records_ + index;
-            record->marker = detail::marker::occupied;
-            record->data = value;
+            publish();
             return true;
         }
         
         
+        // With multiversion records assigned value takes another free record
         bool insert_or_assign(Value const& value) {
+            reclaim();
             auto const key = Adapter::key_of(value);
             auto emplaced = occupied_indices_.try_emplace(key, 0u);
             if(emplaced.second) {
-                if(free_indices_.empty()) {
+                if(free_indices_.empty() || !admissible(value, detail::no_index)) {
                     occupied_indices_.erase(emplaced.first);
                     return false;
                 }
                 auto const index = free_indices_.back();
                 free_indices_.pop_back();
                 emplaced.first->second = index;
-                auto* record = records_ + index;
-                record->marker = detail::marker::occupied;
-                record->data = value;
+                write_record(index, emplaced.first, value);
+                index_record(index);
+                publish();
+                log_change(change_kind::insert, key, value);
                 return true;
             }
             auto const index = emplaced.first->second;
-            auto* record = records_ + index;
-            record->data = value;
+            if(!admissible(value, index))
+                return false;
+            if constexpr(versioned) {
+                if(free_indices_.empty())
+                    return false;
+                auto const copy = free_indices_.back();
+                free_indices_.pop_back();
+                unindex_record(index);
+                write_record(copy, emplaced.first, value);
+                emplaced.first->second = copy;
+                release(index);
+                index_record(copy);
+                publish();
+            } else {
+                auto* record = records_ + index;
+                unindex_record(index);
+                record->data = value;
+                mark_dirty(index);
+                index_record(index);
+                publish();
+            }
+            log_change(change_kind::assign, key, value);
             return true;
         }
         
         
         bool erase(Key const& key) {
-            auto index_found = occupied_indices_.find(key);
-            if(index_found == occupied_indices_.end())
-                return false;
-            auto const index = index_found->second;
-            free_indices_.push_back(index);
-            auto* record = records_ + index;
-            record->marker = detail::marker::empty;
-            occupied_indices_.erase(index_found);
-            return true;
+            return erase_key(key);
+        }
+        
+        
+        // Lookup by type comparable to Key, only with transparent primary
+        // index, e.g. hashed_indices<Hash> with transparent Hash
+        template<typename K, bool T = transparent, typename = std::enable_if_t<T>>
+        bool erase(K const& key) {
+            return erase_key(key);
         }
 
 
         std::optional<Value> extract(Key const& key) {
-            auto index_found = occupied_indices_.find(key);
-            if(index_found == occupied_indices_.end())
-                return std::nullopt;
-            auto const index = index_found->second;
-            free_indices_.push_back(index);
-            auto* record = records_ + index;
-            auto const item = record->data;
-            record->marker = detail::marker::empty;
-            occupied_indices_.erase(index_found);
-            return {item};
-        }        
+            return extract_key(key);
+        }
+        
+        
+        template<typename K, bool T = transparent, typename = std::enable_if_t<T>>
+        std::optional<Value> extract(K const& key) {
+            return extract_key(key);
+        }
         
         
         Value const* find(Key const& key) const noexcept {
-            auto const index_found = occupied_indices_.find(key);
-            if(index_found == occupied_indices_.end())
-                return nullptr;
-            auto const index = index_found->second;
-            return &records_[index].data;
+            return find_key(key);
         }
         
         
+        template<typename K, bool T = transparent, typename = std::enable_if_t<T>>
+        Value const* find(K const& key) const noexcept {
+            return find_key(key);
+        }
+        
+        
+        // Changes made through found item or non-const iterators are not
+        // tracked by checkpoint, use modify for them
         Value* find(Key const& key) noexcept {
-            auto const index_found = occupied_indices_.find(key);
-            if(index_found == occupied_indices_.end())
-                return nullptr;
-            auto const index = index_found->second;
-            return &records_[index].data;
+            return find_key(key);
+        }
+        
+        
+        template<typename K, bool T = transparent, typename = std::enable_if_t<T>>
+        Value* find(K const& key) noexcept {
+            return find_key(key);
+        }
+        
+        
+        // Found item to be changed in place, its record is considered
+        // written and covered by the next checkpoint. Like fetch_add,
+        // changes are neither reindexed, logged nor versioned.
+        Value* modify(Key const& key) noexcept {
+            return modify_key(key);
+        }
+        
+        
+        template<typename K, bool T = transparent, typename = std::enable_if_t<T>>
+        Value* modify(K const& key) noexcept {
+            return modify_key(key);
         }
 
 
         bool contains(Key const& key) const noexcept {
-            return find(key) != nullptr;
+            return find_key(key) != nullptr;
         }
         
         
-        void clear() noexcept {
-            for(auto [key, index]: occupied_indices_) {
-                records_[index].marker = detail::marker::empty;
-                free_indices_.push_back(index);
+        template<typename K, bool T = transparent, typename = std::enable_if_t<T>>
+        bool contains(K const& key) const noexcept {
+            return find_key(key) != nullptr;
+        }
+        
+        
+        // Atomically adds 'delta' to integral field of the item and returns
+        // the previous value, empty if there is no such item. Lock-free for
+        // threads and processes mapping the same file, may run concurrently
+        // with finds and other additions but not with insertions or erasures.
+        // Concurrent readers take the value by adding zero. Like changes made
+        // through found items, additions are not logged nor versioned.
+        template<typename F> std::optional<F> fetch_add(Key const& key, F Value::* field, F delta) noexcept {
+            auto* found = modify_key(key);
+            if(found == nullptr)
+                return std::nullopt;
+            return detail::fetch_add(&(found->*field), delta);
+        }
+        
+        
+        // Point-in-time copy of the storage file, cheap on file systems
+        // supporting reflinks (Btrfs, XFS)
+        std::error_code snapshot(std::filesystem::path const& path) const noexcept {
+            return mapped_file_.copy_to(path);
+        }
+        
+        
+        // Syncs pages written since the previous checkpoint, runs of dirty
+        // pages are written back as single extents in batches followed by
+        // a single file sync. May run in other thread concurrently with
+        // mutations, but not with another checkpoint.
+        std::error_code checkpoint() noexcept {
+            constexpr auto batch_size = std::size_t(64);
+            auto const page = mapped_file::page_size();
+            auto const sequence = detail::load_acquire(&sequence_);
+            mapped_file::extent batch[batch_size];
+            auto batched = std::size_t(0);
+            auto ec = std::error_code{};
+            auto const flush = [&] {
+                ec = mapped_file_.flush_extents(batch, batched);
+                if(!!ec)
+                    for(auto i = std::size_t(0); i != batched; ++i)
+                        mark_dirty(batch[i].offset, batch[i].size);
+                batched = 0;
+            };
+            auto first = std::size_t(0), last = std::size_t(0);
+            auto const add = [&] {
+                if(first == last)
+                    return;
+                if(batched == batch_size)
+                    flush();
+                if(!!ec) {
+                    mark_dirty(first * page, (last - first) * page);
+                    return;
+                }
+                auto const end = std::min(last * page, mapped_file_.size());
+                batch[batched++] = mapped_file::extent{first * page, end - first * page};
+            };
+            for(auto word = std::size_t(0); word != dirty_pages_.size() && !ec; ++word) {
+                auto bits = detail::exchange(&dirty_pages_[word], 0);
+                for(auto bit = 0u; bits != 0; ++bit, bits >>= 1) {
+                    if((bits & 1) == 0)
+                        continue;
+                    auto const current = word * 64 + bit;
+                    if(first != last && current == last) {
+                        ++last;
+                        continue;
+                    }
+                    add();
+                    if(!!ec) {
+                        detail::fetch_or(&dirty_pages_[word], bits << bit);
+                        break;
+                    }
+                    first = current;
+                    last = current + 1;
+                }
             }
+            if(!ec)
+                add();
+            if(!ec)
+                flush();
+            if(!!ec)
+                return ec;
+            detail::store_release(&durable_, sequence);
+            return {};
+        }
+        
+        
+        // Number of pages to be synced by the next checkpoint
+        std::size_t dirty_pages() const noexcept {
+            auto count = std::size_t(0);
+            for(auto const& each: dirty_pages_)
+                for(auto word = detail::load_acquire(&each); word != 0; word &= word - 1)
+                    ++count;
+            return count;
+        }
+        
+        
+        // Number of mutations made so far
+        std::uint64_t sequence() const noexcept {
+            return detail::load_acquire(&sequence_);
+        }
+        
+        
+        // Mutations up to this sequence number are synced by checkpoint
+        std::uint64_t durable_sequence() const noexcept {
+            return detail::load_acquire(&durable_);
+        }
+        
+        
+        void clear() noexcept {
+            for(auto const& entry: occupied_indices_)
+                release(entry.second);
             occupied_indices_.clear();
+            ordered_indices_.clear();
+            std::apply([](auto&... secondary) { (secondary.map.clear(), ...); },
+                       secondary_indices_);
+            bloom_filter_.clear();
+            publish();
+            log_change(change_kind::clear);
+        }
+        
+        
+        // Successful mutations are appended to the log until detached
+        void attach(change_log<Key, Value>& log) noexcept {
+            static_assert(loggable, "Key and Value should be trivially copyable to be logged");
+            change_log_ = &log;
+        }
+        
+        
+        void detach() noexcept {
+            change_log_ = nullptr;
+        }
+        
+        
+        // Stable view of items as of now, unaffected by later mutations.
+        // Items changed through pointers returned by 'find' or by iterators
+        // are changed in place for all views.
+        read_view read_snapshot() const {
+            static_assert(versioned, "Adapter::multiversion is not declared");
+            return read_view{*versions_, records_, capacity()};
+        }
+        
+        
+        // Frees records retired before the oldest active view was taken,
+        // called implicitly when no free records left
+        void collect() noexcept {
+            static_assert(versioned, "Adapter::multiversion is not declared");
+            auto const oldest = versions_->oldest();
+            auto reclaimed = retired_indices_.begin();
+            for(; reclaimed != retired_indices_.end(); ++reclaimed) {
+                auto* record = records_ + *reclaimed;
+                if(record->retired > oldest)
+                    break;
+                record->marker = detail::marker::empty;
+                mark_dirty(*reclaimed);
+                free_indices_.push_back(*reclaimed);
+            }
+            retired_indices_.erase(retired_indices_.begin(), reclaimed);
         }
         
         
     private:
     
-        storage(Indices&& occupied_indices,
-                std::vector<storage_index>&& free_indices,
-                mapped_file&& mapped_file,
+        storage(mapped_file&& mapped_file,
                 detail::header* header,
-                detail::record<Value>* records) noexcept
-            : occupied_indices_{std::move(occupied_indices)}
-            , free_indices_{std::move(free_indices)}
-            , mapped_file_{std::move(mapped_file)}
+                record_type* records,
+                std::filesystem::path const& path)
+            : mapped_file_{std::move(mapped_file)}
             , header_{header}
-            , records_{records} {
+            , records_{records}
+            , path_{path} {
+            if constexpr(hashed)
+                occupied_indices_.attach(records);
+            if constexpr(versioned)
+                versions_ = std::make_unique<detail::version_registry>();
+        }
+        
+        
+        // Sizes in-memory indices once for 'reserved' records
+        void reserve(size_type reserved) {
+            auto const page = mapped_file::page_size();
+            auto const pages = (sizeof(detail::header) + reserved * sizeof(record_type) + page - 1) / page;
+            dirty_pages_.assign((pages + 63) / 64, 0);
+            occupied_indices_.reserve(reserved);
+            free_indices_.reserve(reserved);
+            std::apply([reserved](auto&... secondary) { (secondary.map.reserve(reserved), ...); },
+                       secondary_indices_);
+            if constexpr(filter_traits::enabled)
+                bloom_filter_.reset(reserved, filter_traits::bits_per_item);
+            if constexpr(versioned)
+                retired_indices_.reserve(reserved);
+        }
+        
+        
+        // Rebuilds all in-memory indices from the first 'capacity' records
+        std::error_code load(size_type capacity, size_type reserved) {
+            reserve(reserved);
+            for(auto i = 0u; i != capacity; ++i) {
+                auto* record = records_ + i;
+                switch(record->marker) {
+                case detail::marker::empty:
+                    free_indices_.push_back(i);
+                    continue;
+                case detail::marker::occupied:
+                    if constexpr(versioned) {
+                        restore(i);
+                        continue;
+                    }
+                    if constexpr(hashed)
+                        occupied_indices_.insert_unique(record->hash, i);
+                    else
+                        occupied_indices_[Adapter::key_of(record->data)] = i;
+                    index_record(i);
+                    continue;
+                default:
+                    return make_error_code(storage_error::file_is_corrupted);
+                }
+            }
+            if constexpr(versioned)
+                for(auto const& entry: occupied_indices_)
+                    index_record(entry.second);
+            return {};
+        }
+        
+        
+        // Indexes the first 'count' records written by bulk_load, the last
+        // of items with equal keys is kept
+        std::error_code build(size_type count, size_type capacity) {
+            reserve(capacity);
+            for(auto i = 0u; i != count; ++i) {
+                auto emplaced = emplace_loaded(i);
+                if(emplaced.second)
+                    continue;
+                records_[emplaced.first->second].marker = detail::marker::empty;
+                free_indices_.push_back(emplaced.first->second);
+                emplaced.first->second = i;
+            }
+            for(auto i = count; i != capacity; ++i)
+                free_indices_.push_back(i);
+            for(auto const& entry: occupied_indices_) {
+                if(!admissible(records_[entry.second].data, detail::no_index))
+                    return make_error_code(storage_error::duplicate_secondary_key);
+                index_record(entry.second);
+            }
+            publish();
+            return {};
+        }
+        
+        
+        auto emplace_loaded(storage_index index) {
+            auto const* record = records_ + index;
+            if constexpr(hashed)
+                return occupied_indices_.try_emplace(Adapter::key_of(record->data), index, record->hash);
+            else
+                return occupied_indices_.try_emplace(Adapter::key_of(record->data), index);
+        }
+        
+        
+        static void fill_record(record_type* record, Value const& value) noexcept {
+            new(record) record_type{};
+            record->marker = detail::marker::occupied;
+            if constexpr(hashed)
+                record->hash = primary_indices::hash_of(Adapter::key_of(value));
+            record->data = value;
+            if constexpr(versioned)
+                record->created = 1;
+        }
+        
+        
+        // Random access ranges are copied by several threads
+        template<class It> static void fill_records(record_type* records, It first, std::size_t count) {
+            using category = typename std::iterator_traits<It>::iterator_category;
+            if constexpr(std::is_base_of_v<std::random_access_iterator_tag, category>) {
+                constexpr auto min_chunk = std::size_t(1) << 16;
+                auto const threads = std::max(std::size_t(std::thread::hardware_concurrency()), std::size_t(1));
+                auto const workers = std::min(threads, (count + min_chunk - 1) / min_chunk);
+                if(workers > 1) {
+                    auto const chunk = (count + workers - 1) / workers;
+                    auto pool = std::vector<std::thread>{};
+                    pool.reserve(workers - 1);
+                    for(auto from = chunk; from < count; from += chunk)
+                        pool.emplace_back([records, first, from, to = std::min(from + chunk, count)] {
+                            for(auto i = from; i != to; ++i)
+                                fill_record(records + i, first[i]);
+                        });
+                    for(auto i = std::size_t(0); i != chunk; ++i)
+                        fill_record(records + i, first[i]);
+                    for(auto& worker: pool)
+                        worker.join();
+                    return;
+                }
+            }
+            for(auto* record = records; record != records + count; ++record, ++first)
+                fill_record(record, *first);
+        }
+        
+        
+        // Keeps the latest version of the key, retired and partially written
+        // records are freed since there are no views at opening
+        void restore(storage_index index) {
+            auto* record = records_ + index;
+            auto const stamp = record->retired != detail::unstamped ? record->retired : record->created;
+            if(stamp != detail::unstamped && stamp > versions_->current())
+                versions_->publish(stamp);
+            if(record->created == detail::unstamped || record->retired != detail::unstamped) {
+                record->marker = detail::marker::empty;
+                mark_dirty(index);
+                free_indices_.push_back(index);
+                return;
+            }
+            auto emplaced = occupied_indices_.try_emplace(Adapter::key_of(record->data), index);
+            if(emplaced.second)
+                return;
+            auto* other = records_ + emplaced.first->second;
+            if(other->created > record->created) {
+                record->marker = detail::marker::empty;
+                mark_dirty(index);
+                free_indices_.push_back(index);
+                return;
+            }
+            other->marker = detail::marker::empty;
+            mark_dirty(emplaced.first->second);
+            free_indices_.push_back(emplaced.first->second);
+            emplaced.first->second = index;
+        }
+        
+        
+        template<class E> void write_record(storage_index index, E const& entry, Value const& value) {
+            prepare_record(index);
+            records_[index].data = value;
+            complete_record(index, entry);
+        }
+        
+        
+        // Stamps of reused record are reset before the record is written,
+        // so concurrent views never see it partially written
+        void prepare_record(storage_index index) noexcept {
+            if constexpr(versioned) {
+                auto* record = records_ + index;
+                detail::store_release(&record->created, detail::unstamped);
+                detail::store_release(&record->retired, detail::unstamped);
+            }
+        }
+        
+        
+        template<class E> void complete_record(storage_index index, E const& entry) noexcept {
+            auto* record = records_ + index;
+            record->marker = detail::marker::occupied;
+            if constexpr(hashed)
+                record->hash = entry->tag;
+            if constexpr(versioned)
+                detail::store_release(&record->created, versions_->current() + 1);
+            mark_dirty(index);
+        }
+        
+        
+        // Retired versioned record stays visible to earlier views until collected
+        void release(storage_index index) noexcept {
+            auto* record = records_ + index;
+            if constexpr(versioned) {
+                detail::store_release(&record->retired, versions_->current() + 1);
+                retired_indices_.push_back(index);
+            } else {
+                record->marker = detail::marker::empty;
+                free_indices_.push_back(index);
+            }
+            // After the write, so concurrent checkpoint can't take the page clean
+            mark_dirty(index);
+        }
+        
+        
+        // Completes mutation, records stamped by it become visible to new
+        // views and its pages are covered by the next checkpoint
+        void publish() noexcept {
+            if constexpr(versioned)
+                versions_->publish(versions_->current() + 1);
+            detail::store_release(&sequence_, sequence_ + 1);
+        }
+        
+        
+        void mark_dirty(std::size_t offset, std::size_t size) noexcept {
+            auto const page = mapped_file::page_size();
+            for(auto i = offset / page; i <= (offset + size - 1) / page; ++i)
+                detail::fetch_or(&dirty_pages_[i / 64], std::uint64_t(1) << (i % 64));
+        }
+        
+        
+        void mark_dirty(storage_index index) noexcept {
+            mark_dirty(sizeof(detail::header) + index * sizeof(record_type), sizeof(record_type));
+        }
+        
+        
+        void log_change(change_kind kind, Key const& key, Value const& value) noexcept {
+            if constexpr(loggable)
+                if(change_log_ != nullptr)
+                    change_log_->append(kind, key, value);
+        }
+        
+        
+        void log_change(change_kind kind, Key const& key) noexcept {
+            if constexpr(loggable)
+                if(change_log_ != nullptr)
+                    change_log_->append(kind, key);
+        }
+        
+        
+        void log_change(change_kind kind) noexcept {
+            if constexpr(loggable)
+                if(change_log_ != nullptr)
+                    change_log_->append(kind);
+        }
+        
+        
+        void reclaim() noexcept {
+            if constexpr(versioned)
+                if(free_indices_.empty())
+                    collect();
+        }
+        
+        
+        template<typename F> bool admissible(Value const& value, F&& replaced) const {
+            return std::apply([&](auto const&... secondary) {
+                return (secondary.admissible(value, replaced) && ...);
+            }, secondary_indices_);
+        }
+        
+        
+        bool admissible(Value const& value, storage_index index) const {
+            return admissible(value, [index](storage_index other) { return other == index; });
+        }
+        
+        
+        void index_record(storage_index index) {
+            auto const& value = records_[index].data;
+            if constexpr(filter_traits::enabled)
+                bloom_filter_.insert(hash_of(Adapter::key_of(value)));
+            if constexpr(order_traits::enabled)
+                ordered_indices_.insert(Adapter::order_of(value), index);
+            std::apply([&](auto&... secondary) { (secondary.insert(value, index), ...); },
+                       secondary_indices_);
+        }
+        
+        
+        template<typename K> static std::uint64_t hash_of(K const& key) noexcept {
+            return detail::mix_hash(std::uint64_t(typename primary_indices::hasher{}(key)));
+        }
+        
+        
+        template<typename K> bool may_contain(K const& key) const noexcept {
+            if constexpr(filter_traits::enabled)
+                return bloom_filter_.may_contain(hash_of(key));
+            else
+                return true;
+        }
+        
+        
+        template<typename K> bool erase_key(K const& key) {
+            if(!may_contain(key))
+                return false;
+            auto index_found = occupied_indices_.find(key);
+            if(index_found == occupied_indices_.end())
+                return false;
+            auto const index = index_found->second;
+            auto const erased = Adapter::key_of(records_[index].data);
+            unindex_record(index);
+            release(index);
+            occupied_indices_.erase(index_found);
+            filter_erased();
+            publish();
+            log_change(change_kind::erase, erased);
+            return true;
+        }
+
+
+        template<typename K> std::optional<Value> extract_key(K const& key) {
+            if(!may_contain(key))
+                return std::nullopt;
+            auto index_found = occupied_indices_.find(key);
+            if(index_found == occupied_indices_.end())
+                return std::nullopt;
+            auto const index = index_found->second;
+            unindex_record(index);
+            auto const item = records_[index].data;
+            release(index);
+            occupied_indices_.erase(index_found);
+            filter_erased();
+            publish();
+            log_change(change_kind::erase, Adapter::key_of(item));
+            return {item};
+        }
+        
+        
+        template<typename K> Value const* find_key(K const& key) const noexcept {
+            if(!may_contain(key))
+                return nullptr;
+            auto const index_found = occupied_indices_.find(key);
+            if(index_found == occupied_indices_.end())
+                return nullptr;
+            return &records_[index_found->second].data;
+        }
+        
+        
+        template<typename K> Value* find_key(K const& key) noexcept {
+            if(!may_contain(key))
+                return nullptr;
+            auto const index_found = occupied_indices_.find(key);
+            if(index_found == occupied_indices_.end())
+                return nullptr;
+            return &records_[index_found->second].data;
+        }
+        
+        
+        template<typename K> Value* modify_key(K const& key) noexcept {
+            if(!may_contain(key))
+                return nullptr;
+            auto const index_found = occupied_indices_.find(key);
+            if(index_found == occupied_indices_.end())
+                return nullptr;
+            auto const index = index_found->second;
+            mark_dirty(index);
+            return &records_[index].data;
+        }
+        
+        
+        // Filter is rebuilt once erased keys outnumber present ones
+        void filter_erased() {
+            if constexpr(filter_traits::enabled) {
+                bloom_filter_.mark_stale();
+                if(bloom_filter_.stale() <= occupied_indices_.size())
+                    return;
+                bloom_filter_.clear();
+                for(auto const& entry: occupied_indices_)
+                    bloom_filter_.insert(hash_of(Adapter::key_of(records_[entry.second].data)));
+            }
+        }
+        
+        
+        void unindex_record(storage_index index) noexcept {
+            auto const& value = records_[index].data;
+            if constexpr(order_traits::enabled)
+                ordered_indices_.erase(Adapter::order_of(value), index);
+            std::apply([&](auto&... secondary) { (secondary.erase(value, index), ...); },
+                       secondary_indices_);
         }
         
         
         static expected expand(std::filesystem::path const& path,
                                size_type initial_capacity);
+        
+        
+        static std::filesystem::path redo_path_of(std::filesystem::path const& path) {
+            auto redo_path = path;
+            redo_path += ".redo";
+            return redo_path;
+        }
+        
+        
+        static std::error_code recover(std::filesystem::path const& path,
+                                       mapped_file& file,
+                                       record_type* records,
+                                       size_type capacity);
+        
+        
+        std::error_code write_redo(std::vector<detail::redo_entry<record_type>> const& images) const;
+        void apply(std::vector<detail::redo_entry<record_type>> const& images, std::size_t taken);
+        std::error_code flush_records(std::vector<detail::redo_entry<record_type>> const& images) const;
     }; // storage
     
     template<typename K, typename V, class A, class I>
@@ -396,6 +1531,126 @@ namespace persia {
     }; // storage::expected
     
     
+    // Scanning records takes no locks, so a view may be iterated by other
+    // thread while storage is mutated. View should not outlive storage.
+    template<typename K, typename V, class A, class I>
+    class storage<K, V, A, I>::read_view {
+    friend class storage;
+    private:
+        detail::version_registry* versions_;
+        record_type const* records_;
+        size_type capacity_;
+        std::uint64_t version_;
+        
+        read_view(detail::version_registry& versions,
+                  record_type const* records,
+                  size_type capacity)
+            : versions_{&versions}
+            , records_{records}
+            , capacity_{capacity}
+            , version_{versions.enter()} {
+        }
+        
+    public:
+        
+        class const_iterator {
+        friend class read_view;
+        private:
+            record_type const* current_;
+            record_type const* last_;
+            std::uint64_t version_;
+            
+            const_iterator(record_type const* current,
+                           record_type const* last,
+                           std::uint64_t version) noexcept
+                : current_{current}, last_{last}, version_{version} {
+                skip();
+            }
+            
+            // Retired stamp is read before created one as writer resets them
+            // in reverse order
+            void skip() noexcept {
+                for(; current_ != last_; ++current_) {
+                    auto const retired = detail::load_acquire(&current_->retired);
+                    auto const created = detail::load_acquire(&current_->created);
+                    if(created <= version_ && version_ < retired)
+                        return;
+                }
+            }
+            
+        public:
+            
+            bool operator == (const_iterator const& other) const noexcept {
+                return current_ == other.current_;
+            }
+            
+            
+            bool operator != (const_iterator const& other) const noexcept {
+                return current_ != other.current_;
+            }
+            
+            
+            V const& operator * () const noexcept { return current_->data; }
+            V const* operator -> () const noexcept { return &current_->data; }
+            
+            const_iterator& operator ++ () noexcept {
+                ++current_;
+                skip();
+                return *this;
+            }
+            
+            const_iterator operator ++ (int) noexcept {
+                auto current = *this;
+                ++*this;
+                return current;
+            }
+        }; // const_iterator
+        
+        
+        read_view(read_view const&) = delete;
+        read_view& operator = (read_view const&) = delete;
+        
+        
+        read_view(read_view&& other) noexcept
+            : versions_{other.versions_}
+            , records_{other.records_}
+            , capacity_{other.capacity_}
+            , version_{other.version_} {
+            other.versions_ = nullptr;
+        }
+        
+        
+        read_view& operator = (read_view&& other) noexcept {
+            std::swap(versions_, other.versions_);
+            std::swap(records_, other.records_);
+            std::swap(capacity_, other.capacity_);
+            std::swap(version_, other.version_);
+            return *this;
+        }
+        
+        
+        ~read_view() {
+            if(versions_ != nullptr)
+                versions_->leave(version_);
+        }
+        
+        
+        std::uint64_t version() const noexcept {
+            return version_;
+        }
+        
+        
+        const_iterator begin() const noexcept {
+            return const_iterator{records_, records_ + capacity_, version_};
+        }
+        
+        
+        const_iterator end() const noexcept {
+            return const_iterator{records_ + capacity_, records_ + capacity_, version_};
+        }
+    }; // storage::read_view
+    
+    
     template<typename K, typename V, class A, class I> typename storage<K, V, A, I>::expected
     storage<K, V, A, I>::create(std::filesystem::path const& path,
                                 typename storage<K, V, A, I>::size_type initial_capacity) {
@@ -406,7 +1661,7 @@ namespace persia {
             return {std::error_code{int(errno), std::system_category()}};
         std::fclose(file);
         namespace fs = std::filesystem;
-        auto const storage_size = sizeof(detail::header) + initial_capacity * sizeof(detail::record<V>);
+        auto const storage_size = sizeof(detail::header) + initial_capacity * sizeof(record_type);
         auto ec = std::error_code{};
         fs::resize_file(path, storage_size, ec);
         if(!!ec)
@@ -421,22 +1676,20 @@ namespace persia {
         header->signature[3] = 0x1E;
         header->item_size = sizeof(V);
         header->capacity = initial_capacity;
+        header->flags = format_flags;
         
-        auto occupied_indices = I{};
-        occupied_indices.reserve(initial_capacity);
-        auto free_indices = std::vector<storage_index>{};
-        free_indices.reserve(initial_capacity);
-        for(auto i = 0u; i != initial_capacity; ++i)
-            free_indices.push_back(i);
-        auto* records = expected_file->cast<detail::record<V>>(sizeof(detail::header));
+        auto* records = expected_file->cast<record_type>(sizeof(detail::header));
         for(auto* record = records; record != records + initial_capacity; ++record)
-            new(record) detail::record<V>{};
+            new(record) record_type{};
         
-        return {storage{std::move(occupied_indices),
-                        std::move(free_indices),
-                        std::move(*expected_file),
-                        header,
-                        records}};
+        if(fs::remove(redo_path_of(path), ec))
+            detail::sync_directory(path.parent_path());
+        auto target = storage{std::move(*expected_file), header, records, path};
+        ec = target.load(initial_capacity, initial_capacity);
+        if(!!ec)
+            return {ec};
+        target.mark_dirty(0, sizeof(detail::header) + initial_capacity * sizeof(record_type));
+        return {std::move(target)};
     }
     
     
@@ -446,7 +1699,7 @@ namespace persia {
         auto expected_file = mapped_file::create(path);
         if(!expected_file)
             return {expected_file.error()};
-        if(expected_file->size() < sizeof(detail::header) + sizeof(detail::record<V>))
+        if(expected_file->size() < sizeof(detail::header) + sizeof(record_type))
             return {make_error_code(storage_error::file_size_is_too_small)};
         auto* header = expected_file->cast<detail::header>(0);
         if(header->signature[0] != 0xDA
@@ -454,41 +1707,89 @@ namespace persia {
             || header->signature[2] != 0xF1
             || header->signature[3] != 0x1E)
             return {make_error_code(storage_error::invalid_file_signature)};
-        if(expected_file->size() != sizeof(detail::header) + header->capacity * sizeof(detail::record<V>))
+        if(header->flags != format_flags)
+            return {make_error_code(storage_error::mismatch_format)};
+        if(expected_file->size() != sizeof(detail::header) + header->capacity * sizeof(record_type))
             return {make_error_code(storage_error::mismatch_file_size)};
         if(sizeof(V) != header->item_size)
             return {make_error_code(storage_error::mismatch_item_size)};
+        auto* records = expected_file->cast<record_type>(sizeof(detail::header));
+        auto ec = recover(path, *expected_file, records, header->capacity);
+        if(!!ec)
+            return {ec};
         if(initial_capacity > header->capacity) {
             *expected_file = mapped_file{};
             return expand(path, initial_capacity);
         }
-        auto occupied_indices = I{};
-        occupied_indices.reserve(header->capacity);
-        auto free_indices = std::vector<storage_index>{};
-        free_indices.reserve(header->capacity);
-        auto* records = expected_file->cast<detail::record<V>>(sizeof(detail::header));
-        for(auto i = 0u; i != header->capacity; ++i) {
-            auto* record = records + i;
-            switch(record->marker) {
-            case detail::marker::empty:
-                free_indices.push_back(i);
-                continue;
-            case detail::marker::occupied:
-                occupied_indices[A::key_of(record->data)] = i;
-                continue;
-            default:
-                return {make_error_code(storage_error::file_is_corrupted)};
-            }
-        }
-        return {storage{std::move(occupied_indices),
-                        std::move(free_indices),
-                        std::move(*expected_file),
-                        header,
-                        records}};
-
+        expected_file->will_need(sizeof(detail::header), header->capacity * sizeof(record_type));
+        auto target = storage{std::move(*expected_file), header, records, path};
+        ec = target.load(header->capacity, header->capacity);
+        if(!!ec)
+            return {ec};
+        return {std::move(target)};
     }
 
 
+    // Records are written in file order and made durable before the header,
+    // so interrupted load leaves file without valid signature
+    template<typename K, typename V, class A, class I>
+    template<class It> typename storage<K, V, A, I>::expected
+    storage<K, V, A, I>::bulk_load(std::filesystem::path const& path,
+                                   typename storage<K, V, A, I>::size_type initial_capacity,
+                                   It first, It last) {
+        using category = typename std::iterator_traits<It>::iterator_category;
+        static_assert(std::is_base_of_v<std::forward_iterator_tag, category>,
+                      "Bulk load requires forward iterators");
+        auto const count = std::size_t(std::distance(first, last));
+        if(count > std::size_t(detail::no_index))
+            return {make_error_code(storage_error::mismatch_file_size)};
+        auto const capacity = std::max(initial_capacity, size_type(count));
+        if(capacity == 0)
+            return {make_error_code(storage_error::file_size_is_too_small)};
+        auto* file = std::fopen(path.string().data(), "w+b");
+        if(file == nullptr)
+            return {std::error_code{int(errno), std::system_category()}};
+        std::fclose(file);
+        namespace fs = std::filesystem;
+        auto const storage_size = sizeof(detail::header) + capacity * sizeof(record_type);
+        auto ec = std::error_code{};
+        fs::resize_file(path, storage_size, ec);
+        if(!!ec)
+            return {ec};
+        auto expected_file = mapped_file::create(path);
+        if(!expected_file)
+            return {expected_file.error()};
+        auto* header = expected_file->cast<detail::header>(0);
+        auto* records = expected_file->cast<record_type>(sizeof(detail::header));
+        fill_records(records, first, count);
+        for(auto* record = records + count; record != records + capacity; ++record)
+            new(record) record_type{};
+        
+        if(fs::remove(redo_path_of(path), ec))
+            detail::sync_directory(path.parent_path());
+        auto target = storage{std::move(*expected_file), header, records, path};
+        ec = target.build(size_type(count), capacity);
+        if(!!ec)
+            return {ec};
+        target.mark_dirty(sizeof(detail::header), capacity * sizeof(record_type));
+        ec = target.checkpoint();
+        if(!!ec)
+            return {ec};
+        header->signature[0] = 0xDA;
+        header->signature[1] = 0x1A;
+        header->signature[2] = 0xF1;
+        header->signature[3] = 0x1E;
+        header->item_size = sizeof(V);
+        header->capacity = capacity;
+        header->flags = format_flags;
+        target.mark_dirty(0, sizeof(detail::header));
+        ec = target.checkpoint();
+        if(!!ec)
+            return {ec};
+        return {std::move(target)};
+    }
+    
+    
     template<typename K, typename V, class A, class I> typename storage<K, V, A, I>::expected
     storage<K, V, A, I>::open_or_create(std::filesystem::path const& path,
                                         size_type initial_capacity) {
@@ -507,41 +1808,337 @@ namespace persia {
                                 typename storage<K, V, A, I>::size_type initial_capacity) {
         namespace fs = std::filesystem;
         auto ec = std::error_code{};
-        fs::resize_file(path, sizeof(detail::header) + initial_capacity * sizeof(detail::record<V>), ec);
+        fs::resize_file(path, sizeof(detail::header) + initial_capacity * sizeof(record_type), ec);
         if(!!ec)
             return {ec};
         auto expected_file = mapped_file::create(path);
         if(!expected_file)
             return {expected_file.error()};
-        auto occupied_indices = I{};
-        occupied_indices.reserve(initial_capacity);
-        auto free_indices = std::vector<storage_index>{};
-        free_indices.reserve(initial_capacity);
         auto* header  = expected_file->cast<detail::header>(0);
-        auto* records = expected_file->cast<detail::record<V>>(sizeof(detail::header));
-        for(auto i = 0u; i != header->capacity; ++i) {
-            auto* record = records + i;
-            switch(record->marker) {
-            case detail::marker::empty:
-                free_indices.push_back(i);
+        auto* records = expected_file->cast<record_type>(sizeof(detail::header));
+        expected_file->will_need(sizeof(detail::header), header->capacity * sizeof(record_type));
+        auto target = storage{std::move(*expected_file), header, records, path};
+        ec = target.load(header->capacity, initial_capacity);
+        if(!!ec)
+            return {ec};
+        for(auto i = header->capacity; i != initial_capacity; ++i) {
+            new(records + i) record_type{};
+            target.free_indices_.push_back(i);
+        }
+        target.mark_dirty(0, sizeof(detail::header));
+        target.mark_dirty(sizeof(detail::header) + header->capacity * sizeof(record_type),
+                          (initial_capacity - header->capacity) * sizeof(record_type));
+        header->capacity = initial_capacity;
+        return {std::move(target)};
+    }
+    
+    
+    // Stages mutations and applies them all or none. Committed record images
+    // are made durable in a redo log first and replayed by open after crash.
+    template<typename K, typename V, class A, class I>
+    class storage<K, V, A, I>::transaction {
+    private:
+        
+        enum class operation_kind {
+            insert, insert_or_assign, erase
+        };
+        
+        struct operation {
+            operation_kind kind;
+            V value;
+            K key;
+        }; // operation
+        
+        storage* storage_;
+        std::vector<operation> operations_;
+        
+    public:
+        
+        explicit transaction(storage& target) noexcept
+            : storage_{&target} {
+        }
+        
+        
+        size_type size() const noexcept {
+            return size_type(operations_.size());
+        }
+        
+        
+        bool empty() const noexcept {
+            return operations_.empty();
+        }
+        
+        
+        void insert(V const& value) {
+            operations_.push_back(operation{operation_kind::insert, value, K{}});
+        }
+        
+        
+        void insert_or_assign(V const& value) {
+            operations_.push_back(operation{operation_kind::insert_or_assign, value, K{}});
+        }
+        
+        
+        void erase(K const& key) {
+            operations_.push_back(operation{operation_kind::erase, V{}, key});
+        }
+        
+        
+        void rollback() noexcept {
+            operations_.clear();
+        }
+        
+        
+        // Rejected if any operation would fail when applied in order
+        std::error_code commit();
+        
+    private:
+        
+        template<class S>
+        static bool distinct(S const& secondary,
+                             std::vector<detail::redo_entry<record_type>> const& images) {
+            if constexpr(!S::unique)
+                return true;
+            auto keys = std::unordered_set<typename S::key_type>{};
+            for(auto const& image: images)
+                if(image.record.marker == detail::marker::occupied
+                   && !keys.insert(secondary.key_of(image.record.data)).second)
+                    return false;
+            return true;
+        }
+    }; // storage::transaction
+    
+    
+    template<typename K, typename V, class A, class I>
+    std::error_code storage<K, V, A, I>::transaction::commit() {
+        static_assert(!versioned, "Transactions are not supported with multiversion records");
+        auto& target = *storage_;
+        auto images = std::vector<detail::redo_entry<record_type>>{};
+        auto touched = std::unordered_map<storage_index, std::size_t>{};
+        auto staged = std::unordered_map<K, storage_index>{};
+        auto taken = std::size_t(0);
+        
+        auto const locate = [&](K const& key) {
+            auto const staged_found = staged.find(key);
+            if(staged_found != staged.end())
+                return staged_found->second;
+            auto const found = target.occupied_indices_.find(key);
+            return found == target.occupied_indices_.end() ? detail::no_index : found->second;
+        };
+        auto const stage = [&](storage_index index, record_type const& record) {
+            auto const emplaced = touched.try_emplace(index, images.size());
+            if(emplaced.second)
+                images.push_back(detail::redo_entry<record_type>{index, 0, record});
+            else
+                images[emplaced.first->second].record = record;
+        };
+        auto const occupied = [](K const& key, V const& value) {
+            auto record = record_type{};
+            record.marker = detail::marker::occupied;
+            if constexpr(hashed)
+                record.hash = primary_indices::hash_of(key);
+            record.data = value;
+            return record;
+        };
+        auto const occupy = [&](K const& key, V const& value) {
+            if(taken == target.free_indices_.size())
+                return false;
+            ++taken;
+            auto const index = target.free_indices_[target.free_indices_.size() - taken];
+            staged[key] = index;
+            stage(index, occupied(key, value));
+            return true;
+        };
+        
+        auto rejected = false;
+        for(auto const& op: operations_) {
+            switch(op.kind) {
+            case operation_kind::insert: {
+                auto const key = A::key_of(op.value);
+                rejected = locate(key) != detail::no_index || !occupy(key, op.value);
+                break;
+            }
+            case operation_kind::insert_or_assign: {
+                auto const key = A::key_of(op.value);
+                auto const index = locate(key);
+                if(index == detail::no_index)
+                    rejected = !occupy(key, op.value);
+                else
+                    stage(index, occupied(key, op.value));
+                break;
+            }
+            case operation_kind::erase: {
+                auto const index = locate(op.key);
+                rejected = index == detail::no_index;
+                if(!rejected) {
+                    staged[op.key] = detail::no_index;
+                    stage(index, record_type{});
+                }
+                break;
+            }
+            }
+            if(rejected)
+                break;
+        }
+        
+        // Unique secondary keys are checked against untouched items and each other
+        auto const replaced = [&](storage_index other) { return touched.count(other) != 0; };
+        for(auto const& image: images)
+            if(!rejected && image.record.marker == detail::marker::occupied)
+                rejected = !target.admissible(image.record.data, replaced);
+        if(!rejected)
+            rejected = !std::apply([&](auto const&... secondary) {
+                return (distinct(secondary, images) && ...);
+            }, target.secondary_indices_);
+        
+        operations_.clear();
+        if(rejected)
+            return make_error_code(storage_error::transaction_rejected);
+        if(images.empty())
+            return {};
+        auto ec = target.write_redo(images);
+        if(!!ec)
+            return ec;
+        target.apply(images, taken);
+        ec = target.flush_records(images);
+        if(!!ec)
+            return ec;
+        // Truncated log is durable even if removal is not
+        auto* file = std::fopen(redo_path_of(target.path_).string().data(), "wb");
+        if(file == nullptr)
+            return {errno, std::system_category()};
+        ec = detail::sync(file);
+        std::fclose(file);
+        if(!!ec)
+            return ec;
+        if(std::filesystem::remove(redo_path_of(target.path_), ec))
+            detail::sync_directory(target.path_.parent_path());
+        return {};
+    }
+    
+    
+    template<typename K, typename V, class A, class I> std::error_code
+    storage<K, V, A, I>::write_redo(std::vector<detail::redo_entry<record_type>> const& images) const {
+        auto* file = std::fopen(redo_path_of(path_).string().data(), "wb");
+        if(file == nullptr)
+            return {errno, std::system_category()};
+        auto const bytes = images.size() * sizeof(detail::redo_entry<record_type>);
+        auto commit = detail::redo_commit{};
+        std::memcpy(commit.signature, detail::redo_signature, sizeof(commit.signature));
+        commit.count = std::uint32_t(images.size());
+        commit.checksum = detail::checksum(images.data(), bytes);
+        if(std::fwrite(images.data(), 1, bytes, file) != bytes
+           || std::fwrite(&commit, sizeof(commit), 1, file) != 1) {
+            auto const code = errno;
+            std::fclose(file);
+            return {code, std::system_category()};
+        }
+        auto ec = detail::sync(file);
+        std::fclose(file);
+        if(!!ec)
+            return ec;
+        // Commit record is durable only with the directory entry of the log
+        return detail::sync_directory(path_.parent_path());
+    }
+    
+    
+    // Touched records are unindexed first, so keys may move between them
+    template<typename K, typename V, class A, class I> void
+    storage<K, V, A, I>::apply(std::vector<detail::redo_entry<record_type>> const& images,
+                               std::size_t taken) {
+        for(auto const& image: images) {
+            auto* record = records_ + image.index;
+            if(record->marker != detail::marker::occupied)
                 continue;
-            case detail::marker::occupied:
-                occupied_indices[A::key_of(record->data)] = i;
+            auto const key = A::key_of(record->data);
+            unindex_record(image.index);
+            occupied_indices_.erase(occupied_indices_.find(key));
+            filter_erased();
+            if(image.record.marker != detail::marker::occupied)
+                log_change(change_kind::erase, key);
+        }
+        free_indices_.resize(free_indices_.size() - taken);
+        for(auto const& image: images) {
+            auto* record = records_ + image.index;
+            *record = image.record;
+            mark_dirty(image.index);
+            if(record->marker != detail::marker::occupied) {
+                free_indices_.push_back(image.index);
                 continue;
-            default:
-                return {make_error_code(storage_error::file_is_corrupted)};
             }
+            occupied_indices_.try_emplace(A::key_of(record->data), image.index);
+            index_record(image.index);
+            log_change(change_kind::assign, A::key_of(record->data), record->data);
         }
-        for(auto i = header->capacity; i != initial_capacity; ++i) {
-            new(records + i) detail::record<V>{};
-            free_indices.push_back(i);
+        publish();
+    }
+    
+    
+    template<typename K, typename V, class A, class I> std::error_code
+    storage<K, V, A, I>::flush_records(std::vector<detail::redo_entry<record_type>> const& images) const {
+        auto offsets = std::vector<std::size_t>{};
+        offsets.reserve(images.size());
+        for(auto const& image: images)
+            offsets.push_back(sizeof(detail::header) + image.index * sizeof(record_type));
+        std::sort(offsets.begin(), offsets.end());
+        auto const page = mapped_file::page_size();
+        auto extents = std::vector<mapped_file::extent>{};
+        for(auto first = offsets.begin(); first != offsets.end();) {
+            // Records on the same or adjacent pages are flushed together
+            auto end = *first + sizeof(record_type);
+            auto last = first + 1;
+            for(; last != offsets.end() && *last / page <= end / page + 1; ++last)
+                end = *last + sizeof(record_type);
+            extents.push_back(mapped_file::extent{*first, end - *first});
+            first = last;
         }
-        header->capacity = initial_capacity;
-        return {storage{std::move(occupied_indices),
-                        std::move(free_indices),
-                        std::move(*expected_file),
-                        header,
-                        records}};
+        return mapped_file_.flush_extents(extents.data(), extents.size());
+    }
+    
+    
+    template<typename K, typename V, class A, class I> std::error_code
+    storage<K, V, A, I>::recover(std::filesystem::path const& path,
+                                 mapped_file& file,
+                                 record_type* records,
+                                 size_type capacity) {
+        namespace fs = std::filesystem;
+        auto const redo_path = redo_path_of(path);
+        auto ec = std::error_code{};
+        if(!fs::exists(redo_path, ec))
+            return ec;
+        auto const size = fs::file_size(redo_path, ec);
+        if(!!ec)
+            return ec;
+        using entry = detail::redo_entry<record_type>;
+        if(size >= sizeof(detail::redo_commit)
+           && (size - sizeof(detail::redo_commit)) % sizeof(entry) == 0) {
+            auto images = std::vector<entry>((size - sizeof(detail::redo_commit)) / sizeof(entry));
+            auto commit = detail::redo_commit{};
+            auto* redo = std::fopen(redo_path.string().data(), "rb");
+            if(redo == nullptr)
+                return {errno, std::system_category()};
+            auto const bytes = images.size() * sizeof(entry);
+            auto const read = std::fread(images.data(), 1, bytes, redo) == bytes
+                && std::fread(&commit, sizeof(commit), 1, redo) == 1;
+            std::fclose(redo);
+            // Log without valid commit record was never applied
+            if(read
+               && std::memcmp(commit.signature, detail::redo_signature, sizeof(commit.signature)) == 0
+               && commit.count == images.size()
+               && commit.checksum == detail::checksum(images.data(), bytes)) {
+                for(auto const& image: images)
+                    if(image.index >= capacity)
+                        return make_error_code(storage_error::file_is_corrupted);
+                for(auto const& image: images)
+                    records[image.index] = image.record;
+                ec = file.flush();
+                if(!!ec)
+                    return ec;
+            }
+        }
+        if(fs::remove(redo_path, ec))
+            return detail::sync_directory(path.parent_path());
+        return ec;
     }
 
 
@@ -0,0 +1,546 @@
+// This file is part of persia library
+// Copyright 2022 Andrei Ilin <ortfero@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <persia/mapped_file.hpp>
+#include <persia/span.hpp>
+
+
+namespace persia {
+
+
+    enum class time_series_error {
+        ok,
+        invalid_file_signature,
+        mismatch_file_size,
+        mismatch_item_size,
+        mismatch_chunk_capacity,
+        missing_chunk,
+        out_of_order
+    }; // time_series_error
+
+
+    class time_series_error_category : public std::error_category {
+
+        char const* name() const noexcept override {
+            return "time_series";
+        }
+
+        std::string message(int code) const noexcept override {
+            switch(time_series_error(code)) {
+            case time_series_error::ok:
+                return "Ok";
+            case time_series_error::invalid_file_signature:
+                return "Invalid time series chunk signature";
+            case time_series_error::mismatch_file_size:
+                return "Mismatch file size";
+            case time_series_error::mismatch_item_size:
+                return "Mismatch item size";
+            case time_series_error::mismatch_chunk_capacity:
+                return "Mismatch chunk capacity";
+            case time_series_error::missing_chunk:
+                return "Time series chunk is missing";
+            case time_series_error::out_of_order:
+                return "Item is older than the last one";
+            default:
+                return "Unknown";
+            }
+        }
+    };
+
+
+    inline time_series_error_category const time_series_error_category;
+
+
+    inline std::error_code make_error_code(time_series_error e) noexcept {
+        return {int(e), time_series_error_category};
+    }
+
+} // namespace persia
+
+
+namespace std {
+
+    template <> struct is_error_code_enum<persia::time_series_error> : true_type {};
+
+} // std
+
+
+namespace persia {
+
+
+    namespace detail {
+
+        struct alignas(8) chunk_header {
+            unsigned char signature[4];
+            std::uint32_t item_size{0};
+            std::uint32_t capacity{0};
+            std::uint32_t size{0};
+            std::uint64_t number{0};
+            std::int64_t min_time{0};
+            std::int64_t max_time{0};
+        }; // chunk_header
+
+
+        inline constexpr unsigned char chunk_signature[4] = {0x71, 0x3E, 0x5E, 0x12};
+
+    } // namespace detail
+
+
+    // Items ordered by time kept in a directory of fixed capacity chunk files
+    // numbered consecutively. Every chunk records the time range of its items,
+    // so queries skip chunks out of range without touching them. Only the
+    // last chunk is mapped on open, others are mapped by the first query
+    // reaching them. Items are appended by a single writer in non decreasing
+    // order of time.
+    template<typename T, class Adapter = T> class time_series {
+    public:
+
+        using value_type = T;
+        using size_type = std::uint32_t;
+
+        static_assert(std::is_trivially_copyable_v<T>, "T should be trivially copyable");
+
+        class expected;
+
+        static expected create(std::filesystem::path const& directory, size_type chunk_capacity);
+        static expected open(std::filesystem::path const& directory);
+        static expected open_or_create(std::filesystem::path const& directory, size_type chunk_capacity);
+
+    private:
+
+        // Time range and size are copies of the chunk header, so unmapped
+        // chunks are pruned without faulting their pages in
+        struct chunk {
+            std::uint64_t number;
+            std::int64_t min_time;
+            std::int64_t max_time;
+            size_type size;
+            mapped_file file;
+            detail::chunk_header* header;
+            T* items;
+        }; // chunk
+
+        std::filesystem::path directory_;
+        size_type chunk_capacity_{0};
+        std::deque<chunk> chunks_;
+        std::uint64_t size_{0};
+        std::int64_t last_time_{0};
+        std::uint64_t unflushed_{0};
+
+        time_series(std::filesystem::path const& directory, size_type chunk_capacity) noexcept
+            : directory_{directory}, chunk_capacity_{chunk_capacity} {
+        }
+
+
+        static std::int64_t time_of(T const& item) noexcept {
+            return std::int64_t(Adapter::time_of(item));
+        }
+
+    public:
+
+        time_series() noexcept = default;
+        time_series(time_series const&) = delete;
+        time_series& operator = (time_series const&) = delete;
+        time_series(time_series&&) noexcept = default;
+        time_series& operator = (time_series&&) noexcept = default;
+
+        explicit operator bool () const noexcept {
+            return !chunks_.empty();
+        }
+
+
+        size_type chunk_capacity() const noexcept {
+            return chunk_capacity_;
+        }
+
+
+        size_type chunk_count() const noexcept {
+            return size_type(chunks_.size());
+        }
+
+
+        size_type mapped_chunk_count() const noexcept {
+            return size_type(std::count_if(chunks_.begin(), chunks_.end(),
+                                           [](chunk const& each) { return !!each.file; }));
+        }
+
+
+        std::uint64_t size() const noexcept {
+            return size_;
+        }
+
+
+        bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+
+        // Time of the oldest item, undefined if empty
+        std::int64_t front_time() const noexcept {
+            return chunks_.front().min_time;
+        }
+
+
+        // Time of the latest item, undefined if empty
+        std::int64_t back_time() const noexcept {
+            return last_time_;
+        }
+
+
+        std::error_code append(T const& item) {
+            return append(span<T const>{&item, 1});
+        }
+
+
+        // Batch is rejected entirely if any item is older than its predecessor
+        std::error_code append(span<T const> items) {
+            if(items.empty())
+                return {};
+            auto previous = empty() ? time_of(items[0]) : last_time_;
+            for(auto const& each: items) {
+                auto const time = time_of(each);
+                if(time < previous)
+                    return make_error_code(time_series_error::out_of_order);
+                previous = time;
+            }
+            while(!items.empty()) {
+                if(chunks_.back().size == chunk_capacity_) {
+                    auto const ec = add_chunk(chunks_.back().number + 1);
+                    if(!!ec)
+                        return ec;
+                }
+                auto& last = chunks_.back();
+                auto const count = std::min<std::size_t>(items.size(), chunk_capacity_ - last.size);
+                std::memcpy(last.items + last.size, items.data(), count * sizeof(T));
+                if(last.size == 0)
+                    last.header->min_time = last.min_time = time_of(items[0]);
+                last.header->max_time = last.max_time = time_of(items[count - 1]);
+                last.size += size_type(count);
+                last.header->size = last.size;
+                size_ += count;
+                last_time_ = last.max_time;
+                items = items.subspan(count, items.size() - count);
+            }
+            return {};
+        }
+
+
+        // Appends to 'spans' items with time in [from, to), one span per
+        // chunk in time order. Spans stay valid until 'release' or 'truncate'.
+        std::error_code range(std::int64_t from, std::int64_t to, std::vector<span<T const>>& spans) {
+            if(from >= to)
+                return {};
+            // Only the last chunk may be empty, it's left out of the search
+            auto const end = chunks_.end() - (chunks_.back().size == 0 ? 1 : 0);
+            auto it = std::partition_point(chunks_.begin(), end,
+                                           [from](chunk const& each) { return each.max_time < from; });
+            for(; it != end && it->min_time < to; ++it) {
+                if(!it->file) {
+                    auto const ec = map_chunk(*it);
+                    if(!!ec)
+                        return ec;
+                }
+                auto const* first = it->items;
+                auto const* last = first + it->size;
+                if(it->min_time < from)
+                    first = std::partition_point(first, last,
+                                                 [from](T const& item) { return time_of(item) < from; });
+                if(it->max_time >= to)
+                    last = std::partition_point(first, last,
+                                                [to](T const& item) { return time_of(item) < to; });
+                if(first != last)
+                    spans.emplace_back(first, std::size_t(last - first));
+            }
+            return {};
+        }
+
+
+        // Unmaps chunks mapped by queries, except the last one and ones not
+        // flushed yet
+        void release() noexcept {
+            for(auto& each: chunks_)
+                if(each.number < unflushed_)
+                    unmap_chunk(each);
+        }
+
+
+        // Deletes chunks holding only items older than 'time', the last chunk
+        // is kept
+        std::error_code truncate(std::int64_t time) {
+            while(chunks_.size() > 1 && chunks_.front().max_time < time) {
+                size_ -= chunks_.front().size;
+                auto const path = chunk_path(directory_, chunks_.front().number);
+                chunks_.pop_front();
+                auto ec = std::error_code{};
+                std::filesystem::remove(path, ec);
+                if(!!ec)
+                    return ec;
+            }
+            return {};
+        }
+
+
+        // Syncs chunks appended to since the previous flush
+        std::error_code flush() noexcept {
+            for(auto& each: chunks_) {
+                if(each.number < unflushed_)
+                    continue;
+                auto const ec = each.file.flush();
+                if(!!ec)
+                    return ec;
+            }
+            unflushed_ = chunks_.back().number;
+            return {};
+        }
+
+    private:
+
+        static std::filesystem::path chunk_path(std::filesystem::path const& directory,
+                                                std::uint64_t number) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "%020llu.chunk", static_cast<unsigned long long>(number));
+            return directory / name;
+        }
+
+
+        static std::size_t chunk_size(size_type capacity) noexcept {
+            return sizeof(detail::chunk_header) + std::size_t(capacity) * sizeof(T);
+        }
+
+
+        std::error_code check_header(detail::chunk_header const& header, std::uint64_t number) noexcept {
+            if(std::memcmp(header.signature, detail::chunk_signature, sizeof(header.signature)) != 0)
+                return make_error_code(time_series_error::invalid_file_signature);
+            if(header.item_size != sizeof(T))
+                return make_error_code(time_series_error::mismatch_item_size);
+            if(chunk_capacity_ == 0)
+                chunk_capacity_ = header.capacity;
+            if(header.capacity != chunk_capacity_ || header.number != number || header.size > header.capacity)
+                return make_error_code(time_series_error::mismatch_chunk_capacity);
+            return {};
+        }
+
+
+        // Chunk is prepared under temporary name, so a crash never leaves
+        // partially initialized chunk
+        std::error_code add_chunk(std::uint64_t number) {
+            namespace fs = std::filesystem;
+            auto const path = chunk_path(directory_, number);
+            auto temporary = path;
+            temporary += ".tmp";
+            auto* file = std::fopen(temporary.string().data(), "w+b");
+            if(file == nullptr)
+                return {int(errno), std::system_category()};
+            std::fclose(file);
+            auto ec = std::error_code{};
+            fs::resize_file(temporary, chunk_size(chunk_capacity_), ec);
+            if(!!ec)
+                return ec;
+            {
+                auto expected_file = mapped_file::create(temporary);
+                if(!expected_file)
+                    return expected_file.error();
+                auto* header = expected_file->cast<detail::chunk_header>(0);
+                std::memcpy(header->signature, detail::chunk_signature, sizeof(header->signature));
+                header->item_size = sizeof(T);
+                header->capacity = chunk_capacity_;
+                header->number = number;
+            }
+            fs::rename(temporary, path, ec);
+            if(!!ec)
+                return ec;
+            chunks_.push_back(chunk{number, 0, 0, 0, mapped_file{}, nullptr, nullptr});
+            return map_chunk(chunks_.back());
+        }
+
+
+        // Reads only the header of a chunk
+        std::error_code peek_chunk(std::uint64_t number) {
+            auto* file = std::fopen(chunk_path(directory_, number).string().data(), "rb");
+            if(file == nullptr)
+                return {int(errno), std::system_category()};
+            auto header = detail::chunk_header{};
+            auto const read = std::fread(&header, sizeof(header), 1, file);
+            std::fclose(file);
+            if(read != 1)
+                return make_error_code(time_series_error::mismatch_file_size);
+            auto const ec = check_header(header, number);
+            if(!!ec)
+                return ec;
+            chunks_.push_back(chunk{number, header.min_time, header.max_time, header.size,
+                                    mapped_file{}, nullptr, nullptr});
+            size_ += header.size;
+            if(header.size != 0)
+                last_time_ = header.max_time;
+            return {};
+        }
+
+
+        std::error_code map_chunk(chunk& target) {
+            auto expected_file = mapped_file::create(chunk_path(directory_, target.number));
+            if(!expected_file)
+                return expected_file.error();
+            if(expected_file->size() < sizeof(detail::chunk_header))
+                return make_error_code(time_series_error::mismatch_file_size);
+            auto* header = expected_file->template cast<detail::chunk_header>(0);
+            auto const ec = check_header(*header, target.number);
+            if(!!ec)
+                return ec;
+            if(expected_file->size() != chunk_size(chunk_capacity_))
+                return make_error_code(time_series_error::mismatch_file_size);
+            target.header = header;
+            target.items = expected_file->template cast<T>(sizeof(detail::chunk_header));
+            target.file = std::move(*expected_file);
+            return {};
+        }
+
+
+        void unmap_chunk(chunk& target) noexcept {
+            if(&target == &chunks_.back())
+                return;
+            target.file = mapped_file{};
+            target.header = nullptr;
+            target.items = nullptr;
+        }
+    }; // time_series
+
+
+    template<typename T, class A> class time_series<T, A>::expected {
+    private:
+        std::error_code error_code_;
+        time_series series_;
+
+    public:
+
+        expected(std::error_code ec)
+            : error_code_{ec} {
+        }
+
+
+        expected(time_series&& s)
+            : series_(std::move(s)) {
+        }
+
+
+        explicit operator bool () const noexcept {
+            return !!series_;
+        }
+
+
+        time_series& operator * () & noexcept {
+            return series_;
+        }
+
+
+        time_series&& operator * () && noexcept {
+            return std::move(series_);
+        }
+
+
+        time_series* operator -> () noexcept {
+            return &series_;
+        }
+
+
+        std::error_code error() const noexcept {
+            return error_code_;
+        }
+    }; // time_series::expected
+
+
+    // Chunks of previous series in the directory are deleted
+    template<typename T, class A> typename time_series<T, A>::expected
+    time_series<T, A>::create(std::filesystem::path const& directory, size_type chunk_capacity) {
+        namespace fs = std::filesystem;
+        if(chunk_capacity == 0)
+            return {make_error_code(time_series_error::mismatch_chunk_capacity)};
+        auto ec = std::error_code{};
+        fs::create_directories(directory, ec);
+        if(!!ec)
+            return {ec};
+        for(auto const& entry: fs::directory_iterator{directory, ec}) {
+            auto const extension = entry.path().extension();
+            if(extension == ".chunk" || extension == ".tmp")
+                fs::remove(entry.path(), ec);
+            if(!!ec)
+                return {ec};
+        }
+        if(!!ec)
+            return {ec};
+        auto target = time_series{directory, chunk_capacity};
+        ec = target.add_chunk(0);
+        if(!!ec)
+            return {ec};
+        return {std::move(target)};
+    }
+
+
+    template<typename T, class A> typename time_series<T, A>::expected
+    time_series<T, A>::open(std::filesystem::path const& directory) {
+        namespace fs = std::filesystem;
+        auto ec = std::error_code{};
+        auto numbers = std::vector<std::uint64_t>{};
+        for(auto const& entry: fs::directory_iterator{directory, ec}) {
+            if(entry.path().extension() != ".chunk")
+                continue;
+            auto const stem = entry.path().stem().string();
+            char* end = nullptr;
+            auto const number = std::strtoull(stem.data(), &end, 10);
+            if(end != stem.data() + stem.size())
+                continue;
+            numbers.push_back(number);
+        }
+        if(!!ec)
+            return {ec};
+        if(numbers.empty())
+            return {make_error_code(time_series_error::missing_chunk)};
+        std::sort(numbers.begin(), numbers.end());
+        auto target = time_series{directory, 0};
+        for(auto i = std::size_t(0); i != numbers.size(); ++i) {
+            if(i != 0 && numbers[i] != numbers[i - 1] + 1)
+                return {make_error_code(time_series_error::missing_chunk)};
+            ec = target.peek_chunk(numbers[i]);
+            if(!!ec)
+                return {ec};
+        }
+        ec = target.map_chunk(target.chunks_.back());
+        if(!!ec)
+            return {ec};
+        target.unflushed_ = numbers.back();
+        return {std::move(target)};
+    }
+
+
+    template<typename T, class A> typename time_series<T, A>::expected
+    time_series<T, A>::open_or_create(std::filesystem::path const& directory, size_type chunk_capacity) {
+        auto ec = std::error_code{};
+        if(!std::filesystem::exists(directory, ec)) {
+            if(!!ec)
+                return {ec};
+            return create(directory, chunk_capacity);
+        }
+        auto expected_series = open(directory);
+        if(!!expected_series || expected_series.error() != time_series_error::missing_chunk)
+            return expected_series;
+        return create(directory, chunk_capacity);
+    }
+
+
+} // namespace persia
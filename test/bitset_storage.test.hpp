@@ -0,0 +1,136 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include <persia/bitset_storage.hpp>
+
+
+inline std::vector<std::uint32_t> values_of(persia::bitset_storage const& storage) {
+    return std::vector<std::uint32_t>(storage.begin(), storage.end());
+}
+
+
+TEST_SUITE("bitset_storage") {
+
+    SCENARIO("inserting to bitset storage") {
+        auto expected_target = persia::bitset_storage::create("ids.pbits");
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->empty());
+        REQUIRE(expected_target->begin() == expected_target->end());
+        // Dense container turns into bitmap, sparse ones stay arrays
+        for(auto i = std::uint32_t(0); i != 10000; ++i)
+            REQUIRE(expected_target->insert(i * 3));
+        for(auto i = std::uint32_t(0); i != 100; ++i)
+            REQUIRE(expected_target->insert(0xFFFF0000u + i * 600));
+        REQUIRE(!expected_target->insert(3));
+        REQUIRE_EQ(expected_target->size(), 10100);
+        REQUIRE(expected_target->contains(29997));
+        REQUIRE(!expected_target->contains(29998));
+        REQUIRE(expected_target->contains(0xFFFF0000u + 59400));
+        REQUIRE(!expected_target->contains(0x12345678u));
+        REQUIRE_EQ(expected_target->rank(0), 1);
+        REQUIRE_EQ(expected_target->rank(29999), 10000);
+        REQUIRE_EQ(expected_target->rank(0xFFFF0000u + 600), 10002);
+        REQUIRE_EQ(expected_target->rank(0xFFFFFFFFu), 10100);
+        REQUIRE_EQ(*expected_target->select(0), 0);
+        REQUIRE_EQ(*expected_target->select(9999), 29997);
+        REQUIRE_EQ(*expected_target->select(10001), 0xFFFF0000u + 600);
+        REQUIRE(!expected_target->select(10100));
+        auto const values = values_of(*expected_target);
+        REQUIRE_EQ(values.size(), std::size_t(10100));
+        REQUIRE_EQ(values[9999], 29997);
+        REQUIRE_EQ(values.back(), 0xFFFF0000u + 59400);
+        REQUIRE(!expected_target->flush());
+    }
+
+
+    SCENARIO("erasing from reopened bitset storage") {
+        auto expected_target = persia::bitset_storage::open("ids.pbits");
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->size(), 10100);
+        for(auto i = std::uint32_t(0); i != 10000; i += 2)
+            REQUIRE(expected_target->erase(i * 3));
+        REQUIRE(!expected_target->erase(0));
+        REQUIRE_EQ(expected_target->size(), 5100);
+        REQUIRE(expected_target->contains(3));
+        REQUIRE(!expected_target->contains(6));
+        REQUIRE_EQ(*expected_target->select(0), 3);
+        REQUIRE_EQ(expected_target->rank(29997), 5000);
+        for(auto i = std::uint32_t(0); i != 100; ++i)
+            REQUIRE(expected_target->erase(0xFFFF0000u + i * 600));
+        for(auto i = std::uint32_t(1); i < 10000; i += 2)
+            REQUIRE(expected_target->erase(i * 3));
+        REQUIRE(expected_target->empty());
+        REQUIRE(expected_target->begin() == expected_target->end());
+        for(auto i = std::uint32_t(0); i != 10000; ++i)
+            REQUIRE(expected_target->insert(i * 3));
+        // Released units are reused by the next round
+        auto const allocated = expected_target->allocated_bytes();
+        for(auto i = std::uint32_t(0); i != 10000; ++i)
+            REQUIRE(expected_target->erase(i * 3));
+        for(auto i = std::uint32_t(0); i != 10000; ++i)
+            REQUIRE(expected_target->insert(i * 3));
+        REQUIRE_EQ(expected_target->allocated_bytes(), allocated);
+        expected_target->clear();
+        REQUIRE(expected_target->empty());
+        REQUIRE(!expected_target->contains(3));
+    }
+
+
+    SCENARIO("combining bitset storages") {
+        auto expected_lhs = persia::bitset_storage::create("lhs.pbits");
+        auto expected_rhs = persia::bitset_storage::create("rhs.pbits");
+        REQUIRE(!!expected_lhs);
+        REQUIRE(!!expected_rhs);
+        auto lhs = std::set<std::uint32_t>{};
+        auto rhs = std::set<std::uint32_t>{};
+        auto seed = std::uint32_t(12345);
+        auto const next = [&seed] {
+            seed = seed * 1664525u + 1013904223u;
+            return seed % 400000u;
+        };
+        for(auto i = 0; i != 60000; ++i) {
+            auto const value = next();
+            lhs.insert(value);
+            expected_lhs->insert(value);
+        }
+        for(auto i = 0; i != 3000; ++i) {
+            auto const value = next() * 7;
+            rhs.insert(value);
+            expected_rhs->insert(value);
+        }
+        auto merged = lhs;
+        merged.insert(rhs.begin(), rhs.end());
+        auto common = std::vector<std::uint32_t>{};
+        std::set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::back_inserter(common));
+        auto difference = std::vector<std::uint32_t>{};
+        std::set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::back_inserter(difference));
+
+        auto expected_target = persia::bitset_storage::create("target.pbits");
+        REQUIRE(expected_target->merge(*expected_lhs));
+        REQUIRE_EQ(values_of(*expected_target), std::vector<std::uint32_t>(lhs.begin(), lhs.end()));
+        REQUIRE(expected_target->merge(*expected_rhs));
+        REQUIRE_EQ(expected_target->size(), merged.size());
+        REQUIRE_EQ(values_of(*expected_target), std::vector<std::uint32_t>(merged.begin(), merged.end()));
+        expected_target->subtract(*expected_rhs);
+        REQUIRE_EQ(values_of(*expected_target), difference);
+        // Prefix sums follow containers changed by set operations
+        auto ranked = true;
+        for(auto i = std::size_t(0); i < difference.size(); i += 97)
+            ranked = ranked && expected_target->rank(difference[i]) == i + 1
+                && *expected_target->select(i) == difference[i];
+        REQUIRE(ranked);
+        REQUIRE_EQ(expected_target->rank(0xFFFFFFFFu), difference.size());
+        expected_lhs->intersect(*expected_rhs);
+        REQUIRE_EQ(expected_lhs->size(), common.size());
+        REQUIRE_EQ(values_of(*expected_lhs), common);
+        expected_lhs->subtract(*expected_lhs);
+        REQUIRE(expected_lhs->empty());
+    }
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <persia/cache.hpp>
+
+
+struct page {
+    std::uint64_t number;
+    int hits;
+
+    static std::uint64_t key_of(page const& page) noexcept {
+        return page.number;
+    }
+};
+
+using page_cache = persia::cache<std::uint64_t, page>;
+
+
+TEST_SUITE("cache") {
+
+    SCENARIO("evicting items not used recently") {
+        auto expected_cache = page_cache::create("pages.pcache", 4);
+        REQUIRE(!!expected_cache);
+        REQUIRE(expected_cache->empty());
+        for(auto i = 1; i != 5; ++i)
+            REQUIRE(expected_cache->insert(page{std::uint64_t(i), 0}));
+        REQUIRE(!expected_cache->insert(page{1, 0}));
+        REQUIRE(!!expected_cache->find(1));
+        REQUIRE(!!expected_cache->find(3));
+        REQUIRE(!expected_cache->find(7));
+        REQUIRE(expected_cache->insert(page{5, 0}));
+        REQUIRE_EQ(expected_cache->evictions(), 1);
+        REQUIRE_EQ(expected_cache->size(), 4);
+        REQUIRE(!expected_cache->contains(2));
+        REQUIRE(expected_cache->contains(1));
+        REQUIRE(expected_cache->contains(3));
+        REQUIRE(!expected_cache->flush());
+    }
+
+
+    SCENARIO("reopening cache warm") {
+        auto expected_cache = page_cache::open("pages.pcache");
+        REQUIRE(!!expected_cache);
+        REQUIRE_EQ(expected_cache->size(), 4);
+        REQUIRE_EQ(expected_cache->capacity(), 4);
+        // Hand resumes after the evicted record and spares referenced one
+        REQUIRE(expected_cache->insert(page{6, 0}));
+        REQUIRE(!expected_cache->contains(4));
+        REQUIRE(expected_cache->contains(3));
+        REQUIRE(expected_cache->insert_or_assign(page{5, 50}));
+        REQUIRE_EQ(expected_cache->find(5)->hits, 50);
+        REQUIRE(expected_cache->erase(1));
+        REQUIRE(!expected_cache->erase(1));
+        REQUIRE(expected_cache->insert(page{7, 0}));
+        REQUIRE_EQ(expected_cache->evictions(), 1);
+        expected_cache->clear();
+        REQUIRE(expected_cache->empty());
+    }
+
+
+    SCENARIO("finding in cache concurrently") {
+        constexpr int threads = 4;
+        constexpr int pages = 1000;
+        auto expected_cache = page_cache::create("pages.pcache", pages);
+        REQUIRE(!!expected_cache);
+        for(auto i = 0; i != pages; ++i)
+            REQUIRE(expected_cache->insert(page{std::uint64_t(i), i}));
+        auto& target = *expected_cache;
+        auto workers = std::vector<std::thread>{};
+        auto found = std::vector<int>(threads, 0);
+        for(auto t = 0; t != threads; ++t)
+            workers.emplace_back([&target, &found, t] {
+                for(auto i = 0; i != pages; i += 2)
+                    if(target.find(std::uint64_t(i)) != nullptr)
+                        ++found[t];
+            });
+        for(auto& each: workers)
+            each.join();
+        for(auto t = 0; t != threads; ++t)
+            REQUIRE_EQ(found[t], pages / 2);
+        // Only odd pages are evicted while the hand clears reference bits
+        for(auto i = pages; i != pages + pages / 2; ++i)
+            REQUIRE(expected_cache->insert(page{std::uint64_t(i), i}));
+        auto even = true;
+        for(auto i = 0; i != pages; i += 2)
+            even = even && expected_cache->contains(std::uint64_t(i));
+        REQUIRE(even);
+    }
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <persia/change_log.hpp>
+#include <persia/storage.hpp>
+
+
+struct quote {
+    int instrument;
+    int price;
+
+    static int key_of(quote const& quote) noexcept {
+        return quote.instrument;
+    }
+};
+
+using quote_storage = persia::storage<int, quote>;
+using quote_log = persia::change_log<int, quote>;
+
+
+inline std::vector<std::pair<int, int>> contents_of(quote_storage const& storage) {
+    auto contents = std::vector<std::pair<int, int>>{};
+    for(auto const& each: storage)
+        contents.emplace_back(each.instrument, each.price);
+    std::sort(contents.begin(), contents.end());
+    return contents;
+}
+
+
+TEST_SUITE("change_log") {
+
+    SCENARIO("following storage through change log") {
+        auto expected_log = quote_log::create("quotes.log", 64);
+        REQUIRE(!!expected_log);
+        auto expected_primary = quote_storage::create("primary.pmap", 16);
+        REQUIRE(!!expected_primary);
+        expected_primary->attach(*expected_log);
+        REQUIRE(expected_primary->insert(quote{1, 100}));
+        REQUIRE(expected_primary->insert(quote{2, 200}));
+        REQUIRE(expected_primary->insert_or_assign(quote{1, 101}));
+        REQUIRE(expected_primary->erase(2));
+        auto transaction = quote_storage::transaction{*expected_primary};
+        transaction.insert(quote{3, 300});
+        transaction.erase(1);
+        REQUIRE(!transaction.commit());
+        REQUIRE_EQ(expected_log->head(), 6);
+
+        auto expected_standby = quote_storage::create("standby.pmap", 16);
+        REQUIRE(!!expected_standby);
+        auto follower = persia::follower<quote_storage>{*expected_log, *expected_standby};
+        REQUIRE_EQ(follower.lag(), 6);
+        REQUIRE(!follower.poll());
+        REQUIRE_EQ(follower.applied(), 6);
+        REQUIRE_EQ(contents_of(*expected_standby), contents_of(*expected_primary));
+
+        expected_primary->clear();
+        REQUIRE(expected_primary->insert(quote{4, 400}));
+        REQUIRE(!follower.poll());
+        REQUIRE_EQ(follower.lag(), 0);
+        REQUIRE_EQ(contents_of(*expected_standby), std::vector<std::pair<int, int>>{{4, 400}});
+    }
+
+
+    SCENARIO("opening change log") {
+        auto expected_log = quote_log::open("quotes.log");
+        REQUIRE(!!expected_log);
+        REQUIRE_EQ(expected_log->capacity(), 64);
+        REQUIRE_EQ(expected_log->head(), 8);
+        auto entry = quote_log::entry{};
+        REQUIRE(expected_log->read(8, entry));
+        REQUIRE_EQ(entry.kind, persia::change_kind::insert);
+        REQUIRE_EQ(entry.value.price, 400);
+        REQUIRE(!expected_log->read(9, entry));
+        struct depth {
+            int instrument;
+            int prices[4];
+        };
+        auto expected_other = persia::change_log<int, depth>::open("quotes.log");
+        REQUIRE_EQ(expected_other.error(), persia::change_log_error::mismatch_item_size);
+    }
+
+
+    SCENARIO("falling behind change log") {
+        auto expected_log = quote_log::create("quotes.log", 4);
+        REQUIRE(!!expected_log);
+        auto expected_primary = quote_storage::create("primary.pmap", 16);
+        REQUIRE(!!expected_primary);
+        auto expected_standby = quote_storage::create("standby.pmap", 16);
+        REQUIRE(!!expected_standby);
+        expected_primary->attach(*expected_log);
+        auto follower = persia::follower<quote_storage>{*expected_log, *expected_standby};
+        for(auto i = 0; i != 6; ++i)
+            REQUIRE(expected_primary->insert(quote{i, i}));
+        REQUIRE_EQ(follower.poll(), persia::change_log_error::change_log_overrun);
+        REQUIRE_EQ(follower.applied(), 0);
+        auto entry = quote_log::entry{};
+        REQUIRE(!expected_log->read(1, entry));
+        REQUIRE(expected_log->read(6, entry));
+    }
+
+}
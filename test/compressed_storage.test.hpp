@@ -0,0 +1,102 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <persia/compressed_storage.hpp>
+
+
+struct account {
+    std::uint64_t id;
+    std::int64_t balance;
+    std::uint32_t flags;
+    char note[108];
+
+    static std::uint64_t key_of(account const& account) noexcept {
+        return account.id;
+    }
+};
+
+using account_storage = persia::compressed_storage<std::uint64_t, account>;
+using small_block_account_storage = persia::compressed_storage<std::uint64_t, account, account, 4096>;
+
+
+TEST_SUITE("compressed_storage") {
+
+    SCENARIO("compressing by lz codec") {
+        auto source = std::vector<unsigned char>(20000);
+        for(auto i = std::size_t(0); i != source.size(); ++i)
+            source[i] = i % 1000 < 600 ? 0 : static_cast<unsigned char>(i * 2654435761u >> 13);
+        auto compressed = std::vector<unsigned char>(source.size());
+        auto const size = persia::lz::compress(source.data(), source.size(), compressed.data(), compressed.size());
+        REQUIRE_NE(size, 0);
+        REQUIRE_LT(size, source.size() / 2);
+        auto restored = std::vector<unsigned char>(source.size());
+        auto decompressed = std::size_t(0);
+        REQUIRE(persia::lz::decompress(compressed.data(), size, restored.data(), restored.size(), decompressed));
+        REQUIRE_EQ(decompressed, source.size());
+        REQUIRE(restored == source);
+        REQUIRE(!persia::lz::decompress(compressed.data(), size, restored.data(), restored.size() - 1, decompressed));
+        REQUIRE_EQ(persia::lz::compress(source.data(), source.size(), compressed.data(), 16), 0);
+        unsigned char const malformed[] = {0x10, 'a', 0x05, 0x00};
+        REQUIRE(!persia::lz::decompress(malformed, sizeof(malformed), restored.data(), restored.size(), decompressed));
+    }
+
+
+    SCENARIO("inserting to compressed storage") {
+        constexpr int accounts = 10000;
+        auto expected_storage = account_storage::create("accounts.pcomp", accounts, 2);
+        REQUIRE(!!expected_storage);
+        REQUIRE_GE(expected_storage->capacity(), accounts);
+        for(auto i = 0; i != accounts; ++i) {
+            auto value = account{std::uint64_t(i), i * 10, 0, {}};
+            if(i % 10 == 0)
+                value.note[0] = 'v';
+            REQUIRE(expected_storage->insert(value));
+        }
+        REQUIRE(!expected_storage->insert(account{7, 0, 0, {}}));
+        REQUIRE_EQ(expected_storage->size(), accounts);
+        auto found = true;
+        for(auto i = 0; i < accounts; i += 7) {
+            auto const* value = expected_storage->find(std::uint64_t(i));
+            found = found && value != nullptr && value->balance == i * 10
+                && (value->note[0] == 'v') == (i % 10 == 0);
+        }
+        REQUIRE(found);
+        REQUIRE(!expected_storage->find(accounts));
+        for(auto i = 0; i != accounts; i += 2)
+            REQUIRE(expected_storage->erase(std::uint64_t(i)));
+        REQUIRE(!expected_storage->erase(0));
+        REQUIRE(!expected_storage->flush());
+        REQUIRE_LT(expected_storage->compressed_size(), accounts / 2 * sizeof(account) / 4);
+    }
+
+
+    SCENARIO("reopening compressed storage") {
+        constexpr int accounts = 10000;
+        auto const expected_small = small_block_account_storage::open("accounts.pcomp");
+        REQUIRE_EQ(expected_small.error(), persia::compressed_storage_error::mismatch_block_size);
+        auto expected_storage = account_storage::open("accounts.pcomp", 1);
+        REQUIRE(!!expected_storage);
+        REQUIRE_EQ(expected_storage->size(), accounts / 2);
+        REQUIRE(!expected_storage->contains(0));
+        REQUIRE(expected_storage->contains(1));
+        REQUIRE_EQ(expected_storage->find(9999)->balance, 99990);
+        REQUIRE(expected_storage->insert_or_assign(account{1, -1, 0, {}}));
+        REQUIRE(expected_storage->update(9999, [](account& value) { value.flags = 3; }));
+        REQUIRE(!expected_storage->update(0, [](account&) { }));
+        // Reused slots of erased records
+        for(auto i = 0; i != accounts; i += 2)
+            REQUIRE(expected_storage->insert(account{std::uint64_t(accounts + i), 0, 0, {}}));
+        REQUIRE_EQ(expected_storage->size(), accounts);
+        REQUIRE_EQ(expected_storage->find(1)->balance, -1);
+        REQUIRE_EQ(expected_storage->find(9999)->flags, 3);
+        expected_storage->clear();
+        REQUIRE(expected_storage->empty());
+        REQUIRE_EQ(expected_storage->compressed_size(), 0);
+    }
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <chrono>
+#include <system_error>
+#include <thread>
+
+#include <persia/flusher.hpp>
+#include <persia/storage.hpp>
+
+
+struct sample {
+    int id;
+    int value;
+
+    static int key_of(sample const& sample) noexcept {
+        return sample.id;
+    }
+};
+
+using sample_storage = persia::storage<int, sample>;
+
+
+TEST_SUITE("flusher") {
+
+    SCENARIO("waiting for durable mutation") {
+        auto expected_target = sample_storage::create("samples.pmap", 4096);
+        REQUIRE(!!expected_target);
+        auto flusher = persia::flusher<sample_storage>{*expected_target,
+                                                       persia::flusher_policy{std::chrono::seconds{60}, 1024}};
+        REQUIRE(expected_target->insert(sample{1, 1}));
+        REQUIRE(expected_target->insert(sample{2, 2}));
+        auto const sequence = expected_target->sequence();
+        REQUIRE_EQ(sequence, 2);
+        REQUIRE(!flusher.wait_durable(sequence));
+        REQUIRE_GE(flusher.durable_sequence(), sequence);
+        REQUIRE(!flusher.error());
+    }
+
+
+    SCENARIO("waiting for mutation not made yet") {
+        auto expected_target = sample_storage::create("samples.pmap", 4096);
+        REQUIRE(!!expected_target);
+        auto flusher = persia::flusher<sample_storage>{*expected_target,
+                                                       persia::flusher_policy{std::chrono::seconds{1}, 1024}};
+        REQUIRE(expected_target->insert(sample{1, 1}));
+        auto const sequence = expected_target->sequence() + 1;
+        auto ec = std::error_code{};
+        auto waiter = std::thread{[&] { ec = flusher.wait_durable(sequence); }};
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        REQUIRE(expected_target->insert(sample{2, 2}));
+        waiter.join();
+        REQUIRE(!ec);
+        REQUIRE_GE(flusher.durable_sequence(), sequence);
+    }
+
+
+    SCENARIO("flushing storage in background") {
+        auto expected_target = sample_storage::create("samples.pmap", 4096);
+        REQUIRE(!!expected_target);
+        auto flusher = persia::flusher<sample_storage>{*expected_target,
+                                                       persia::flusher_policy{std::chrono::milliseconds{1}, 1024}};
+        for(auto i = 0; i != 1000; ++i)
+            REQUIRE(expected_target->insert_or_assign(sample{i % 100, i}));
+        auto const sequence = expected_target->sequence();
+        while(flusher.durable_sequence() < sequence)
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        REQUIRE_EQ(expected_target->dirty_pages(), 0);
+    }
+
+
+    SCENARIO("flushing storage on stopping flusher") {
+        auto expected_target = sample_storage::create("samples.pmap", 4096);
+        REQUIRE(!!expected_target);
+        {
+            auto flusher = persia::flusher<sample_storage>{*expected_target,
+                                                           persia::flusher_policy{std::chrono::seconds{60}, 1u << 20}};
+            REQUIRE(expected_target->insert(sample{1, 1}));
+        }
+        REQUIRE_EQ(expected_target->durable_sequence(), 1);
+        REQUIRE_EQ(expected_target->dirty_pages(), 0);
+    }
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+#include <persia/log.hpp>
+
+
+struct tick {
+    std::uint64_t time;
+    int price;
+};
+
+using tick_log = persia::log<tick>;
+
+
+inline std::vector<int> prices_of(tick_log& log, std::uint64_t from) {
+    auto prices = std::vector<int>{};
+    for(auto items = log.read(from, 3); !items.empty(); items = log.read(from, 3)) {
+        for(auto const& each: items)
+            prices.push_back(each.price);
+        from += items.size();
+    }
+    return prices;
+}
+
+
+TEST_SUITE("log") {
+
+    SCENARIO("appending to segmented log") {
+        auto expected_log = tick_log::create("ticks", 4);
+        REQUIRE(!!expected_log);
+        REQUIRE_EQ(expected_log->tail(), 0);
+        REQUIRE(expected_log->read(0, 1).empty());
+        REQUIRE(!expected_log->append(tick{1, 10}));
+        tick const batch[] = {{2, 20}, {3, 30}, {4, 40}, {5, 50}, {6, 60}};
+        REQUIRE(!expected_log->append(batch));
+        REQUIRE_EQ(expected_log->tail(), 6);
+        REQUIRE_EQ(expected_log->read(2, 8).size(), 2);
+        REQUIRE_EQ(expected_log->read(4, 8).size(), 2);
+        REQUIRE_EQ(expected_log->read(5, 8)[0].time, 6);
+        REQUIRE_EQ(prices_of(*expected_log, 0), std::vector<int>{10, 20, 30, 40, 50, 60});
+        REQUIRE(!expected_log->flush());
+    }
+
+
+    SCENARIO("following log appended by other object") {
+        auto expected_writer = tick_log::open("ticks");
+        REQUIRE(!!expected_writer);
+        auto expected_reader = tick_log::open("ticks");
+        REQUIRE(!!expected_reader);
+        REQUIRE_EQ(expected_reader->segment_capacity(), 4);
+        REQUIRE_EQ(expected_reader->tail(), 6);
+        for(auto i = 7; i != 11; ++i)
+            REQUIRE(!expected_writer->append(tick{std::uint64_t(i), i * 10}));
+        REQUIRE_EQ(expected_reader->tail(), 10);
+        REQUIRE_EQ(prices_of(*expected_reader, 5), std::vector<int>{60, 70, 80, 90, 100});
+    }
+
+
+    SCENARIO("truncating log") {
+        auto expected_log = tick_log::open("ticks");
+        REQUIRE(!!expected_log);
+        REQUIRE(!expected_log->truncate(7));
+        REQUIRE_EQ(expected_log->front(), 4);
+        REQUIRE(expected_log->read(3, 1).empty());
+        REQUIRE(!expected_log->truncate(100));
+        REQUIRE_EQ(expected_log->front(), 8);
+        REQUIRE_EQ(prices_of(*expected_log, 8), std::vector<int>{90, 100});
+        auto expected_reopened = tick_log::open("ticks");
+        REQUIRE(!!expected_reopened);
+        REQUIRE_EQ(expected_reopened->front(), 8);
+        REQUIRE_EQ(expected_reopened->tail(), 10);
+        auto const expected_other = persia::log<int>::open("ticks");
+        REQUIRE_EQ(expected_other.error(), persia::log_error::mismatch_item_size);
+        auto ec = std::error_code{};
+        std::filesystem::remove_all("ticks", ec);
+        REQUIRE(!tick_log::open("ticks"));
+    }
+
+}
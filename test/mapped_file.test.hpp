@@ -42,4 +42,73 @@ TEST_SUITE("mapped_file") {
         std::filesystem::remove("dummy", ec);
     }
     
+    
+    SCENARIO("copying mapped file") {
+        auto* file = std::fopen("dummy", "w+b");
+        REQUIRE(!!file);
+        char buffer[4096] = {};
+        std::fwrite(buffer, sizeof(char), sizeof(buffer), file);
+        std::fclose(file);
+        auto target = persia::mapped_file::create("dummy");
+        REQUIRE(!!target);
+        *target->cast<char>(42) = 42;
+        REQUIRE(!target->copy_to("dummy.copy"));
+        target = persia::mapped_file{};
+        auto copy = persia::mapped_file::create("dummy.copy");
+        REQUIRE(!!copy);
+        REQUIRE_EQ(copy->size(), 4096);
+        REQUIRE_EQ(*copy->cast<char>(42), 42);
+        copy = persia::mapped_file{};
+        auto ec = std::error_code{};
+        std::filesystem::remove("dummy", ec);
+        std::filesystem::remove("dummy.copy", ec);
+    }
+    
+    
+    SCENARIO("flushing extents of mapped file") {
+        auto* file = std::fopen("dummy", "w+b");
+        REQUIRE(!!file);
+        char buffer[65536] = {};
+        std::fwrite(buffer, sizeof(char), sizeof(buffer), file);
+        std::fclose(file);
+        auto target = persia::mapped_file::create("dummy");
+        REQUIRE(!!target);
+        target->will_need(0, target->size());
+        *target->cast<char>(100) = 1;
+        *target->cast<char>(40000) = 2;
+        persia::mapped_file::extent const extents[] = {{100, 1}, {40000, 1}};
+        REQUIRE(!target->flush_extents(extents, 2));
+        REQUIRE(!target->flush_extents(extents, 0));
+        target = persia::mapped_file{};
+        auto reopened = persia::mapped_file::create("dummy");
+        REQUIRE(!!reopened);
+        REQUIRE_EQ(*reopened->cast<char>(40000), 2);
+        reopened = persia::mapped_file{};
+        auto ec = std::error_code{};
+        std::filesystem::remove("dummy", ec);
+    }
+    
+    
+    SCENARIO("resizing mapped file") {
+        auto* file = std::fopen("dummy", "w+b");
+        REQUIRE(!!file);
+        char buffer[4096] = {};
+        std::fwrite(buffer, sizeof(char), sizeof(buffer), file);
+        std::fclose(file);
+        auto target = persia::mapped_file::create("dummy");
+        REQUIRE(!!target);
+        *target->cast<char>(42) = 42;
+        REQUIRE(!target->resize("dummy", 8192));
+        REQUIRE_EQ(target->size(), 8192);
+        REQUIRE_EQ(*target->cast<char>(42), 42);
+        // Failed resize keeps the file mapped with its original size
+        REQUIRE(!!target->resize("dummy", ~std::size_t(0) / 2));
+        REQUIRE(!!*target);
+        REQUIRE_EQ(target->size(), 8192);
+        REQUIRE_EQ(*target->cast<char>(42), 42);
+        target = persia::mapped_file{};
+        auto ec = std::error_code{};
+        std::filesystem::remove("dummy", ec);
+    }
+    
 }
@@ -0,0 +1,107 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <persia/multi_storage.hpp>
+
+
+struct fill {
+    std::uint64_t account;
+    int id;
+    int quantity;
+
+    static std::uint64_t key_of(fill const& fill) noexcept {
+        return fill.account;
+    }
+};
+
+using fill_storage = persia::multi_storage<std::uint64_t, fill>;
+
+
+inline std::vector<int> fill_ids_of(fill_storage const& storage, std::uint64_t account) {
+    auto ids = std::vector<int>{};
+    for(auto const& each: storage.equal_range(account))
+        ids.push_back(each.id);
+    return ids;
+}
+
+
+TEST_SUITE("multi_storage") {
+
+    SCENARIO("inserting several items per key") {
+        auto expected_target = fill_storage::create("fills.pmulti", 1000);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->empty());
+        REQUIRE(expected_target->equal_range(1).empty());
+        for(auto i = 0; i != 1000; ++i)
+            REQUIRE(expected_target->insert(fill{std::uint64_t(i % 3 == 0 ? 1 : 1000 + i), i, i}));
+        REQUIRE(expected_target->fully_occupied());
+        REQUIRE(!expected_target->insert(fill{1, 1000, 0}));
+        REQUIRE_EQ(expected_target->size(), 1000);
+        REQUIRE_EQ(expected_target->count(1), 334);
+        REQUIRE_EQ(expected_target->count(1002), 1);
+        REQUIRE_EQ(expected_target->count(1003), 0);
+        REQUIRE_EQ(expected_target->key_count(), 1000 - 334 + 1);
+        auto const ids = fill_ids_of(*expected_target, 1);
+        REQUIRE_EQ(ids.size(), std::size_t(334));
+        auto in_order = true;
+        for(auto i = 0; i != 334; ++i)
+            in_order = in_order && ids[i] == i * 3;
+        REQUIRE(in_order);
+        for(auto& each: expected_target->equal_range(1002))
+            each.quantity = -2;
+        REQUIRE_EQ(expected_target->equal_range(1002).begin()->quantity, -2);
+    }
+
+
+    SCENARIO("erasing items of a key") {
+        auto expected_target = fill_storage::open("fills.pmulti", 0);
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->count(1), 334);
+        REQUIRE_EQ(expected_target->equal_range(1002).begin()->quantity, -2);
+        auto range = expected_target->equal_range(1);
+        for(auto it = range.begin(); it != range.end();)
+            if(it->id % 2 == 0)
+                it = expected_target->erase(it);
+            else
+                ++it;
+        REQUIRE_EQ(expected_target->count(1), 167);
+        REQUIRE_EQ(fill_ids_of(*expected_target, 1).front(), 3);
+        REQUIRE_EQ(fill_ids_of(*expected_target, 1).back(), 999);
+        REQUIRE(expected_target->insert(fill{1, 1000, 0}));
+        REQUIRE_EQ(fill_ids_of(*expected_target, 1).back(), 1000);
+        REQUIRE_EQ(expected_target->erase(std::uint64_t(1002)), 1);
+        REQUIRE(!expected_target->contains(1002));
+        REQUIRE_EQ(expected_target->erase(std::uint64_t(1002)), 0);
+        REQUIRE_EQ(expected_target->size(), 1000 - 167 + 1 - 1);
+    }
+
+
+    SCENARIO("reopening multi storage with larger capacity") {
+        auto expected_target = fill_storage::open("fills.pmulti", 2000);
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->capacity(), 2000);
+        REQUIRE_EQ(expected_target->size(), 833);
+        auto const ids = fill_ids_of(*expected_target, 1);
+        REQUIRE_EQ(ids.size(), std::size_t(168));
+        auto in_order = true;
+        for(auto i = 0; i != 167; ++i)
+            in_order = in_order && ids[i] == 3 + i * 6;
+        REQUIRE(in_order);
+        REQUIRE_EQ(ids.back(), 1000);
+        for(auto i = 0; i != 1167; ++i)
+            REQUIRE(expected_target->insert(fill{7, i, 0}));
+        REQUIRE(expected_target->fully_occupied());
+        REQUIRE_EQ(expected_target->erase(std::uint64_t(1)), 168);
+        REQUIRE_EQ(expected_target->count(7), 1167);
+        expected_target->clear();
+        REQUIRE(expected_target->empty());
+        REQUIRE(!expected_target->contains(7));
+        REQUIRE(!expected_target->flush());
+    }
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <persia/ordered_storage.hpp>
+
+
+struct trade {
+    std::int64_t id;
+    int quantity;
+
+    static std::int64_t key_of(trade const& trade) noexcept {
+        return trade.id;
+    }
+};
+
+using trade_storage = persia::ordered_storage<std::int64_t, trade>;
+
+
+struct ticker {
+    char text[8];
+
+    friend bool operator < (ticker const& lhs, ticker const& rhs) noexcept {
+        return std::memcmp(lhs.text, rhs.text, sizeof(lhs.text)) < 0;
+    }
+};
+
+
+struct listing {
+    ticker name;
+    int board;
+
+    static ticker key_of(listing const& listing) noexcept {
+        return listing.name;
+    }
+};
+
+using listing_storage = persia::ordered_storage<ticker, listing>;
+
+
+inline std::vector<std::int64_t> ids_of(trade_storage const& storage) {
+    auto ids = std::vector<std::int64_t>{};
+    for(auto const& each: storage)
+        ids.push_back(each.id);
+    return ids;
+}
+
+
+TEST_SUITE("ordered_storage") {
+
+    SCENARIO("inserting to ordered storage") {
+        constexpr int count = 20000;
+        auto expected_target = trade_storage::create("trades.ptree", 16);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->empty());
+        REQUIRE(expected_target->begin() == expected_target->end());
+        for(auto i = 0; i != count; ++i)
+            REQUIRE(expected_target->insert(trade{(i * 7919) % count, i}));
+        REQUIRE(!expected_target->insert(trade{5, -1}));
+        REQUIRE(expected_target->insert_or_assign(trade{5, -5}));
+        REQUIRE_EQ(expected_target->size(), count);
+        REQUIRE_GT(expected_target->height(), 1);
+        auto const ids = ids_of(*expected_target);
+        REQUIRE_EQ(ids.size(), std::size_t(count));
+        auto ordered = true;
+        for(auto i = 0; i != count; ++i)
+            ordered = ordered && ids[i] == i;
+        REQUIRE(ordered);
+        REQUIRE_EQ(expected_target->find(5)->quantity, -5);
+        REQUIRE_EQ(expected_target->find(7919)->quantity, 1);
+        REQUIRE(!expected_target->find(count));
+        REQUIRE(!expected_target->contains(-1));
+    }
+
+
+    SCENARIO("reopening ordered storage") {
+        auto expected_target = trade_storage::open("trades.ptree");
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->size(), 20000);
+        REQUIRE_EQ(expected_target->find(5)->quantity, -5);
+        REQUIRE_EQ(expected_target->lower_bound(100)->id, 100);
+        REQUIRE_EQ(expected_target->upper_bound(100)->id, 101);
+        REQUIRE(expected_target->lower_bound(20000) == expected_target->end());
+        auto sum = std::int64_t(0);
+        for(auto const& each: expected_target->range(1000, 2000))
+            sum += each.id;
+        REQUIRE_EQ(sum, (1000 + 1999) * 1000 / 2);
+        REQUIRE(expected_target->range(30000, 40000).empty());
+        auto const expected_other = listing_storage::open("trades.ptree");
+        REQUIRE(!expected_other);
+    }
+
+
+    SCENARIO("erasing from ordered storage") {
+        auto expected_target = trade_storage::open("trades.ptree");
+        REQUIRE(!!expected_target);
+        for(auto i = 0; i < 20000; i += 2)
+            REQUIRE(expected_target->erase(i));
+        REQUIRE(!expected_target->erase(0));
+        REQUIRE_EQ(expected_target->size(), 10000);
+        REQUIRE_EQ(expected_target->lower_bound(1000)->id, 1001);
+        auto odd = true;
+        for(auto const& each: *expected_target)
+            odd = odd && each.id % 2 == 1;
+        REQUIRE(odd);
+        for(auto i = 19999; i > 0; i -= 2)
+            REQUIRE(expected_target->erase(i));
+        REQUIRE(expected_target->empty());
+        REQUIRE_EQ(expected_target->height(), 1);
+        REQUIRE(expected_target->begin() == expected_target->end());
+        for(auto i = 0; i != 1000; ++i)
+            REQUIRE(expected_target->insert(trade{i, i}));
+        REQUIRE_EQ(ids_of(*expected_target).back(), 999);
+        expected_target->clear();
+        REQUIRE(expected_target->empty());
+        REQUIRE(!expected_target->flush());
+    }
+
+
+    SCENARIO("ordering items by non arithmetic keys") {
+        auto expected_target = listing_storage::create("listings.ptree", 4);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(listing{{"MSFT"}, 1}));
+        REQUIRE(expected_target->insert(listing{{"AAPL"}, 1}));
+        REQUIRE(expected_target->insert(listing{{"GOOG"}, 2}));
+        auto names = std::vector<std::string>{};
+        for(auto const& each: *expected_target)
+            names.emplace_back(each.name.text);
+        REQUIRE_EQ(names, std::vector<std::string>{"AAPL", "GOOG", "MSFT"});
+        REQUIRE_EQ(expected_target->find(ticker{"GOOG"})->board, 2);
+    }
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <persia/priority_queue.hpp>
+
+
+struct timer {
+    std::int64_t deadline;
+    std::uint64_t id;
+
+    static std::int64_t priority_of(timer const& timer) noexcept {
+        return timer.deadline;
+    }
+};
+
+using timer_queue = persia::priority_queue<timer>;
+using binary_timer_queue = persia::priority_queue<timer, timer, 2>;
+
+
+TEST_SUITE("priority_queue") {
+
+    SCENARIO("pushing to priority queue") {
+        constexpr int timers = 10000;
+        auto expected_queue = timer_queue::create("timers.pheap", 16);
+        REQUIRE(!!expected_queue);
+        REQUIRE(expected_queue->empty());
+        REQUIRE(!expected_queue->top());
+        for(auto i = 0; i != timers; ++i)
+            REQUIRE(expected_queue->push(timer{(i * 7919) % timers, std::uint64_t(i)}));
+        REQUIRE_EQ(expected_queue->size(), timers);
+        REQUIRE_GE(expected_queue->capacity(), timers);
+        REQUIRE_EQ(expected_queue->top()->deadline, 0);
+        auto popped = timer{};
+        for(auto i = 0; i != timers / 2; ++i) {
+            REQUIRE(expected_queue->pop(popped));
+            REQUIRE_EQ(popped.deadline, i);
+        }
+        REQUIRE(!expected_queue->flush());
+    }
+
+
+    SCENARIO("expiring timers of reopened priority queue") {
+        auto expected_queue = timer_queue::open("timers.pheap");
+        REQUIRE(!!expected_queue);
+        REQUIRE_EQ(expected_queue->size(), 5000);
+        REQUIRE_EQ(expected_queue->top()->deadline, 5000);
+        auto expired = std::vector<std::int64_t>{};
+        auto const count = expected_queue->pop_until(std::int64_t(5999), [&](timer const& each) {
+            expired.push_back(each.deadline);
+        });
+        REQUIRE_EQ(count, 1000);
+        auto ordered = expired.size() == 1000;
+        for(auto i = std::size_t(0); ordered && i != expired.size(); ++i)
+            ordered = expired[i] == std::int64_t(5000 + i);
+        REQUIRE(ordered);
+        REQUIRE(expected_queue->push(timer{-1, 0}));
+        REQUIRE_EQ(expected_queue->top()->deadline, -1);
+        auto const expected_binary = binary_timer_queue::open("timers.pheap");
+        REQUIRE_EQ(expected_binary.error(), persia::priority_queue_error::mismatch_arity);
+        expected_queue->clear();
+        auto popped = timer{};
+        REQUIRE(!expected_queue->pop(popped));
+    }
+
+
+    SCENARIO("popping equal priorities") {
+        auto expected_queue = binary_timer_queue::create("binary.pheap", 1);
+        REQUIRE(!!expected_queue);
+        for(auto i = 0; i != 100; ++i)
+            REQUIRE(expected_queue->push(timer{i % 3, std::uint64_t(i)}));
+        auto popped = timer{};
+        auto previous = std::int64_t(0);
+        auto ordered = true;
+        for(auto i = 0; i != 100; ++i) {
+            REQUIRE(expected_queue->pop(popped));
+            ordered = ordered && popped.deadline >= previous;
+            previous = popped.deadline;
+        }
+        REQUIRE(ordered);
+        REQUIRE(expected_queue->empty());
+    }
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <persia/queue.hpp>
+
+
+struct message {
+    int producer;
+    int number;
+};
+
+using message_queue = persia::queue<message>;
+using shared_message_queue = persia::queue<message, persia::multi_producer>;
+
+
+TEST_SUITE("queue") {
+
+    SCENARIO("pushing to and popping from queue") {
+        auto expected_queue = message_queue::create("messages.queue", 3);
+        REQUIRE(!!expected_queue);
+        REQUIRE_EQ(expected_queue->capacity(), 4);
+        REQUIRE(expected_queue->empty());
+        auto popped = message{};
+        REQUIRE(!expected_queue->try_pop(popped));
+        for(auto i = 0; i != 4; ++i)
+            REQUIRE(expected_queue->try_push(message{0, i}));
+        REQUIRE(!expected_queue->try_push(message{0, 4}));
+        REQUIRE(expected_queue->try_pop(popped));
+        REQUIRE_EQ(popped.number, 0);
+        REQUIRE(expected_queue->try_push(message{0, 4}));
+        REQUIRE_EQ(expected_queue->size(), 4);
+        REQUIRE(!expected_queue->flush());
+    }
+
+
+    SCENARIO("reopening queue") {
+        auto expected_queue = message_queue::open("messages.queue");
+        REQUIRE(!!expected_queue);
+        REQUIRE_EQ(expected_queue->size(), 4);
+        auto popped = message{};
+        for(auto i = 1; i != 5; ++i) {
+            REQUIRE(expected_queue->try_pop(popped));
+            REQUIRE_EQ(popped.number, i);
+        }
+        REQUIRE(!expected_queue->try_pop(popped));
+        auto const expected_shared = shared_message_queue::open("messages.queue");
+        REQUIRE_EQ(expected_shared.error(), persia::queue_error::mismatch_producer_mode);
+    }
+
+
+    SCENARIO("passing messages between mappings") {
+        constexpr int messages = 100000;
+        auto expected_consumer = message_queue::create("messages.queue", 64);
+        REQUIRE(!!expected_consumer);
+        auto producer = std::thread{[] {
+            auto expected_producer = message_queue::open("messages.queue");
+            for(auto i = 0; i != messages;)
+                if(expected_producer->try_push(message{0, i}))
+                    ++i;
+                else
+                    std::this_thread::yield();
+        }};
+        auto in_order = true;
+        auto popped = message{};
+        for(auto i = 0; i != messages;)
+            if(expected_consumer->try_pop(popped)) {
+                in_order = in_order && popped.number == i;
+                ++i;
+            } else {
+                std::this_thread::yield();
+            }
+        producer.join();
+        REQUIRE(in_order);
+        REQUIRE(expected_consumer->empty());
+    }
+
+
+    SCENARIO("pushing by multiple producers") {
+        constexpr int producers = 4;
+        constexpr int messages = 20000;
+        auto expected_queue = shared_message_queue::create("shared.queue", 128);
+        REQUIRE(!!expected_queue);
+        auto& queue = *expected_queue;
+        auto threads = std::vector<std::thread>{};
+        for(auto p = 0; p != producers; ++p)
+            threads.emplace_back([&queue, p] {
+                for(auto i = 0; i != messages;)
+                    if(queue.try_push(message{p, i}))
+                        ++i;
+                    else
+                        std::this_thread::yield();
+            });
+        auto next = std::vector<int>(producers, 0);
+        auto in_order = true;
+        auto popped = message{};
+        for(auto received = 0; received != producers * messages;)
+            if(queue.try_pop(popped)) {
+                in_order = in_order && popped.number == next[popped.producer]++;
+                ++received;
+            } else {
+                std::this_thread::yield();
+            }
+        for(auto& thread: threads)
+            thread.join();
+        REQUIRE(in_order);
+        REQUIRE(queue.empty());
+        REQUIRE(!queue.try_pop(popped));
+    }
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+
+#include <persia/split_storage.hpp>
+
+
+struct customer_summary {
+    std::int64_t balance;
+    std::uint32_t tier;
+};
+
+
+struct customer {
+    std::uint64_t id;
+    std::int64_t balance;
+    std::uint32_t tier;
+    char address[236];
+
+    static std::uint64_t key_of(customer const& customer) noexcept {
+        return customer.id;
+    }
+
+    static customer_summary hot_of(customer const& customer) noexcept {
+        return {customer.balance, customer.tier};
+    }
+};
+
+using customer_storage = persia::split_storage<std::uint64_t, customer>;
+
+
+TEST_SUITE("split_storage") {
+
+    SCENARIO("inserting to split storage") {
+        constexpr int customers = 1000;
+        auto expected_storage = customer_storage::create("customers.psplit", customers);
+        REQUIRE(!!expected_storage);
+        REQUIRE(expected_storage->empty());
+        for(auto i = 0; i != customers; ++i)
+            REQUIRE(expected_storage->insert(customer{std::uint64_t(i), i * 100, std::uint32_t(i % 3), {'x'}}));
+        REQUIRE(expected_storage->fully_occupied());
+        REQUIRE(!expected_storage->insert(customer{customers, 0, 0, {}}));
+        REQUIRE(!expected_storage->insert_or_assign(customer{customers, 0, 0, {}}));
+        auto const* summary = expected_storage->find_hot(42);
+        REQUIRE(summary != nullptr);
+        REQUIRE_EQ(summary->balance, 4200);
+        REQUIRE_EQ(summary->tier, 0);
+        REQUIRE_EQ(expected_storage->find(43)->address[0], 'x');
+        REQUIRE(!expected_storage->find_hot(customers));
+        REQUIRE(expected_storage->update(42, [](customer& value) { value.tier = 7; }));
+        REQUIRE_EQ(expected_storage->find_hot(42)->tier, 7);
+        REQUIRE_EQ(expected_storage->find(42)->tier, 7);
+        for(auto i = 0; i != customers; i += 2)
+            REQUIRE(expected_storage->erase(std::uint64_t(i)));
+        REQUIRE(!expected_storage->erase(0));
+        REQUIRE(!expected_storage->flush());
+    }
+
+
+    SCENARIO("reopening split storage") {
+        constexpr int customers = 1000;
+        auto expected_storage = customer_storage::open("customers.psplit");
+        REQUIRE(!!expected_storage);
+        REQUIRE_EQ(expected_storage->size(), customers / 2);
+        REQUIRE(!expected_storage->contains(42));
+        REQUIRE_EQ(expected_storage->find_hot(43)->balance, 4300);
+        auto total = std::int64_t(0);
+        auto count = 0;
+        expected_storage->for_each_hot([&](std::uint64_t key, customer_summary const& each) {
+            total += each.balance;
+            count += key % 2 == 1;
+        });
+        REQUIRE_EQ(count, customers / 2);
+        REQUIRE_EQ(total, std::int64_t(customers / 2) * customers * 100 / 2);
+        expected_storage->insert_or_assign(customer{43, -1, 9, {}});
+        REQUIRE_EQ(expected_storage->find_hot(43)->tier, 9);
+        REQUIRE_EQ(expected_storage->find(43)->address[0], '\0');
+        expected_storage->clear();
+        REQUIRE(expected_storage->empty());
+        REQUIRE_EQ(expected_storage->find(43), nullptr);
+    }
+
+}
@@ -1,8 +1,19 @@
 #pragma once
 
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <functional>
+#include <list>
+#include <string>
+#include <string_view>
 #include <system_error>
+#include <thread>
+#include <vector>
 
 #include "doctest.h"
 
@@ -15,13 +26,132 @@ struct item {
     int key;
     int data;
     
-    static key_of(item const& item) noexcept {
+    static int key_of(item const& item) noexcept {
         return item.key;
     }
 };
 
 using storage = persia::storage<int, item>;
 
+
+struct event {
+    int id;
+    int timestamp;
+    
+    static int key_of(event const& event) noexcept {
+        return event.id;
+    }
+    
+    static int order_of(event const& event) noexcept {
+        return event.timestamp;
+    }
+};
+
+using event_storage = persia::storage<int, event>;
+
+
+struct order {
+    int id;
+    int reference;
+    int account;
+    
+    static int key_of(order const& order) noexcept {
+        return order.id;
+    }
+    
+    static int reference_of(order const& order) noexcept {
+        return order.reference;
+    }
+    
+    static int account_of(order const& order) noexcept {
+        return order.account;
+    }
+    
+    using secondary_indices = persia::secondary_indices<persia::unique_index<&reference_of>,
+                                                        persia::multi_index<&account_of>>;
+};
+
+using order_storage = persia::storage<int, order>;
+
+
+struct filtered_adapter {
+    static constexpr unsigned bloom_filter_bits = 10;
+    
+    static int key_of(item const& item) noexcept {
+        return item.key;
+    }
+};
+
+using filtered_storage = persia::storage<int, item, filtered_adapter>;
+
+using hashed_storage = persia::storage<int, item, item, persia::hashed_indices<>>;
+
+
+struct symbol {
+    char text[16];
+    
+    std::string_view view() const noexcept {
+        return {text, std::strlen(text)};
+    }
+    
+    friend bool operator == (symbol const& lhs, symbol const& rhs) noexcept {
+        return lhs.view() == rhs.view();
+    }
+    
+    friend bool operator == (symbol const& lhs, std::string_view rhs) noexcept {
+        return lhs.view() == rhs;
+    }
+};
+
+
+struct symbol_hash {
+    using is_transparent = void;
+    
+    std::size_t operator () (std::string_view text) const noexcept {
+        return std::hash<std::string_view>{}(text);
+    }
+    
+    std::size_t operator () (symbol const& symbol) const noexcept {
+        return (*this)(symbol.view());
+    }
+};
+
+
+struct instrument {
+    symbol name;
+    int lot;
+    
+    static symbol key_of(instrument const& instrument) noexcept {
+        return instrument.name;
+    }
+};
+
+using instrument_storage = persia::storage<symbol, instrument, instrument,
+                                           persia::hashed_indices<symbol_hash>>;
+
+
+struct versioned_adapter {
+    static constexpr bool multiversion = true;
+    
+    static int key_of(item const& item) noexcept {
+        return item.key;
+    }
+};
+
+using versioned_storage = persia::storage<int, item, versioned_adapter>;
+
+
+struct named_item {
+    char name[16];
+    int data;
+    
+    static std::string key_of(named_item const& item) {
+        return item.name;
+    }
+};
+
+using named_storage = persia::storage<std::string, named_item>;
+
 TEST_SUITE("storage") {
     
     SCENARIO("open non existing storage") {
@@ -163,4 +293,529 @@ TEST_SUITE("storage") {
         REQUIRE(expected_target->empty());
     }
     
+    
+    SCENARIO("iterating storage in order") {
+        auto expected_target = event_storage::create("events.pmap", 1024);
+        REQUIRE(!!expected_target);
+        for(auto i = 0; i != 1000; ++i)
+            REQUIRE(expected_target->insert(event{i, (i * 7919) % 500}));
+        auto previous = -1;
+        auto count = 0;
+        for(auto it = expected_target->ordered_begin(); it != expected_target->ordered_end(); ++it) {
+            REQUIRE_LE(previous, it->timestamp);
+            previous = it->timestamp;
+            ++count;
+        }
+        REQUIRE_EQ(count, 1000);
+    }
+    
+    
+    SCENARIO("querying range of ordered storage") {
+        auto expected_target = event_storage::open("events.pmap", 1024);
+        REQUIRE(!!expected_target);
+        auto count = 0;
+        for(auto const& event: expected_target->range(100, 110)) {
+            REQUIRE_GE(event.timestamp, 100);
+            REQUIRE_LT(event.timestamp, 110);
+            ++count;
+        }
+        REQUIRE_EQ(count, 20);
+        auto const found = expected_target->lower_bound(499);
+        REQUIRE(found != expected_target->ordered_end());
+        REQUIRE_EQ(found->timestamp, 499);
+        REQUIRE(expected_target->lower_bound(500) == expected_target->ordered_end());
+    }
+    
+    
+    SCENARIO("maintaining order on assigning and erasing") {
+        auto expected_target = event_storage::open("events.pmap", 1024);
+        REQUIRE(!!expected_target);
+        for(auto i = 0; i != 1000; i += 2)
+            REQUIRE(expected_target->erase(i));
+        REQUIRE(expected_target->insert_or_assign(event{1, 1000}));
+        auto timestamps = std::vector<int>{};
+        for(auto it = expected_target->ordered_begin(); it != expected_target->ordered_end(); ++it)
+            timestamps.push_back(it->timestamp);
+        REQUIRE_EQ(timestamps.size(), 500);
+        REQUIRE(std::is_sorted(timestamps.begin(), timestamps.end()));
+        REQUIRE_EQ(timestamps.back(), 1000);
+        expected_target->clear();
+        REQUIRE(expected_target->range(0, 1001).empty());
+    }
+    
+    
+    SCENARIO("finding by secondary indices") {
+        auto expected_target = order_storage::create("orders.pmap", 16);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(order{1, 101, 7}));
+        REQUIRE(expected_target->insert(order{2, 102, 7}));
+        REQUIRE(expected_target->insert(order{3, 103, 8}));
+        REQUIRE(!expected_target->insert(order{4, 101, 9}));
+        auto const* found = expected_target->find_by<0>(102);
+        REQUIRE(!!found);
+        REQUIRE_EQ(found->id, 2);
+        REQUIRE(!expected_target->find_by<0>(104));
+        auto count = 0;
+        for(auto const& order: expected_target->find_by<1>(7)) {
+            REQUIRE_EQ(order.account, 7);
+            ++count;
+        }
+        REQUIRE_EQ(count, 2);
+    }
+    
+    
+    SCENARIO("maintaining secondary indices on mutations") {
+        auto expected_target = order_storage::open("orders.pmap", 16);
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->find_by<0>(103)->id, 3);
+        REQUIRE(!expected_target->insert_or_assign(order{3, 101, 8}));
+        REQUIRE(expected_target->insert_or_assign(order{3, 104, 7}));
+        REQUIRE(!expected_target->find_by<0>(103));
+        REQUIRE_EQ(expected_target->find_by<0>(104)->id, 3);
+        REQUIRE(expected_target->find_by<1>(8).empty());
+        REQUIRE(expected_target->erase(1));
+        REQUIRE(!expected_target->find_by<0>(101));
+        auto count = 0;
+        for(auto const& order: expected_target->find_by<1>(7)) {
+            REQUIRE_NE(order.id, 1);
+            ++count;
+        }
+        REQUIRE_EQ(count, 2);
+        expected_target->clear();
+        REQUIRE(expected_target->find_by<1>(7).empty());
+    }
+    
+    
+    SCENARIO("emplacing items") {
+        auto expected_target = storage::create("emplaced.pmap", 2);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->emplace(item{1, 10}));
+        REQUIRE(!expected_target->emplace(item{1, 11}));
+        REQUIRE(expected_target->try_emplace(2, item{2, 20}));
+        REQUIRE(!expected_target->try_emplace(2, item{2, 21}));
+        REQUIRE(!expected_target->emplace(item{3, 30}));
+        REQUIRE_EQ(expected_target->size(), 2);
+        REQUIRE_EQ(expected_target->find(1)->data, 10);
+        REQUIRE_EQ(expected_target->find(2)->data, 20);
+    }
+    
+    
+    SCENARIO("updating items in place") {
+        auto expected_target = order_storage::create("orders.pmap", 16);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(order{1, 101, 7}));
+        REQUIRE(expected_target->insert(order{2, 102, 7}));
+        REQUIRE(expected_target->update(1, [](order& o) { o.account = 8; }));
+        REQUIRE_EQ(expected_target->find(1)->account, 8);
+        REQUIRE_EQ(expected_target->find_by<1>(8).begin()->id, 1);
+        REQUIRE(!expected_target->update(2, [](order& o) { o.reference = 101; }));
+        REQUIRE_EQ(expected_target->find(2)->reference, 102);
+        REQUIRE_EQ(expected_target->find_by<0>(102)->id, 2);
+        REQUIRE(!expected_target->update(3, [](order& o) { o.account = 9; }));
+    }
+    
+    
+    SCENARIO("rejecting misses by bloom filter") {
+        auto expected_target = filtered_storage::create("filtered.pmap", 4096);
+        REQUIRE(!!expected_target);
+        for(auto i = 0; i != 4096; i += 2)
+            REQUIRE(expected_target->insert(item{i, i}));
+        for(auto i = 0; i != 4096; ++i)
+            REQUIRE_EQ(expected_target->contains(i), i % 2 == 0);
+        for(auto i = 0; i != 4096; i += 2)
+            REQUIRE(expected_target->erase(i));
+        REQUIRE(expected_target->empty());
+        REQUIRE(expected_target->insert(item{1, 1}));
+        REQUIRE(expected_target->contains(1));
+        REQUIRE(!expected_target->contains(2));
+    }
+    
+    
+    SCENARIO("rebuilding bloom filter on opening") {
+        auto expected_target = filtered_storage::open("filtered.pmap", 4096);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->contains(1));
+        REQUIRE_EQ(expected_target->extract(1)->data, 1);
+        REQUIRE(!expected_target->extract(1));
+    }
+    
+    
+    SCENARIO("storing key hashes in records") {
+        auto expected_target = hashed_storage::create("hashed.pmap", 1024);
+        REQUIRE(!!expected_target);
+        for(auto i = 0; i != 1000; ++i)
+            REQUIRE(expected_target->insert(item{i, i}));
+        REQUIRE(!expected_target->insert(item{5, 0}));
+        for(auto i = 0; i < 1000; i += 3)
+            REQUIRE(expected_target->erase(i));
+        REQUIRE(expected_target->insert_or_assign(item{1, -1}));
+        REQUIRE_EQ(expected_target->size(), 666);
+    }
+    
+    
+    SCENARIO("opening storage with key hashes in records") {
+        auto expected_target = hashed_storage::open("hashed.pmap", 2048);
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->capacity(), 2048);
+        REQUIRE_EQ(expected_target->size(), 666);
+        for(auto i = 0; i != 1000; ++i) {
+            auto const* found = expected_target->find(i);
+            REQUIRE_EQ(!!found, i % 3 != 0);
+            if(found)
+                REQUIRE_EQ(found->data, i == 1 ? -1 : i);
+        }
+        auto sum = 0;
+        for(auto const& each: *expected_target)
+            sum += each.key;
+        REQUIRE_EQ(sum, 332667);
+    }
+    
+    
+    SCENARIO("looking up by comparable key type") {
+        auto expected_target = instrument_storage::create("instruments.pmap", 16);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(instrument{{"EURUSD"}, 1000}));
+        REQUIRE(expected_target->insert(instrument{{"USDJPY"}, 100}));
+        REQUIRE(expected_target->insert(instrument{{"XAUUSD"}, 1}));
+        auto const request = std::string_view{"USDJPY;EURUSD;XAUUSD"};
+        REQUIRE_EQ(expected_target->find(request.substr(0, 6))->lot, 100);
+        REQUIRE(expected_target->contains(request.substr(7, 6)));
+        REQUIRE(!expected_target->contains(request.substr(0, 3)));
+        REQUIRE(expected_target->erase(request.substr(7, 6)));
+        REQUIRE(!expected_target->contains(std::string_view{"EURUSD"}));
+        REQUIRE_EQ(expected_target->extract(request.substr(14, 6))->lot, 1);
+        REQUIRE_EQ(expected_target->size(), 1);
+        REQUIRE(expected_target->contains(symbol{"USDJPY"}));
+    }
+    
+    
+    SCENARIO("storing items with non trivially copyable key") {
+        auto expected_target = named_storage::create("named.pmap", 16);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(named_item{"first", 1}));
+        REQUIRE(expected_target->insert_or_assign(named_item{"second", 2}));
+        REQUIRE(expected_target->insert_or_assign(named_item{"first", 3}));
+        REQUIRE_EQ(expected_target->find(std::string{"first"})->data, 3);
+        REQUIRE(expected_target->erase(std::string{"second"}));
+        REQUIRE_EQ(expected_target->size(), 1);
+        expected_target->clear();
+        REQUIRE(expected_target->empty());
+    }
+    
+    
+    SCENARIO("opening storage with different record format") {
+        auto expected_target = storage::open("hashed.pmap", 2048);
+        REQUIRE(!expected_target);
+        REQUIRE_EQ(expected_target.error(), persia::storage_error::mismatch_format);
+    }
+    
+    
+    SCENARIO("opening storage written in original layout") {
+        // 16-byte header, then records of marker, item and padding
+        std::uint32_t const image[] = {
+            0x1EF11ADA, 8, 4, 0,
+            0xFEEDDA1A, 7, 70, 0,
+            0, 0, 0, 0,
+            0xFEEDDA1A, 9, 90, 0,
+            0, 0, 0, 0
+        };
+        auto* file = std::fopen("original.pmap", "wb");
+        REQUIRE(file != nullptr);
+        REQUIRE_EQ(std::fwrite(image, sizeof(image), 1, file), 1);
+        std::fclose(file);
+        auto expected_target = storage::open("original.pmap", 4);
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->capacity(), 4);
+        REQUIRE_EQ(expected_target->size(), 2);
+        REQUIRE_EQ(expected_target->find(7)->data, 70);
+        REQUIRE_EQ(expected_target->find(9)->data, 90);
+    }
+    
+    
+    SCENARIO("bulk loading storage") {
+        auto items = std::vector<item>{};
+        for(auto i = 0; i != 200000; ++i)
+            items.push_back(item{(i * 7919) % 200000, i});
+        items.push_back(item{5, -5});
+        auto expected_target = hashed_storage::bulk_load("bulk.pmap", 0, items.begin(), items.end());
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->size(), 200000);
+        REQUIRE_EQ(expected_target->capacity(), 200001);
+        REQUIRE_EQ(expected_target->dirty_pages(), 0);
+        REQUIRE_EQ(expected_target->find(5)->data, -5);
+        REQUIRE_EQ(expected_target->find(7919)->data, 1);
+        REQUIRE(expected_target->insert(item{200000, 0}));
+        REQUIRE(expected_target->fully_occupied());
+    }
+    
+    
+    SCENARIO("opening bulk loaded storage") {
+        auto expected_target = hashed_storage::open("bulk.pmap", 0);
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->find(5)->data, -5);
+        REQUIRE_EQ(expected_target->size(), 200001);
+        REQUIRE_EQ(expected_target->find(7919)->data, 1);
+    }
+    
+    
+    SCENARIO("bulk loading from forward range") {
+        auto const orders = std::list<order>{{1, 101, 7}, {2, 102, 7}, {3, 103, 8}};
+        auto expected_target = order_storage::bulk_load("orders.pmap", 16, orders.begin(), orders.end());
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->capacity(), 16);
+        REQUIRE_EQ(expected_target->find_by<0>(102)->id, 2);
+        REQUIRE(expected_target->insert(order{4, 104, 8}));
+        auto const duplicates = std::list<order>{{1, 101, 7}, {2, 101, 7}};
+        auto expected_other = order_storage::bulk_load("orders.pmap", 16, duplicates.begin(), duplicates.end());
+        REQUIRE_EQ(expected_other.error(), persia::storage_error::duplicate_secondary_key);
+        REQUIRE_EQ(order_storage::open("orders.pmap", 16).error(), persia::storage_error::invalid_file_signature);
+    }
+    
+    
+    SCENARIO("taking snapshot of storage") {
+        auto expected_target = storage::create("test.pmap", 4);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(item{1, 1}));
+        REQUIRE(!expected_target->snapshot("snapshot.pmap"));
+        REQUIRE(expected_target->insert_or_assign(item{1, 2}));
+        auto expected_snapshot = storage::open("snapshot.pmap", 4);
+        REQUIRE(!!expected_snapshot);
+        REQUIRE_EQ(expected_snapshot->size(), 1);
+        REQUIRE_EQ(expected_snapshot->find(1)->data, 1);
+        REQUIRE_EQ(expected_target->find(1)->data, 2);
+    }
+    
+    
+    SCENARIO("checkpointing dirty pages") {
+        auto expected_target = storage::create("test.pmap", 4096);
+        REQUIRE(!!expected_target);
+        REQUIRE_NE(expected_target->dirty_pages(), 0);
+        REQUIRE(!expected_target->checkpoint());
+        REQUIRE_EQ(expected_target->dirty_pages(), 0);
+        REQUIRE(expected_target->insert(item{1, 1}));
+        REQUIRE_EQ(expected_target->dirty_pages(), 1);
+        REQUIRE(!expected_target->checkpoint());
+        REQUIRE_EQ(expected_target->dirty_pages(), 0);
+        REQUIRE_EQ(expected_target->find(1)->data, 1);
+        REQUIRE_EQ(expected_target->dirty_pages(), 0);
+        expected_target->modify(1)->data = 2;
+        REQUIRE_EQ(expected_target->dirty_pages(), 1);
+        REQUIRE(!expected_target->checkpoint());
+        REQUIRE(expected_target->erase(1));
+        REQUIRE_EQ(expected_target->dirty_pages(), 1);
+        REQUIRE(!expected_target->checkpoint());
+        REQUIRE_EQ(expected_target->dirty_pages(), 0);
+    }
+    
+    
+    SCENARIO("checkpointing concurrently with erasing") {
+        constexpr int keys = 4096;
+        {
+            auto expected_target = storage::create("test.pmap", keys);
+            REQUIRE(!!expected_target);
+            for(auto key = 0; key != keys; ++key)
+                REQUIRE(expected_target->insert(item{key, key}));
+            REQUIRE(!expected_target->checkpoint());
+            auto& target = *expected_target;
+            auto erasing = std::atomic<bool>{true};
+            auto checkpointer = std::thread{[&] {
+                while(erasing.load())
+                    target.checkpoint();
+            }};
+            for(auto key = 0; key != keys; ++key)
+                target.erase(key);
+            erasing.store(false);
+            checkpointer.join();
+            REQUIRE(!target.checkpoint());
+            REQUIRE_EQ(target.durable_sequence(), target.sequence());
+            REQUIRE_EQ(target.dirty_pages(), 0);
+        }
+        auto expected_target = storage::open("test.pmap", keys);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->empty());
+    }
+    
+    
+    SCENARIO("adding to counters concurrently") {
+        constexpr int threads = 4;
+        constexpr int additions = 10000;
+        constexpr int keys = 16;
+        auto expected_target = storage::create("test.pmap", keys);
+        REQUIRE(!!expected_target);
+        for(auto key = 0; key != keys; ++key)
+            REQUIRE(expected_target->insert(item{key, 0}));
+        REQUIRE(!expected_target->checkpoint());
+        auto& target = *expected_target;
+        auto workers = std::vector<std::thread>{};
+        for(auto t = 0; t != threads; ++t)
+            workers.emplace_back([&target] {
+                for(auto i = 0; i != additions; ++i)
+                    target.fetch_add(i % keys, &item::data, 1);
+            });
+        for(auto& each: workers)
+            each.join();
+        auto counted = true;
+        for(auto key = 0; key != keys; ++key)
+            counted = counted && target.fetch_add(key, &item::data, 0) == threads * additions / keys;
+        REQUIRE(counted);
+        REQUIRE_EQ(target.fetch_add(1, &item::data, -1), threads * additions / keys);
+        REQUIRE_EQ(target.find(1)->data, threads * additions / keys - 1);
+        REQUIRE(!target.fetch_add(keys, &item::data, 1));
+        REQUIRE_NE(target.dirty_pages(), 0);
+    }
+    
+    
+    SCENARIO("committing transaction") {
+        auto expected_target = storage::create("test.pmap", 4);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(item{1, 10}));
+        auto transaction = storage::transaction{*expected_target};
+        transaction.erase(1);
+        transaction.insert(item{2, 10});
+        transaction.insert_or_assign(item{3, 0});
+        REQUIRE(!transaction.commit());
+        REQUIRE(transaction.empty());
+        REQUIRE_EQ(expected_target->size(), 2);
+        REQUIRE(!expected_target->contains(1));
+        REQUIRE_EQ(expected_target->find(2)->data, 10);
+        REQUIRE(!std::filesystem::exists("test.pmap.redo"));
+    }
+    
+    
+    SCENARIO("rejecting transaction") {
+        auto expected_target = storage::open("test.pmap", 4);
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->size(), 2);
+        auto transaction = storage::transaction{*expected_target};
+        transaction.insert_or_assign(item{2, 0});
+        transaction.erase(1);
+        REQUIRE_EQ(transaction.commit(), persia::storage_error::transaction_rejected);
+        REQUIRE_EQ(expected_target->find(2)->data, 10);
+        transaction.insert(item{4, 4});
+        transaction.insert(item{5, 5});
+        transaction.insert(item{6, 6});
+        REQUIRE_EQ(transaction.commit(), persia::storage_error::transaction_rejected);
+        REQUIRE_EQ(expected_target->size(), 2);
+    }
+    
+    
+    SCENARIO("checking unique secondary keys in transaction") {
+        auto expected_target = order_storage::create("orders.pmap", 16);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(order{1, 101, 7}));
+        auto transaction = order_storage::transaction{*expected_target};
+        transaction.insert(order{2, 101, 7});
+        REQUIRE_EQ(transaction.commit(), persia::storage_error::transaction_rejected);
+        transaction.erase(1);
+        transaction.insert(order{2, 101, 7});
+        REQUIRE(!transaction.commit());
+        REQUIRE_EQ(expected_target->find_by<0>(101)->id, 2);
+        transaction.insert(order{3, 102, 7});
+        transaction.insert(order{4, 102, 7});
+        REQUIRE_EQ(transaction.commit(), persia::storage_error::transaction_rejected);
+    }
+        
+    
+    SCENARIO("reading snapshot while mutating storage") {
+        auto expected_target = versioned_storage::create("versioned.pmap", 8);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(item{1, 1}));
+        REQUIRE(expected_target->insert(item{2, 2}));
+        auto const before = expected_target->read_snapshot();
+        REQUIRE(expected_target->insert_or_assign(item{1, 10}));
+        REQUIRE(expected_target->erase(2));
+        REQUIRE(expected_target->insert(item{3, 3}));
+        auto seen = std::vector<std::pair<int, int>>{};
+        for(auto const& each: before)
+            seen.emplace_back(each.key, each.data);
+        std::sort(seen.begin(), seen.end());
+        REQUIRE_EQ(seen, std::vector<std::pair<int, int>>{{1, 1}, {2, 2}});
+        seen.clear();
+        for(auto const& each: expected_target->read_snapshot())
+            seen.emplace_back(each.key, each.data);
+        std::sort(seen.begin(), seen.end());
+        REQUIRE_EQ(seen, std::vector<std::pair<int, int>>{{1, 10}, {3, 3}});
+        REQUIRE_EQ(expected_target->size(), 2);
+        REQUIRE_EQ(expected_target->find(1)->data, 10);
+    }
+    
+    
+    SCENARIO("collecting records retired before snapshots") {
+        auto expected_target = versioned_storage::create("versioned.pmap", 4);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->insert(item{1, 0}));
+        {
+            auto const view = expected_target->read_snapshot();
+            REQUIRE(expected_target->insert_or_assign(item{1, 1}));
+            REQUIRE(expected_target->insert_or_assign(item{1, 2}));
+            REQUIRE(expected_target->insert_or_assign(item{1, 3}));
+            REQUIRE(!expected_target->insert_or_assign(item{1, 4}));
+            REQUIRE_EQ(view.begin()->data, 0);
+        }
+        REQUIRE(expected_target->insert_or_assign(item{1, 4}));
+        REQUIRE(expected_target->insert(item{2, 2}));
+        REQUIRE_EQ(expected_target->find(1)->data, 4);
+    }
+    
+    
+    SCENARIO("updating items with multiversion records") {
+        auto expected_target = versioned_storage::create("updated.pmap", 4);
+        REQUIRE(!!expected_target);
+        REQUIRE(expected_target->emplace(item{1, 1}));
+        auto const before = expected_target->read_snapshot();
+        REQUIRE(expected_target->update(1, [](item& i) { i.data = 2; }));
+        REQUIRE_EQ(before.begin()->data, 1);
+        REQUIRE_EQ(expected_target->find(1)->data, 2);
+        REQUIRE_EQ(expected_target->size(), 1);
+    }
+    
+    
+    SCENARIO("opening storage with multiversion records") {
+        auto expected_target = versioned_storage::open("versioned.pmap", 4);
+        REQUIRE(!!expected_target);
+        REQUIRE_EQ(expected_target->size(), 2);
+        REQUIRE_EQ(expected_target->find(1)->data, 4);
+        REQUIRE_EQ(expected_target->find(2)->data, 2);
+        REQUIRE(expected_target->insert(item{3, 3}));
+        REQUIRE(expected_target->insert(item{4, 4}));
+        REQUIRE(expected_target->fully_occupied());
+        auto expected_plain = storage::open("versioned.pmap", 4);
+        REQUIRE_EQ(expected_plain.error(), persia::storage_error::mismatch_format);
+    }
+    
+    
+    SCENARIO("scanning snapshots concurrently with writer") {
+        constexpr int items = 16;
+        auto expected_target = versioned_storage::create("versioned.pmap", 4 * items);
+        REQUIRE(!!expected_target);
+        for(auto key = 0; key != items; ++key)
+            REQUIRE(expected_target->insert(item{key, 0}));
+        auto& target = *expected_target;
+        auto done = std::atomic<bool>{false};
+        auto consistent = true;
+        auto reader = std::thread{[&] {
+            while(!done.load()) {
+                // Writer assigns rounds in key order, so a snapshot taken
+                // in the middle of a round sees its prefix only
+                int data[items];
+                auto count = 0;
+                for(auto const& each: target.read_snapshot()) {
+                    data[each.key] = each.data;
+                    ++count;
+                }
+                consistent = consistent && count == items;
+                for(auto key = 1; consistent && key != items; ++key)
+                    consistent = data[key] <= data[key - 1] && data[0] - data[key] <= 1;
+            }
+        }};
+        // Assigning fails while views pin all spare records
+        for(auto round = 1; round != 2000; ++round)
+            for(auto key = 0; key != items; ++key)
+                while(!target.insert_or_assign(item{key, round}))
+                    std::this_thread::yield();
+        done.store(true);
+        reader.join();
+        REQUIRE(consistent);
+    }
+    
 }
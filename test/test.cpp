@@ -1,5 +1,17 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
+#include "bitset_storage.test.hpp"
+#include "cache.test.hpp"
+#include "change_log.test.hpp"
+#include "compressed_storage.test.hpp"
+#include "flusher.test.hpp"
+#include "log.test.hpp"
 #include "mapped_file.test.hpp"
+#include "multi_storage.test.hpp"
+#include "ordered_storage.test.hpp"
+#include "priority_queue.test.hpp"
+#include "queue.test.hpp"
+#include "split_storage.test.hpp"
 #include "storage.test.hpp"
+#include "time_series.test.hpp"
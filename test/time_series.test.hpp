@@ -0,0 +1,127 @@
+#pragma once
+
+
+#include "doctest.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <persia/mapped_file.hpp>
+#include <persia/time_series.hpp>
+
+
+struct measurement {
+    std::int64_t time;
+    int value;
+
+    static std::int64_t time_of(measurement const& measurement) noexcept {
+        return measurement.time;
+    }
+};
+
+using measurement_series = persia::time_series<measurement>;
+
+
+inline std::vector<int> values_of(measurement_series& series, std::int64_t from, std::int64_t to) {
+    auto spans = std::vector<persia::span<measurement const>>{};
+    REQUIRE(!series.range(from, to, spans));
+    auto values = std::vector<int>{};
+    for(auto const& each: spans)
+        for(auto const& item: each)
+            values.push_back(item.value);
+    return values;
+}
+
+
+TEST_SUITE("time_series") {
+
+    SCENARIO("appending samples to time series") {
+        auto expected_series = measurement_series::create("samples", 4);
+        REQUIRE(!!expected_series);
+        REQUIRE(expected_series->empty());
+        REQUIRE(values_of(*expected_series, 0, 100).empty());
+        for(auto i = 0; i != 10; ++i)
+            REQUIRE(!expected_series->append(measurement{i * 10, i}));
+        measurement const batch[] = {{100, 10}, {100, 11}, {110, 12}};
+        REQUIRE(!expected_series->append(batch));
+        measurement const unordered[] = {{120, 13}, {115, 14}};
+        REQUIRE_EQ(expected_series->append(unordered), persia::time_series_error::out_of_order);
+        REQUIRE_EQ(expected_series->append(measurement{100, 0}), persia::time_series_error::out_of_order);
+        REQUIRE_EQ(expected_series->size(), 13);
+        REQUIRE_EQ(expected_series->chunk_count(), 4);
+        REQUIRE_EQ(expected_series->front_time(), 0);
+        REQUIRE_EQ(expected_series->back_time(), 110);
+        REQUIRE_EQ(values_of(*expected_series, 25, 65), std::vector<int>{3, 4, 5, 6});
+        REQUIRE_EQ(values_of(*expected_series, 100, 101), std::vector<int>{10, 11});
+        REQUIRE_EQ(values_of(*expected_series, -10, 5), std::vector<int>{0});
+        REQUIRE(values_of(*expected_series, 111, 200).empty());
+        REQUIRE(values_of(*expected_series, 50, 50).empty());
+        REQUIRE(!expected_series->flush());
+    }
+
+
+    SCENARIO("mapping only chunks queried") {
+        auto expected_series = measurement_series::open("samples");
+        REQUIRE(!!expected_series);
+        REQUIRE_EQ(expected_series->chunk_capacity(), 4);
+        REQUIRE_EQ(expected_series->size(), 13);
+        REQUIRE_EQ(expected_series->back_time(), 110);
+        REQUIRE_EQ(expected_series->mapped_chunk_count(), 1);
+        auto spans = std::vector<persia::span<measurement const>>{};
+        REQUIRE(!expected_series->range(40, 60, spans));
+        REQUIRE_EQ(spans.size(), 1);
+        REQUIRE_EQ(spans[0].size(), 2);
+        REQUIRE_EQ(spans[0][0].value, 4);
+        REQUIRE_EQ(expected_series->mapped_chunk_count(), 2);
+        REQUIRE_EQ(values_of(*expected_series, 0, 1000).size(), 13);
+        REQUIRE_EQ(expected_series->mapped_chunk_count(), 4);
+        expected_series->release();
+        REQUIRE_EQ(expected_series->mapped_chunk_count(), 1);
+        REQUIRE(!expected_series->append(measurement{120, 13}));
+        REQUIRE_EQ(values_of(*expected_series, 105, 1000), std::vector<int>{12, 13});
+    }
+
+
+    SCENARIO("truncating time series") {
+        auto expected_series = measurement_series::open("samples");
+        REQUIRE(!!expected_series);
+        REQUIRE(!expected_series->truncate(45));
+        REQUIRE_EQ(expected_series->chunk_count(), 3);
+        REQUIRE_EQ(expected_series->front_time(), 40);
+        REQUIRE_EQ(expected_series->size(), 10);
+        REQUIRE(!expected_series->truncate(1000));
+        REQUIRE_EQ(expected_series->chunk_count(), 1);
+        REQUIRE_EQ(values_of(*expected_series, 0, 1000), std::vector<int>{12, 13});
+        auto expected_other = measurement_series::open("samples");
+        REQUIRE(!!expected_other);
+        REQUIRE_EQ(expected_other->size(), 2);
+        auto const expected_missing = measurement_series::open("no_samples");
+        REQUIRE(!expected_missing);
+    }
+
+
+    SCENARIO("querying time series with empty last chunk") {
+        {
+            auto expected_series = measurement_series::create("tail_samples", 4);
+            REQUIRE(!!expected_series);
+            for(auto i = 0; i != 5; ++i)
+                REQUIRE(!expected_series->append(measurement{i * 10, i}));
+        }
+        {
+            // As if crashed right after adding the chunk
+            auto expected_file = persia::mapped_file::create("tail_samples/00000000000000000001.chunk");
+            REQUIRE(!!expected_file);
+            auto* header = expected_file->cast<persia::detail::chunk_header>(0);
+            header->size = 0;
+            header->min_time = header->max_time = 0;
+        }
+        auto expected_series = measurement_series::open("tail_samples");
+        REQUIRE(!!expected_series);
+        REQUIRE_EQ(expected_series->size(), 4);
+        REQUIRE_EQ(values_of(*expected_series, 0, 100), std::vector<int>{0, 1, 2, 3});
+        REQUIRE_EQ(values_of(*expected_series, 25, 100), std::vector<int>{3});
+        REQUIRE(!expected_series->append(measurement{40, 4}));
+        REQUIRE_EQ(values_of(*expected_series, 25, 100), std::vector<int>{3, 4});
+    }
+
+}